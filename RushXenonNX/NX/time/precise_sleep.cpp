@@ -0,0 +1,184 @@
+#include "precise_sleep.h"
+#include "../log/nxlogger.h"
+#include <switch.h>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace {
+
+    // How close to the deadline we stop trusting the kernel and start spinning.
+    constexpr uint64_t SpinWindowNs = 20'000;
+
+    // Alertable sleeps are split into slices this long so an alert is noticed promptly.
+    constexpr uint64_t AbortPollNs = 1'000'000;
+
+    // Longest single kernel sleep, keeps tick/ns conversions far away from overflow.
+    constexpr uint64_t MaxSliceNs = 1'000'000'000;
+
+    // Upper bound for the oversleep estimate, a single bad wake-up must not turn
+    // every sleep into a busy wait.
+    constexpr uint64_t MaxOversleepNs = 2'000'000;
+
+    std::atomic<uint64_t> s_oversleepTicks{ armNsToTicks(100'000) };
+
+    inline void SpinPause()
+    {
+#if defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    void RecordOversleep(uint64_t requestedTicks, uint64_t sleptTicks)
+    {
+        const uint64_t sample = std::min(sleptTicks > requestedTicks ? sleptTicks - requestedTicks : 0,
+            armNsToTicks(MaxOversleepNs));
+
+        // Exponential moving average with 1/8 weight; races between threads only lose a sample.
+        const uint64_t estimate = s_oversleepTicks.load(std::memory_order_relaxed);
+        const int64_t delta = (int64_t)sample - (int64_t)estimate;
+        s_oversleepTicks.store(estimate + delta / 8, std::memory_order_relaxed);
+    }
+
+    inline bool IsAborted(const std::atomic<bool>* abort)
+    {
+        return abort != nullptr && abort->load(std::memory_order_acquire);
+    }
+
+} // namespace
+
+void PreciseSleep::Calibrate()
+{
+    constexpr size_t SampleCount = 16;
+    constexpr uint64_t SampleNs = 500'000;
+
+    const uint64_t requestedTicks = armNsToTicks(SampleNs);
+    uint64_t worstTicks = 0;
+
+    for (size_t i = 0; i < SampleCount; i++)
+    {
+        const uint64_t start = armGetSystemTick();
+        svcSleepThread(SampleNs);
+        const uint64_t slept = armGetSystemTick() - start;
+
+        if (slept > requestedTicks)
+            worstTicks = std::max(worstTicks, slept - requestedTicks);
+    }
+
+    worstTicks = std::min(worstTicks, armNsToTicks(MaxOversleepNs));
+    s_oversleepTicks.store(worstTicks, std::memory_order_relaxed);
+
+    SDLogger::Log("PreciseSleep::Calibrate - oversleep estimate %llu ns",
+        (unsigned long long)armTicksToNs(worstTicks));
+}
+
+bool PreciseSleep::SleepUntil(uint64_t deadlineTick, const std::atomic<bool>* abort)
+{
+    const uint64_t spinWindowTicks = armNsToTicks(SpinWindowNs);
+    const uint64_t sliceTicks = armNsToTicks(abort != nullptr ? AbortPollNs : MaxSliceNs);
+
+    while (true)
+    {
+        if (IsAborted(abort))
+            return false;
+
+        const uint64_t now = armGetSystemTick();
+        if (now >= deadlineTick)
+            return true;
+
+        const uint64_t remaining = deadlineTick - now;
+        const uint64_t slack = s_oversleepTicks.load(std::memory_order_relaxed) + spinWindowTicks;
+
+        if (remaining <= slack)
+            break;
+
+        const uint64_t sleepTicks = std::min(remaining - slack, sliceTicks);
+
+        svcSleepThread((s64)armTicksToNs(sleepTicks));
+        RecordOversleep(sleepTicks, armGetSystemTick() - now);
+    }
+
+    while (armGetSystemTick() < deadlineTick)
+    {
+        if (IsAborted(abort))
+            return false;
+
+        SpinPause();
+    }
+
+    return true;
+}
+
+bool PreciseSleep::SleepFor(uint64_t ns, const std::atomic<bool>* abort)
+{
+    return SleepUntil(armGetSystemTick() + armNsToTicks(ns), abort);
+}
+
+void PreciseSleep::Yield()
+{
+    svcSleepThread(YieldType_WithoutCoreMigration);
+}
+
+void PreciseSleep::RunJitterBenchmark()
+{
+    // Wake-up error buckets in microseconds, the last one catches everything above.
+    constexpr int64_t BucketLimitsUs[] = { 0, 5, 10, 25, 50, 100, 250, 1000 };
+    constexpr size_t BucketCount = std::size(BucketLimitsUs) + 1;
+    constexpr uint64_t IntervalsUs[] = { 100, 500, 1000, 4000, 16667 };
+    constexpr size_t Iterations = 200;
+
+    auto bucketOf = [&](int64_t errorUs)
+    {
+        for (size_t i = 0; i < std::size(BucketLimitsUs); i++)
+        {
+            if (errorUs < BucketLimitsUs[i])
+                return i;
+        }
+
+        return BucketCount - 1;
+    };
+
+    auto report = [&](const char* method, uint64_t intervalUs, const uint32_t (&histogram)[BucketCount], int64_t worstUs)
+    {
+        char line[256];
+        int length = snprintf(line, sizeof(line), "PreciseSleep %-6s %6lluus worst=%lldus |", method,
+            (unsigned long long)intervalUs, (long long)worstUs);
+
+        for (size_t i = 0; i < BucketCount && length < (int)sizeof(line); i++)
+        {
+            if (i < std::size(BucketLimitsUs))
+                length += snprintf(line + length, sizeof(line) - length, " <%lld:%u", (long long)BucketLimitsUs[i], histogram[i]);
+            else
+                length += snprintf(line + length, sizeof(line) - length, " >=%lld:%u", (long long)BucketLimitsUs[i - 1], histogram[i]);
+        }
+
+        SDLogger::Log("%s", line);
+    };
+
+    SDLogger::Log("PreciseSleep::RunJitterBenchmark - %zu iterations per interval", Iterations);
+
+    for (uint64_t intervalUs : IntervalsUs)
+    {
+        for (int hybrid = 0; hybrid < 2; hybrid++)
+        {
+            uint32_t histogram[BucketCount]{};
+            int64_t worstUs = 0;
+
+            for (size_t i = 0; i < Iterations; i++)
+            {
+                const uint64_t start = armGetSystemTick();
+
+                if (hybrid)
+                    SleepFor(intervalUs * 1000);
+                else
+                    svcSleepThread((s64)(intervalUs * 1000));
+
+                const int64_t errorUs = (int64_t)(armTicksToNs(armGetSystemTick() - start) / 1000) - (int64_t)intervalUs;
+                histogram[bucketOf(errorUs)]++;
+                worstUs = std::max(worstUs, errorUs);
+            }
+
+            report(hybrid ? "hybrid" : "kernel", intervalUs, histogram, worstUs);
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Hybrid sleep for guest frame limiters and timed waits: the kernel sleep handles
+// the bulk of the interval and the tail is spun on the system tick, so deadlines
+// land within a few microseconds instead of whenever the scheduler wakes us up.
+namespace PreciseSleep {
+
+    // Measures how late svcSleepThread wakes up on this console. Call once at boot,
+    // the estimate keeps adapting afterwards.
+    void Calibrate();
+
+    // Sleeps until the given armGetSystemTick() value. If `abort` is given it is polled
+    // while waiting; returns false when it was raised before the deadline.
+    bool SleepUntil(uint64_t deadlineTick, const std::atomic<bool>* abort = nullptr);
+
+    bool SleepFor(uint64_t ns, const std::atomic<bool>* abort = nullptr);
+
+    // Gives the rest of the time slice to another ready thread on this core.
+    void Yield();
+
+    // Logs a histogram of wake-up error for common frame-limiter intervals,
+    // comparing plain svcSleepThread against SleepFor.
+    void RunJitterBenchmark();
+
+} // namespace PreciseSleep
@@ -0,0 +1,669 @@
+#include "aes_cbc.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <vector>
+
+#if defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO)
+#include <arm_neon.h>
+#define AES_CBC_ARMV8 1
+#endif
+
+using namespace AesCbc;
+
+constexpr size_t AES_WORKER_STACK_SIZE = 0x4000;
+constexpr int AES_WORKER_PRIORITY = 0x2C;
+
+namespace {
+
+    using RoundKeys = uint8_t[Rounds + 1][BlockSize];
+
+    // Decrypts `blocks` blocks in place. `iv` holds the ciphertext block before the first
+    // one on entry and the last one on return.
+    using SegmentFunction = void (*)(const RoundKeys& keys, uint8_t* iv, uint8_t* data, size_t blocks);
+
+    struct Tables
+    {
+        uint8_t sbox[256];
+        uint8_t inverse[256];
+
+        // InvMixColumns of the inverse S-box, one byte rotation per table.
+        uint32_t td[4][256];
+    };
+
+    uint8_t Multiply(uint8_t a, uint8_t b)
+    {
+        uint8_t result = 0;
+        while (b != 0)
+        {
+            if (b & 1)
+                result ^= a;
+
+            a = uint8_t((a << 1) ^ (a & 0x80 ? 0x1B : 0));
+            b >>= 1;
+        }
+
+        return result;
+    }
+
+    uint8_t RotateByte(uint8_t value, int shift)
+    {
+        return uint8_t((value << shift) | (value >> (8 - shift)));
+    }
+
+    uint32_t RotateWord(uint32_t value, int shift)
+    {
+        return (value >> shift) | (value << (32 - shift));
+    }
+
+    Tables BuildTables()
+    {
+        Tables tables{};
+
+        // Walk the multiplicative group with generator 3, keeping p * q == 1.
+        uint8_t p = 1;
+        uint8_t q = 1;
+        do
+        {
+            p = uint8_t(p ^ (p << 1) ^ (p & 0x80 ? 0x1B : 0));
+
+            q ^= uint8_t(q << 1);
+            q ^= uint8_t(q << 2);
+            q ^= uint8_t(q << 4);
+            if (q & 0x80)
+                q ^= 0x09;
+
+            tables.sbox[p] = q ^ RotateByte(q, 1) ^ RotateByte(q, 2) ^ RotateByte(q, 3) ^ RotateByte(q, 4) ^ 0x63;
+        } while (p != 1);
+
+        tables.sbox[0] = 0x63;
+
+        for (int i = 0; i < 256; i++)
+            tables.inverse[tables.sbox[i]] = uint8_t(i);
+
+        for (int i = 0; i < 256; i++)
+        {
+            const uint8_t value = tables.inverse[i];
+            const uint32_t word = uint32_t(Multiply(value, 0x0E)) << 24 | uint32_t(Multiply(value, 0x09)) << 16
+                | uint32_t(Multiply(value, 0x0D)) << 8 | Multiply(value, 0x0B);
+
+            tables.td[0][i] = word;
+            for (int table = 1; table < 4; table++)
+                tables.td[table][i] = RotateWord(word, 8 * table);
+        }
+
+        return tables;
+    }
+
+    const Tables& GetTables()
+    {
+        static const Tables tables = BuildTables();
+        return tables;
+    }
+
+    uint32_t LoadWord(const uint8_t* bytes)
+    {
+        return uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 | uint32_t(bytes[2]) << 8 | bytes[3];
+    }
+
+    void StoreWord(uint8_t* bytes, uint32_t word)
+    {
+        bytes[0] = uint8_t(word >> 24);
+        bytes[1] = uint8_t(word >> 16);
+        bytes[2] = uint8_t(word >> 8);
+        bytes[3] = uint8_t(word);
+    }
+
+    // Decryption schedule of the equivalent inverse cipher: the encryption round keys in
+    // reverse, with InvMixColumns applied to all but the outer two. Both the table and the
+    // AESD/AESIMC backends consume it as is.
+    void ExpandKey(const uint8_t* key, RoundKeys& keys)
+    {
+        const Tables& tables = GetTables();
+        const uint8_t* sbox = tables.sbox;
+
+        uint32_t words[(Rounds + 1) * 4];
+        for (int i = 0; i < 4; i++)
+            words[i] = LoadWord(key + 4 * i);
+
+        uint8_t rcon = 1;
+        for (size_t i = 4; i < std::size(words); i++)
+        {
+            uint32_t temp = words[i - 1];
+            if (i % 4 == 0)
+            {
+                temp = uint32_t(sbox[(temp >> 16) & 0xFF]) << 24 | uint32_t(sbox[(temp >> 8) & 0xFF]) << 16
+                    | uint32_t(sbox[temp & 0xFF]) << 8 | sbox[temp >> 24];
+                temp ^= uint32_t(rcon) << 24;
+                rcon = Multiply(rcon, 2);
+            }
+
+            words[i] = words[i - 4] ^ temp;
+        }
+
+        for (size_t round = 0; round <= Rounds; round++)
+        {
+            const uint32_t* source = words + 4 * (Rounds - round);
+
+            for (int i = 0; i < 4; i++)
+            {
+                uint32_t word = source[i];
+
+                // td[n][sbox[x]] is InvMixColumns of byte x alone, the S-boxes cancel out.
+                if (round != 0 && round != Rounds)
+                {
+                    word = tables.td[0][sbox[word >> 24]] ^ tables.td[1][sbox[(word >> 16) & 0xFF]]
+                        ^ tables.td[2][sbox[(word >> 8) & 0xFF]] ^ tables.td[3][sbox[word & 0xFF]];
+                }
+
+                StoreWord(keys[round] + 4 * i, word);
+            }
+        }
+    }
+
+    void DecryptTable(const RoundKeys& keys, uint8_t* iv, uint8_t* data, size_t blocks)
+    {
+        const Tables& tables = GetTables();
+        const uint32_t* td0 = tables.td[0];
+        const uint32_t* td1 = tables.td[1];
+        const uint32_t* td2 = tables.td[2];
+        const uint32_t* td3 = tables.td[3];
+        const uint8_t* inverse = tables.inverse;
+
+        uint32_t rk[(Rounds + 1) * 4];
+        for (size_t i = 0; i < std::size(rk); i++)
+            rk[i] = LoadWord(keys[i / 4] + 4 * (i % 4));
+
+        uint32_t chain[4] = { LoadWord(iv), LoadWord(iv + 4), LoadWord(iv + 8), LoadWord(iv + 12) };
+
+        for (; blocks != 0; blocks--, data += BlockSize)
+        {
+            const uint32_t c[4] = { LoadWord(data), LoadWord(data + 4), LoadWord(data + 8), LoadWord(data + 12) };
+
+            uint32_t s0 = c[0] ^ rk[0];
+            uint32_t s1 = c[1] ^ rk[1];
+            uint32_t s2 = c[2] ^ rk[2];
+            uint32_t s3 = c[3] ^ rk[3];
+
+            for (size_t round = 1; round < Rounds; round++)
+            {
+                const uint32_t* k = rk + 4 * round;
+                const uint32_t t0 = td0[s0 >> 24] ^ td1[(s3 >> 16) & 0xFF] ^ td2[(s2 >> 8) & 0xFF] ^ td3[s1 & 0xFF] ^ k[0];
+                const uint32_t t1 = td0[s1 >> 24] ^ td1[(s0 >> 16) & 0xFF] ^ td2[(s3 >> 8) & 0xFF] ^ td3[s2 & 0xFF] ^ k[1];
+                const uint32_t t2 = td0[s2 >> 24] ^ td1[(s1 >> 16) & 0xFF] ^ td2[(s0 >> 8) & 0xFF] ^ td3[s3 & 0xFF] ^ k[2];
+                const uint32_t t3 = td0[s3 >> 24] ^ td1[(s2 >> 16) & 0xFF] ^ td2[(s1 >> 8) & 0xFF] ^ td3[s0 & 0xFF] ^ k[3];
+
+                s0 = t0;
+                s1 = t1;
+                s2 = t2;
+                s3 = t3;
+            }
+
+            auto last = [&](uint32_t w0, uint32_t w1, uint32_t w2, uint32_t w3)
+                {
+                    return uint32_t(inverse[w0 >> 24]) << 24 | uint32_t(inverse[(w1 >> 16) & 0xFF]) << 16
+                        | uint32_t(inverse[(w2 >> 8) & 0xFF]) << 8 | inverse[w3 & 0xFF];
+                };
+
+            const uint32_t* k = rk + 4 * Rounds;
+            StoreWord(data, last(s0, s3, s2, s1) ^ k[0] ^ chain[0]);
+            StoreWord(data + 4, last(s1, s0, s3, s2) ^ k[1] ^ chain[1]);
+            StoreWord(data + 8, last(s2, s1, s0, s3) ^ k[2] ^ chain[2]);
+            StoreWord(data + 12, last(s3, s2, s1, s0) ^ k[3] ^ chain[3]);
+
+            memcpy(chain, c, sizeof(chain));
+        }
+
+        for (int i = 0; i < 4; i++)
+            StoreWord(iv + 4 * i, chain[i]);
+    }
+
+#ifdef AES_CBC_ARMV8
+    // AESD is AddRoundKey + InvShiftRows + InvSubBytes, AESIMC is InvMixColumns.
+    inline uint8x16_t DecryptBlockArmCrypto(uint8x16_t state, const uint8x16_t* k)
+    {
+        for (size_t round = 0; round < Rounds - 1; round++)
+            state = vaesimcq_u8(vaesdq_u8(state, k[round]));
+
+        return veorq_u8(vaesdq_u8(state, k[Rounds - 1]), k[Rounds]);
+    }
+
+    void DecryptArmCrypto(const RoundKeys& keys, uint8_t* iv, uint8_t* data, size_t blocks)
+    {
+        uint8x16_t k[Rounds + 1];
+        for (size_t round = 0; round <= Rounds; round++)
+            k[round] = vld1q_u8(keys[round]);
+
+        uint8x16_t chain = vld1q_u8(iv);
+
+        // Four independent blocks in flight hide the latency of each AESD/AESIMC pair.
+        for (; blocks >= 4; blocks -= 4, data += 4 * BlockSize)
+        {
+            const uint8x16_t c0 = vld1q_u8(data);
+            const uint8x16_t c1 = vld1q_u8(data + BlockSize);
+            const uint8x16_t c2 = vld1q_u8(data + 2 * BlockSize);
+            const uint8x16_t c3 = vld1q_u8(data + 3 * BlockSize);
+
+            uint8x16_t s0 = c0;
+            uint8x16_t s1 = c1;
+            uint8x16_t s2 = c2;
+            uint8x16_t s3 = c3;
+
+            for (size_t round = 0; round < Rounds - 1; round++)
+            {
+                s0 = vaesimcq_u8(vaesdq_u8(s0, k[round]));
+                s1 = vaesimcq_u8(vaesdq_u8(s1, k[round]));
+                s2 = vaesimcq_u8(vaesdq_u8(s2, k[round]));
+                s3 = vaesimcq_u8(vaesdq_u8(s3, k[round]));
+            }
+
+            s0 = veorq_u8(vaesdq_u8(s0, k[Rounds - 1]), k[Rounds]);
+            s1 = veorq_u8(vaesdq_u8(s1, k[Rounds - 1]), k[Rounds]);
+            s2 = veorq_u8(vaesdq_u8(s2, k[Rounds - 1]), k[Rounds]);
+            s3 = veorq_u8(vaesdq_u8(s3, k[Rounds - 1]), k[Rounds]);
+
+            vst1q_u8(data, veorq_u8(s0, chain));
+            vst1q_u8(data + BlockSize, veorq_u8(s1, c0));
+            vst1q_u8(data + 2 * BlockSize, veorq_u8(s2, c1));
+            vst1q_u8(data + 3 * BlockSize, veorq_u8(s3, c2));
+
+            chain = c3;
+        }
+
+        for (; blocks != 0; blocks--, data += BlockSize)
+        {
+            const uint8x16_t c = vld1q_u8(data);
+            vst1q_u8(data, veorq_u8(DecryptBlockArmCrypto(c, k), chain));
+            chain = c;
+        }
+
+        vst1q_u8(iv, chain);
+    }
+#endif
+
+    SegmentFunction GetSegmentFunction(Backend backend)
+    {
+#ifdef AES_CBC_ARMV8
+        if (backend == Backend::ArmCrypto)
+            return DecryptArmCrypto;
+#endif
+        return DecryptTable;
+    }
+
+    size_t g_threadCount = MaxThreads;
+
+    struct SegmentJob
+    {
+        SegmentFunction function;
+        const RoundKeys* keys;
+        uint8_t iv[BlockSize];
+        uint8_t* data;
+        size_t blocks;
+    };
+
+    void SegmentWorker(void* arg)
+    {
+        auto* job = static_cast<SegmentJob*>(arg);
+        job->function(*job->keys, job->iv, job->data, job->blocks);
+    }
+
+    void DecryptParallel(SegmentFunction function, Context& ctx, uint8_t* data, size_t blocks, size_t threads)
+    {
+        SegmentJob jobs[MaxThreads];
+        Thread workers[MaxThreads - 1];
+
+        // Each segment chains from the last ciphertext block of the one before, which that
+        // segment overwrites as it goes, so every IV is copied out before anything starts.
+        size_t start = 0;
+        for (size_t i = 0; i < threads; i++)
+        {
+            const size_t count = i + 1 == threads ? blocks - start : blocks / threads;
+            jobs[i] = { function, &ctx.roundKeys, {}, data + start * BlockSize, count };
+            memcpy(jobs[i].iv, i == 0 ? ctx.iv : data + (start - 1) * BlockSize, BlockSize);
+            start += count;
+        }
+
+        size_t started = 0;
+        while (started + 1 < threads)
+        {
+            // Worker i runs on core i; the caller keeps the first segment.
+            Thread& worker = workers[started];
+            if (R_FAILED(threadCreate(&worker, SegmentWorker, &jobs[started + 1], nullptr, AES_WORKER_STACK_SIZE,
+                AES_WORKER_PRIORITY, int(started + 1))))
+            {
+                break;
+            }
+
+            if (R_FAILED(threadStart(&worker)))
+            {
+                threadClose(&worker);
+                break;
+            }
+
+            started++;
+        }
+
+        SegmentWorker(&jobs[0]);
+
+        // Segments whose thread could not be started.
+        for (size_t i = started + 1; i < threads; i++)
+            SegmentWorker(&jobs[i]);
+
+        for (size_t i = 0; i < started; i++)
+        {
+            threadWaitForExit(&workers[i]);
+            threadClose(&workers[i]);
+        }
+
+        memcpy(ctx.iv, jobs[threads - 1].iv, BlockSize);
+    }
+
+    void Bind(Context& ctx, const uint8_t* key, const uint8_t* iv, Backend backend)
+    {
+        ctx.backend = backend;
+        memcpy(ctx.iv, iv, BlockSize);
+
+        if (backend == Backend::Reference)
+            AES_init_ctx_iv(&ctx.reference, key, iv);
+        else
+            ExpandKey(key, ctx.roundKeys);
+    }
+
+    struct KnownAnswer
+    {
+        const char* name;
+        uint8_t key[16];
+        uint8_t iv[16];
+        uint8_t ciphertext[64];
+        uint8_t plaintext[64];
+        size_t size;
+    };
+
+    const KnownAnswer KnownAnswers[] = {
+        {
+            "FIPS-197 C.1",
+            { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F },
+            {},
+            { 0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B, 0x04, 0x30, 0xD8, 0xCD, 0xB7, 0x80, 0x70, 0xB4, 0xC5, 0x5A },
+            { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF },
+            16,
+        },
+        {
+            "SP 800-38A F.2.2",
+            { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C },
+            { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F },
+            {
+                0x76, 0x49, 0xAB, 0xAC, 0x81, 0x19, 0xB2, 0x46, 0xCE, 0xE9, 0x8E, 0x9B, 0x12, 0xE9, 0x19, 0x7D,
+                0x50, 0x86, 0xCB, 0x9B, 0x50, 0x72, 0x19, 0xEE, 0x95, 0xDB, 0x11, 0x3A, 0x91, 0x76, 0x78, 0xB2,
+                0x73, 0xBE, 0xD6, 0xB8, 0xE3, 0xC1, 0x74, 0x3B, 0x71, 0x16, 0xE6, 0x9E, 0x22, 0x22, 0x95, 0x16,
+                0x3F, 0xF1, 0xCA, 0xA1, 0x68, 0x1F, 0xAC, 0x09, 0x12, 0x0E, 0xCA, 0x30, 0x75, 0x86, 0xE1, 0xA7,
+            },
+            {
+                0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96, 0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A,
+                0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C, 0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51,
+                0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11, 0xE5, 0xFB, 0xC1, 0x19, 0x1A, 0x0A, 0x52, 0xEF,
+                0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B, 0x17, 0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10,
+            },
+            64,
+        },
+    };
+
+    // Every vector in one call and, for the multi-block one, split after each block so the
+    // chaining between calls and the interleaved and single-block paths are all covered.
+    bool PassesKnownAnswers(Backend backend)
+    {
+        bool passed = true;
+
+        for (const KnownAnswer& vector : KnownAnswers)
+        {
+            for (size_t split = 0; split < vector.size; split += BlockSize)
+            {
+                uint8_t buffer[64];
+                memcpy(buffer, vector.ciphertext, vector.size);
+
+                Context ctx;
+                Bind(ctx, vector.key, vector.iv, backend);
+                Decrypt(ctx, buffer, split);
+                Decrypt(ctx, buffer + split, vector.size - split);
+
+                if (memcmp(buffer, vector.plaintext, vector.size) != 0
+                    || memcmp(ctx.iv, vector.ciphertext + vector.size - BlockSize, BlockSize) != 0)
+                {
+                    SDLogger::Log("AesCbc - %s backend fails %s (split at %zu)", GetBackendName(backend), vector.name, split);
+                    passed = false;
+                    break;
+                }
+            }
+        }
+
+        return passed;
+    }
+
+    Backend SelectBackend()
+    {
+        for (Backend backend : { Backend::ArmCrypto, Backend::Table })
+        {
+            if (IsAvailable(backend) && PassesKnownAnswers(backend))
+            {
+                SDLogger::Log("AesCbc - using the %s backend", GetBackendName(backend));
+                return backend;
+            }
+        }
+
+        return Backend::Reference;
+    }
+
+    Backend& SelectedBackend()
+    {
+        static Backend backend = SelectBackend();
+        return backend;
+    }
+
+} // namespace
+
+void AesCbc::Init(Context& ctx, const uint8_t* key, const uint8_t* iv)
+{
+    Bind(ctx, key, iv, GetBackend());
+}
+
+void AesCbc::Decrypt(Context& ctx, uint8_t* data, size_t size)
+{
+    const size_t blocks = size / BlockSize;
+    if (blocks == 0)
+        return;
+
+    if (ctx.backend == Backend::Reference)
+    {
+        AES_ctx_set_iv(&ctx.reference, ctx.iv);
+        AES_CBC_decrypt_buffer(&ctx.reference, data, blocks * BlockSize);
+        memcpy(ctx.iv, ctx.reference.Iv, BlockSize);
+        return;
+    }
+
+    const SegmentFunction function = GetSegmentFunction(ctx.backend);
+    const size_t threads = size >= ParallelThreshold ? std::min(g_threadCount, blocks) : 1;
+
+    if (threads <= 1)
+        function(ctx.roundKeys, ctx.iv, data, blocks);
+    else
+        DecryptParallel(function, ctx, data, blocks, threads);
+}
+
+Backend AesCbc::GetBackend()
+{
+    return SelectedBackend();
+}
+
+bool AesCbc::SetBackend(Backend backend)
+{
+    if (!IsAvailable(backend))
+        return false;
+
+    SelectedBackend() = backend;
+    return true;
+}
+
+bool AesCbc::IsAvailable(Backend backend)
+{
+#ifndef AES_CBC_ARMV8
+    if (backend == Backend::ArmCrypto)
+        return false;
+#endif
+    return true;
+}
+
+const char* AesCbc::GetBackendName(Backend backend)
+{
+    switch (backend)
+    {
+    case Backend::Reference:
+        return "tiny-AES";
+    case Backend::Table:
+        return "table";
+    case Backend::ArmCrypto:
+        return "ARMv8 Crypto";
+    }
+
+    return "unknown";
+}
+
+void AesCbc::SetThreadCount(size_t threads)
+{
+    g_threadCount = std::clamp(threads, size_t(1), MaxThreads);
+}
+
+bool AesCbc::RunSelfTest()
+{
+    bool passed = true;
+
+    for (Backend backend : { Backend::Reference, Backend::Table, Backend::ArmCrypto })
+    {
+        if (IsAvailable(backend))
+            passed &= PassesKnownAnswers(backend);
+    }
+
+    // Random buffers against tiny-AES, up to a few blocks past the threading threshold.
+    std::mt19937 rng{ 0x41455331 };
+    const size_t savedThreads = g_threadCount;
+    const size_t maxBlocks = ParallelThreshold / BlockSize + 7;
+
+    std::vector<uint8_t> ciphertext(maxBlocks * BlockSize);
+    std::vector<uint8_t> expected(ciphertext.size());
+    std::vector<uint8_t> actual(ciphertext.size());
+
+    for (int iteration = 0; iteration < 24 && passed; iteration++)
+    {
+        uint8_t key[16];
+        uint8_t iv[16];
+        for (auto& byte : key)
+            byte = uint8_t(rng());
+        for (auto& byte : iv)
+            byte = uint8_t(rng());
+        for (auto& byte : ciphertext)
+            byte = uint8_t(rng());
+
+        const size_t blocks = iteration % 3 == 0 ? maxBlocks - rng() % 8 : rng() % 300;
+        const size_t split = blocks != 0 ? rng() % (blocks + 1) : 0;
+        const size_t size = blocks * BlockSize;
+
+        AES_ctx reference;
+        AES_init_ctx_iv(&reference, key, iv);
+        memcpy(expected.data(), ciphertext.data(), size);
+        AES_CBC_decrypt_buffer(&reference, expected.data(), size);
+
+        for (Backend backend : { Backend::Table, Backend::ArmCrypto })
+        {
+            if (!IsAvailable(backend))
+                continue;
+
+            for (size_t threads = 1; threads <= MaxThreads; threads++)
+            {
+                SetThreadCount(threads);
+                memcpy(actual.data(), ciphertext.data(), size);
+
+                Context ctx;
+                Bind(ctx, key, iv, backend);
+                Decrypt(ctx, actual.data(), size);
+
+                bool same = memcmp(actual.data(), expected.data(), size) == 0;
+
+                // The same stream in two calls.
+                memcpy(actual.data(), ciphertext.data(), size);
+                Bind(ctx, key, iv, backend);
+                Decrypt(ctx, actual.data(), split * BlockSize);
+                Decrypt(ctx, actual.data() + split * BlockSize, size - split * BlockSize);
+
+                same &= memcmp(actual.data(), expected.data(), size) == 0 && memcmp(ctx.iv, reference.Iv, BlockSize) == 0;
+
+                if (!same)
+                {
+                    SDLogger::Log("AesCbc - %s backend differs from tiny-AES: %zu blocks, split at %zu, %zu threads",
+                        GetBackendName(backend), blocks, split, threads);
+                    passed = false;
+                }
+            }
+        }
+    }
+
+    g_threadCount = savedThreads;
+
+    SDLogger::Log("AesCbc self-test: %s", passed ? "all backends match" : "FAILED");
+    return passed;
+}
+
+void AesCbc::RunBenchmark()
+{
+    constexpr size_t BufferSize = 8 * 1024 * 1024;
+    constexpr int Passes = 4;
+
+    if (!RunSelfTest())
+        return;
+
+    auto buffer = std::make_unique<uint8_t[]>(BufferSize);
+    std::mt19937 rng{ 0x58455845 };
+    for (size_t i = 0; i < BufferSize; i++)
+        buffer[i] = uint8_t(rng());
+
+    const uint8_t key[16] = { 0x58, 0x45, 0x58, 0x32 };
+    const uint8_t iv[16] = {};
+    const size_t savedThreads = g_threadCount;
+
+    auto measure = [&](Backend backend, size_t threads)
+        {
+            SetThreadCount(threads);
+
+            Context ctx;
+            Bind(ctx, key, iv, backend);
+
+            const uint64_t start = armGetSystemTick();
+            for (int pass = 0; pass < Passes; pass++)
+                Decrypt(ctx, buffer.get(), BufferSize);
+
+            const uint64_t ns = armTicksToNs(armGetSystemTick() - start);
+            return ns != 0 ? double(BufferSize) * Passes / (1024.0 * 1024.0) * 1e9 / double(ns) : 0.0;
+        };
+
+    SDLogger::Log("AesCbc::RunBenchmark - %zu MiB buffer, selected backend: %s", BufferSize / (1024 * 1024), GetBackendName(GetBackend()));
+    SDLogger::Log("%-14s %8s %10s %8s", "backend", "threads", "MB/s", "speedup");
+
+    const double reference = measure(Backend::Reference, 1);
+    SDLogger::Log("%-14s %8d %10.1f %7.2fx", GetBackendName(Backend::Reference), 1, reference, 1.0);
+
+    for (Backend backend : { Backend::Table, Backend::ArmCrypto })
+    {
+        if (!IsAvailable(backend))
+            continue;
+
+        for (size_t threads = 1; threads <= MaxThreads; threads++)
+        {
+            const double rate = measure(backend, threads);
+            SDLogger::Log("%-14s %8zu %10.1f %7.2fx", GetBackendName(backend), threads, rate, reference > 0.0 ? rate / reference : 0.0);
+        }
+    }
+
+    g_threadCount = savedThreads;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "aes.hpp"
+
+// AES-128-CBC decryption for XEX payloads. tiny-AES works a byte at a time and is kept as
+// the reference; the other backends run the equivalent inverse cipher, one block per
+// table lookup round or, with the ARMv8 Crypto Extension, four blocks interleaved through
+// AESD/AESIMC. CBC decryption has no dependency between blocks other than the previous
+// ciphertext, so large buffers are also split across cores.
+namespace AesCbc {
+
+    constexpr size_t BlockSize = 16;
+    constexpr size_t Rounds = 10;
+
+    enum class Backend : uint8_t
+    {
+        Reference,
+        Table,
+        ArmCrypto,
+    };
+
+    struct Context
+    {
+        // Round keys of the equivalent inverse cipher, in the order they are applied.
+        alignas(16) uint8_t roundKeys[Rounds + 1][BlockSize];
+        uint8_t iv[BlockSize];
+
+        Backend backend;
+        AES_ctx reference;
+    };
+
+    // Binds the context to the current backend.
+    void Init(Context& ctx, const uint8_t* key, const uint8_t* iv);
+
+    // Decrypts `size` bytes in place; `size` must be a whole number of blocks. The context
+    // keeps the last ciphertext block, so consecutive calls continue one CBC stream.
+    void Decrypt(Context& ctx, uint8_t* data, size_t size);
+
+    // The backend is picked on first use: the fastest one built in that passes the
+    // known-answer test. Horizon does not expose the CPU feature registers to
+    // applications, so "built in" is decided by RXN_AES_ARMV8.
+    Backend GetBackend();
+    bool SetBackend(Backend backend);
+    bool IsAvailable(Backend backend);
+    const char* GetBackendName(Backend backend);
+
+    // Buffers of at least ParallelThreshold bytes are split over up to this many threads
+    // (the caller included); 1 keeps everything on the calling thread.
+    constexpr size_t MaxThreads = 3;
+    constexpr size_t ParallelThreshold = 1024 * 1024;
+    void SetThreadCount(size_t threads);
+
+    // FIPS-197 and SP 800-38A vectors on every available backend, plus a random
+    // comparison with tiny-AES across block counts, split points and thread counts.
+    bool RunSelfTest();
+
+    // MB/s of each backend against tiny-AES, single and multi-threaded.
+    void RunBenchmark();
+
+} // namespace AesCbc
@@ -0,0 +1,196 @@
+#include "contention_profiler.h"
+#include "memory.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <algorithm>
+
+ContentionProfiler::ContentionProfiler(const char* name)
+    : name(name)
+{
+}
+
+ContentionProfiler::~ContentionProfiler()
+{
+    delete[] entries.load();
+}
+
+void ContentionProfiler::SetEnabled(bool value)
+{
+    // The table is only allocated once somebody actually wants statistics.
+    if (value && entries.load(std::memory_order_acquire) == nullptr)
+    {
+        auto* table = new Entry[Capacity]();
+        Entry* expected = nullptr;
+
+        if (!entries.compare_exchange_strong(expected, table, std::memory_order_acq_rel))
+            delete[] table;
+    }
+
+    enabled.store(value, std::memory_order_relaxed);
+    SDLogger::Log("ContentionProfiler(%s) - %s", name, value ? "enabled" : "disabled");
+}
+
+ContentionProfiler::Entry* ContentionProfiler::FindOrInsert(uint32_t address)
+{
+    Entry* table = entries.load(std::memory_order_acquire);
+    if (table == nullptr || address == 0)
+        return nullptr;
+
+    // Guest lock words are at least 4-byte aligned, drop the low bits before hashing.
+    size_t index = ((address >> 2) * 0x9E3779B1u) & (Capacity - 1);
+
+    for (size_t probe = 0; probe < Capacity; probe++)
+    {
+        Entry& entry = table[index];
+        uint32_t current = entry.address.load(std::memory_order_acquire);
+
+        if (current == address)
+            return &entry;
+
+        if (current == 0 && entry.address.compare_exchange_strong(current, address, std::memory_order_acq_rel))
+            return &entry;
+
+        if (current == address)
+            return &entry;
+
+        index = (index + 1) & (Capacity - 1);
+    }
+
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+void ContentionProfiler::RecordAcquire(uint32_t address, const void* owner)
+{
+    if (!IsEnabled())
+        return;
+
+    Entry* entry = FindOrInsert(address);
+    if (entry == nullptr)
+        return;
+
+    entry->acquires.fetch_add(1, std::memory_order_relaxed);
+
+    if (owner != nullptr)
+        entry->owner.store(owner, std::memory_order_relaxed);
+}
+
+void ContentionProfiler::RecordContended(uint32_t address, uint64_t waitTicks, const void* blocker)
+{
+    if (!IsEnabled())
+        return;
+
+    Entry* entry = FindOrInsert(address);
+    if (entry == nullptr)
+        return;
+
+    entry->contended.fetch_add(1, std::memory_order_relaxed);
+
+    if (blocker != nullptr)
+        entry->blocker.store(blocker, std::memory_order_relaxed);
+
+    entry->waitTicks.fetch_add(waitTicks, std::memory_order_relaxed);
+
+    uint64_t maxWait = entry->maxWaitTicks.load(std::memory_order_relaxed);
+    while (waitTicks > maxWait && !entry->maxWaitTicks.compare_exchange_weak(maxWait, waitTicks, std::memory_order_relaxed))
+    {
+    }
+}
+
+const void* ContentionProfiler::GetOwner(uint32_t address)
+{
+    if (!IsEnabled())
+        return nullptr;
+
+    Entry* entry = FindOrInsert(address);
+    return entry != nullptr ? entry->owner.load(std::memory_order_relaxed) : nullptr;
+}
+
+std::vector<ContentionStats> ContentionProfiler::Snapshot() const
+{
+    std::vector<ContentionStats> stats;
+
+    const Entry* table = entries.load(std::memory_order_acquire);
+    if (table == nullptr)
+        return stats;
+
+    for (size_t i = 0; i < Capacity; i++)
+    {
+        const Entry& entry = table[i];
+        const uint32_t address = entry.address.load(std::memory_order_acquire);
+
+        if (address == 0)
+            continue;
+
+        stats.push_back({ address,
+            entry.acquires.load(std::memory_order_relaxed),
+            entry.contended.load(std::memory_order_relaxed),
+            entry.waitTicks.load(std::memory_order_relaxed),
+            entry.maxWaitTicks.load(std::memory_order_relaxed),
+            entry.owner.load(std::memory_order_relaxed),
+            entry.blocker.load(std::memory_order_relaxed) });
+    }
+
+    std::sort(stats.begin(), stats.end(), [](const ContentionStats& lhs, const ContentionStats& rhs)
+        {
+            return lhs.waitTicks != rhs.waitTicks ? lhs.waitTicks > rhs.waitTicks : lhs.contended > rhs.contended;
+        });
+
+    return stats;
+}
+
+void ContentionProfiler::Report(size_t maxEntries) const
+{
+    const auto stats = Snapshot();
+
+    SDLogger::Log("=== %s contention: %zu addresses, %llu dropped ===", name, stats.size(),
+        (unsigned long long)dropped.load(std::memory_order_relaxed));
+    SDLogger::Log("%-10s %12s %12s %12s %10s %-12s %-12s", "address", "acquires", "contended", "wait_us", "max_us",
+        "owner", "blocked_by");
+
+    // Owners are reported as the guest function that made the call.
+    auto describe = [](const void* host, char (&buffer)[16]) -> const char*
+        {
+            const uint32_t guest = host != nullptr ? g_memory.FindGuestFunction(host) : 0;
+            if (guest == 0)
+                return "-";
+
+            snprintf(buffer, sizeof(buffer), "sub_%08X", guest);
+            return buffer;
+        };
+
+    for (size_t i = 0; i < std::min(maxEntries, stats.size()); i++)
+    {
+        const auto& entry = stats[i];
+        char owner[16];
+        char blocker[16];
+
+        SDLogger::Log("0x%08X %12llu %12llu %12llu %10llu %-12s %-12s", entry.address,
+            (unsigned long long)entry.acquires,
+            (unsigned long long)entry.contended,
+            (unsigned long long)(armTicksToNs(entry.waitTicks) / 1000),
+            (unsigned long long)(armTicksToNs(entry.maxWaitTicks) / 1000),
+            describe(entry.owner, owner),
+            describe(entry.blocker, blocker));
+    }
+}
+
+void ContentionProfiler::Reset()
+{
+    Entry* table = entries.load(std::memory_order_acquire);
+    if (table == nullptr)
+        return;
+
+    for (size_t i = 0; i < Capacity; i++)
+    {
+        table[i].acquires.store(0, std::memory_order_relaxed);
+        table[i].contended.store(0, std::memory_order_relaxed);
+        table[i].waitTicks.store(0, std::memory_order_relaxed);
+        table[i].maxWaitTicks.store(0, std::memory_order_relaxed);
+        table[i].owner.store(nullptr, std::memory_order_relaxed);
+        table[i].blocker.store(nullptr, std::memory_order_relaxed);
+        table[i].address.store(0, std::memory_order_release);
+    }
+
+    dropped.store(0, std::memory_order_relaxed);
+}
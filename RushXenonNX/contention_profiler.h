@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct ContentionStats
+{
+    uint32_t address{};
+    uint64_t acquires{};
+    uint64_t contended{};
+    uint64_t waitTicks{};
+    uint64_t maxWaitTicks{};
+
+    // Host code addresses of the last acquirer and of the holder the last
+    // contended acquire had to wait for; null when the caller doesn't track them.
+    const void* owner{};
+    const void* blocker{};
+};
+
+// Fixed-size, lock-free table of per-address lock statistics keyed by guest address.
+// Recording is a couple of relaxed atomics, so it can stay on while the game runs;
+// when the table is full new addresses are dropped and counted in `dropped`.
+class ContentionProfiler
+{
+public:
+    explicit ContentionProfiler(const char* name);
+    ~ContentionProfiler();
+
+    bool IsEnabled() const
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    void SetEnabled(bool value);
+
+    void RecordAcquire(uint32_t address, const void* owner = nullptr);
+    void RecordContended(uint32_t address, uint64_t waitTicks, const void* blocker = nullptr);
+
+    // Last owner passed to RecordAcquire, read before waiting to blame the holder.
+    const void* GetOwner(uint32_t address);
+
+    // Copies the non-empty entries sorted by total wait time, hottest first.
+    std::vector<ContentionStats> Snapshot() const;
+
+    // Logs the `maxEntries` hottest addresses.
+    void Report(size_t maxEntries = 32) const;
+
+    void Reset();
+
+private:
+    struct Entry
+    {
+        std::atomic<uint32_t> address;
+        std::atomic<uint64_t> acquires;
+        std::atomic<uint64_t> contended;
+        std::atomic<uint64_t> waitTicks;
+        std::atomic<uint64_t> maxWaitTicks;
+        std::atomic<const void*> owner;
+        std::atomic<const void*> blocker;
+    };
+
+    static constexpr size_t Capacity = 4096;
+
+    Entry* FindOrInsert(uint32_t address);
+
+    const char* name;
+    std::atomic<bool> enabled{ false };
+    std::atomic<Entry*> entries{ nullptr };
+    std::atomic<uint64_t> dropped{ 0 };
+};
+
+// Every RtlEnterCriticalSection, keyed by the guest XRTL_CRITICAL_SECTION address.
+extern ContentionProfiler g_criticalSectionProfiler;
@@ -0,0 +1,163 @@
+#include "dpc.h"
+#include "function.h"
+#include "guest_thread.h"
+#include "memory.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+
+constexpr uint16_t DPC_OBJECT_TYPE = 19;
+
+// Marks a KDPC as sitting in the queue, stored in DpcListEntry.Blink.
+constexpr uint32_t DPC_QUEUED = 1;
+
+constexpr size_t DPC_WORKER_STACK_SIZE = 0x40000;
+constexpr int DPC_WORKER_PRIORITY = 0x2B;
+
+// Guest address of the most recently pushed KDPC, chained through DpcListEntry.Flink.
+static std::atomic<uint32_t> g_dpcHead{ 0 };
+
+static Mutex g_dpcMutex;
+static CondVar g_dpcCondVar;
+
+static Thread g_dpcThread;
+
+static void DpcWorkerFunc(void*)
+{
+    GuestThreadContext ctx(0);
+    SDLogger::Log("DpcQueue - Worker started");
+
+    while (true)
+    {
+        uint32_t head = g_dpcHead.exchange(0, std::memory_order_acquire);
+
+        if (head == 0)
+        {
+            mutexLock(&g_dpcMutex);
+
+            while (g_dpcHead.load(std::memory_order_acquire) == 0)
+                condvarWait(&g_dpcCondVar, &g_dpcMutex);
+
+            mutexUnlock(&g_dpcMutex);
+            continue;
+        }
+
+        // The stack hands them back newest first, reverse to run in insertion order.
+        uint32_t ordered = 0;
+        while (head != 0)
+        {
+            auto* dpc = reinterpret_cast<XKDPC*>(g_memory.base + head);
+            const uint32_t next = dpc->DpcListEntry.Flink;
+
+            dpc->DpcListEntry.Flink = ordered;
+            ordered = head;
+            head = next;
+        }
+
+        while (ordered != 0)
+        {
+            auto* dpc = reinterpret_cast<XKDPC*>(g_memory.base + ordered);
+            ordered = dpc->DpcListEntry.Flink;
+
+            const uint32_t routine = dpc->DeferredRoutine;
+            const uint32_t context = dpc->DeferredContext;
+            const uint32_t argument1 = dpc->SystemArgument1;
+            const uint32_t argument2 = dpc->SystemArgument2;
+
+            // Dequeue before running so the routine may queue itself again.
+            std::atomic_ref<uint32_t>(dpc->DpcListEntry.Blink.value).store(0, std::memory_order_release);
+
+            GuestToHostFunction<void>(routine, dpc, context, argument1, argument2);
+        }
+    }
+}
+
+static bool StartDpcWorker()
+{
+    mutexInit(&g_dpcMutex);
+    condvarInit(&g_dpcCondVar);
+
+    void* stack = malloc(DPC_WORKER_STACK_SIZE);
+    Result rc = threadCreate(&g_dpcThread, DpcWorkerFunc, nullptr, stack, DPC_WORKER_STACK_SIZE, DPC_WORKER_PRIORITY, -2);
+
+    if (R_FAILED(rc))
+    {
+        SDLogger::Log("DpcQueue - Failed to create worker: %u", rc);
+        free(stack);
+        return false;
+    }
+
+    if (R_FAILED(rc = threadStart(&g_dpcThread)))
+    {
+        SDLogger::Log("DpcQueue - Failed to start worker: %u", rc);
+        threadClose(&g_dpcThread);
+        free(stack);
+        return false;
+    }
+
+    return true;
+}
+
+void DpcQueue::Initialize(XKDPC* dpc, uint32_t routine, uint32_t context)
+{
+    dpc->Type = DPC_OBJECT_TYPE;
+    dpc->SelectedCpuNumber = 0;
+    dpc->DesiredCpuNumber = 0;
+    dpc->DpcListEntry.Flink = 0;
+    dpc->DpcListEntry.Blink = 0;
+    dpc->DeferredRoutine = routine;
+    dpc->DeferredContext = context;
+    dpc->SystemArgument1 = 0;
+    dpc->SystemArgument2 = 0;
+}
+
+bool DpcQueue::Insert(XKDPC* dpc, uint32_t argument1, uint32_t argument2)
+{
+    static const bool started = StartDpcWorker();
+
+    // Without a worker nothing would ever drain the queue, so the insert fails instead of
+    // reporting a DPC that never runs.
+    if (!started)
+        return false;
+
+    // Claim the DPC, a second insert while it is still queued is a no-op.
+    uint32_t expected = 0;
+    if (!std::atomic_ref<uint32_t>(dpc->DpcListEntry.Blink.value).compare_exchange_strong(expected,
+        ByteSwap(DPC_QUEUED), std::memory_order_acq_rel))
+    {
+        return false;
+    }
+
+    dpc->SystemArgument1 = argument1;
+    dpc->SystemArgument2 = argument2;
+
+    const uint32_t address = g_memory.MapVirtual(dpc);
+    uint32_t head = g_dpcHead.load(std::memory_order_relaxed);
+
+    do
+    {
+        dpc->DpcListEntry.Flink = head;
+    } while (!g_dpcHead.compare_exchange_weak(head, address, std::memory_order_release, std::memory_order_relaxed));
+
+    // Only the push onto an empty queue can find the worker asleep.
+    if (head == 0)
+    {
+        mutexLock(&g_dpcMutex);
+        condvarWakeOne(&g_dpcCondVar);
+        mutexUnlock(&g_dpcMutex);
+    }
+
+    return true;
+}
+
+void KeInitializeDpc(XKDPC* dpc, uint32_t routine, uint32_t context)
+{
+    DpcQueue::Initialize(dpc, routine, context);
+}
+
+uint32_t KeInsertQueueDpc(XKDPC* dpc, uint32_t argument1, uint32_t argument2)
+{
+    return DpcQueue::Insert(dpc, argument1, argument2);
+}
+
+GUEST_FUNCTION_HOOK(__imp__KeInitializeDpc, KeInitializeDpc);
+GUEST_FUNCTION_HOOK(__imp__KeInsertQueueDpc, KeInsertQueueDpc);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "xbox.h"
+
+// Deferred procedure calls run on a dedicated worker with its own guest thread
+// context. Producers push the guest KDPC itself onto a lock-free stack (the KDPC
+// list entry is kernel-owned), so inserting never allocates or takes a lock.
+namespace DpcQueue {
+
+    void Initialize(XKDPC* dpc, uint32_t routine, uint32_t context);
+
+    // Returns false if the DPC is already queued.
+    bool Insert(XKDPC* dpc, uint32_t argument1, uint32_t argument2);
+
+} // namespace DpcQueue
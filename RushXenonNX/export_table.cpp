@@ -0,0 +1,235 @@
+#include "export_table.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+
+namespace {
+
+    struct ExportEntry
+    {
+        uint32_t ordinal;
+        const char* name;
+    };
+
+#define STRINGIFY(X) #X
+#define XE_EXPORT(MODULE, ORDINAL, NAME, TYPE) ExportEntry{ (ORDINAL), "__imp__" STRINGIFY(NAME) }
+
+    constexpr ExportEntry XboxKernelExports[] =
+    {
+        #include "xbox/xboxkrnl_table.inc"
+    };
+
+    constexpr ExportEntry XamExports[] =
+    {
+        #include "xbox/xam_table.inc"
+    };
+
+#undef XE_EXPORT
+
+    template<size_t N>
+    constexpr uint32_t MaxOrdinal(const ExportEntry (&entries)[N])
+    {
+        uint32_t max = 0;
+        for (const auto& entry : entries)
+            max = std::max(max, entry.ordinal);
+
+        return max;
+    }
+
+    // Ordinals are small and unique, so the perfect hash is the ordinal itself:
+    // slot[ordinal] holds the entry index + 1, 0 for holes.
+    template<size_t Slots, size_t N>
+    constexpr std::array<uint16_t, Slots> MakeOrdinalIndex(const ExportEntry (&entries)[N])
+    {
+        static_assert(N < UINT16_MAX);
+
+        std::array<uint16_t, Slots> index{};
+        for (size_t i = 0; i < N; i++)
+            index[entries[i].ordinal] = static_cast<uint16_t>(i + 1);
+
+        return index;
+    }
+
+    constexpr uint32_t HashName(std::string_view name)
+    {
+        // FNV-1a, cheap enough to evaluate for every export at compile time.
+        uint32_t hash = 0x811C9DC5u;
+        for (char c : name)
+            hash = (hash ^ static_cast<uint8_t>(c)) * 0x01000193u;
+
+        return hash;
+    }
+
+    // Open-addressed name -> entry index + 1 table, kept under half full so
+    // probe sequences stay short.
+    template<size_t N>
+    constexpr size_t NameSlotCount()
+    {
+        size_t slots = 1;
+        while (slots < N * 2)
+            slots <<= 1;
+
+        return slots;
+    }
+
+    template<size_t N>
+    constexpr std::array<uint16_t, NameSlotCount<N>()> MakeNameIndex(const ExportEntry (&entries)[N])
+    {
+        constexpr size_t Mask = NameSlotCount<N>() - 1;
+
+        std::array<uint16_t, NameSlotCount<N>()> index{};
+        for (size_t i = 0; i < N; i++)
+        {
+            size_t slot = HashName(entries[i].name) & Mask;
+            while (index[slot] != 0)
+                slot = (slot + 1) & Mask;
+
+            index[slot] = static_cast<uint16_t>(i + 1);
+        }
+
+        return index;
+    }
+
+    template<size_t N>
+    constexpr bool HasUniqueOrdinals(const ExportEntry (&entries)[N])
+    {
+        for (size_t i = 1; i < N; i++)
+        {
+            if (entries[i - 1].ordinal >= entries[i].ordinal)
+                return false;
+        }
+
+        return true;
+    }
+
+    static_assert(HasUniqueOrdinals(XboxKernelExports), "xboxkrnl_table.inc must be sorted by ordinal without duplicates.");
+    static_assert(HasUniqueOrdinals(XamExports), "xam_table.inc must be sorted by ordinal without duplicates.");
+
+    constexpr auto XboxKernelOrdinalIndex = MakeOrdinalIndex<MaxOrdinal(XboxKernelExports) + 1>(XboxKernelExports);
+    constexpr auto XamOrdinalIndex = MakeOrdinalIndex<MaxOrdinal(XamExports) + 1>(XamExports);
+
+    constexpr auto XboxKernelNameIndex = MakeNameIndex(XboxKernelExports);
+    constexpr auto XamNameIndex = MakeNameIndex(XamExports);
+
+    template<size_t Slots, size_t N>
+    const char* FindByOrdinal(const std::array<uint16_t, Slots>& index, const ExportEntry (&entries)[N], uint32_t ordinal)
+    {
+        if (ordinal >= Slots || index[ordinal] == 0)
+            return nullptr;
+
+        return entries[index[ordinal] - 1].name;
+    }
+
+    template<size_t Slots, size_t N>
+    const ExportEntry* FindByName(const std::array<uint16_t, Slots>& index, const ExportEntry (&entries)[N], std::string_view name)
+    {
+        for (size_t slot = HashName(name) & (Slots - 1); index[slot] != 0; slot = (slot + 1) & (Slots - 1))
+        {
+            const ExportEntry& entry = entries[index[slot] - 1];
+            if (entry.name == name)
+                return &entry;
+        }
+
+        return nullptr;
+    }
+
+} // namespace
+
+ExportLibrary ExportTable::FromModuleName(std::string_view moduleName)
+{
+    if (moduleName == "xboxkrnl.exe")
+        return ExportLibrary::XboxKernel;
+
+    if (moduleName == "xam.xex")
+        return ExportLibrary::Xam;
+
+    return ExportLibrary::Unknown;
+}
+
+const char* ExportTable::GetLibraryName(ExportLibrary library)
+{
+    switch (library)
+    {
+        case ExportLibrary::XboxKernel: return "xboxkrnl";
+        case ExportLibrary::Xam: return "xam";
+        default: return "-";
+    }
+}
+
+const char* ExportTable::FindName(ExportLibrary library, uint32_t ordinal)
+{
+    switch (library)
+    {
+        case ExportLibrary::XboxKernel: return FindByOrdinal(XboxKernelOrdinalIndex, XboxKernelExports, ordinal);
+        case ExportLibrary::Xam: return FindByOrdinal(XamOrdinalIndex, XamExports, ordinal);
+        default: return nullptr;
+    }
+}
+
+bool ExportTable::FindOrdinal(std::string_view name, ExportLibrary& library, uint32_t& ordinal)
+{
+    if (const ExportEntry* entry = FindByName(XboxKernelNameIndex, XboxKernelExports, name))
+    {
+        library = ExportLibrary::XboxKernel;
+        ordinal = entry->ordinal;
+        return true;
+    }
+
+    if (const ExportEntry* entry = FindByName(XamNameIndex, XamExports, name))
+    {
+        library = ExportLibrary::Xam;
+        ordinal = entry->ordinal;
+        return true;
+    }
+
+    library = ExportLibrary::Unknown;
+    ordinal = 0;
+    return false;
+}
+
+void ExportTable::RunBenchmark()
+{
+    constexpr size_t LookupRounds = 100;
+
+    // What xex.cpp used to do during static initialisation.
+    uint64_t start = armGetSystemTick();
+
+    std::unordered_map<size_t, const char*> kernelMap;
+    std::unordered_map<size_t, const char*> xamMap;
+
+    for (const auto& entry : XboxKernelExports)
+        kernelMap.emplace(entry.ordinal, entry.name);
+
+    for (const auto& entry : XamExports)
+        xamMap.emplace(entry.ordinal, entry.name);
+
+    const uint64_t buildNs = armTicksToNs(armGetSystemTick() - start);
+
+    size_t found = 0;
+    start = armGetSystemTick();
+
+    for (size_t round = 0; round < LookupRounds; round++)
+    {
+        for (uint32_t ordinal = 0; ordinal < XamOrdinalIndex.size(); ordinal++)
+            found += xamMap.find(ordinal) != xamMap.end();
+    }
+
+    const uint64_t mapLookupNs = armTicksToNs(armGetSystemTick() - start);
+    start = armGetSystemTick();
+
+    for (size_t round = 0; round < LookupRounds; round++)
+    {
+        for (uint32_t ordinal = 0; ordinal < XamOrdinalIndex.size(); ordinal++)
+            found += FindName(ExportLibrary::Xam, ordinal) != nullptr;
+    }
+
+    const uint64_t tableLookupNs = armTicksToNs(armGetSystemTick() - start);
+    const size_t lookups = LookupRounds * XamOrdinalIndex.size();
+
+    SDLogger::Log("ExportTable bench - unordered_map build %llu us for %zu exports, constexpr tables 0 us",
+        (unsigned long long)(buildNs / 1000), std::size(XboxKernelExports) + std::size(XamExports));
+    SDLogger::Log("ExportTable bench - lookup by ordinal: unordered_map %llu ns, table %llu ns (%zu found)",
+        (unsigned long long)(mapLookupNs / lookups), (unsigned long long)(tableLookupNs / lookups), found);
+}
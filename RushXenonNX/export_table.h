@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// Ordinal -> name tables for the system libraries games import from, generated at
+// compile time from xbox/xboxkrnl_table.inc and xbox/xam_table.inc. Lookups by
+// ordinal are a direct index, lookups by name probe a constexpr hash table;
+// nothing is built at startup and nothing touches the heap.
+enum class ExportLibrary : uint8_t
+{
+    Unknown,
+    XboxKernel,
+    Xam
+};
+
+namespace ExportTable {
+
+    // Maps an import library's module name ("xboxkrnl.exe", "xam.xex").
+    ExportLibrary FromModuleName(std::string_view moduleName);
+
+    const char* GetLibraryName(ExportLibrary library);
+
+    // "__imp__"-prefixed symbol name of an export, nullptr if unknown.
+    const char* FindName(ExportLibrary library, uint32_t ordinal);
+
+    // Reverse lookup of an "__imp__" symbol name in either library.
+    bool FindOrdinal(std::string_view name, ExportLibrary& library, uint32_t& ordinal);
+
+    // Compares the old startup-built std::unordered_map against these tables.
+    void RunBenchmark();
+
+} // namespace ExportTable
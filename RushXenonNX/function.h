@@ -1,10 +1,15 @@
 #pragma once
 
 #include "ppc/ppc_context.h"
+#include <algorithm>
 #include <array>
 #include "xbox.h"
 #include "memory.h"
+#include "stub_registry.h"
+#include "import_profiler.h"
 #include <iostream>
+#include <tuple>
+#include <utility>
 #include <switch.h>
 
 template <typename R, typename... T>
@@ -39,253 +44,213 @@ std::enable_if_t<(I < sizeof...(TArgs)), void> _tuple_for(std::tuple<TArgs...>&
     _tuple_for<TCallable, I + 1>(tpl, callable);
 }
 
-struct ArgTranslator
+// Where one argument of a signature lives. Integer arguments take the GPR matching
+// their position, floating point ones the next free FPR; whatever doesn't fit goes
+// to the caller's parameter save area, one doubleword per position.
+enum class ArgLocation : uint8_t
 {
-    constexpr static uint64_t GetIntegerArgumentValue(const PPCContext& ctx, uint8_t* base, size_t arg) noexcept
-    {
-        if (arg <= 7)
-        {
-            switch (arg)
-            {
-                case 0: return ctx.r3.u32;
-                case 1: return ctx.r4.u32;
-                case 2: return ctx.r5.u32;
-                case 3: return ctx.r6.u32;
-                case 4: return ctx.r7.u32;
-                case 5: return ctx.r8.u32;
-                case 6: return ctx.r9.u32;
-                case 7: return ctx.r10.u32;
-                default: break;
-            }
-        }
+    Gpr,
+    Fpr,
+    Stack,
+    StackFloat
+};
 
-        return *reinterpret_cast<be<uint32_t>*>(base + ctx.r1.u32 + 0x54 + ((arg - 8) * 8));
-    }
+struct ArgSlot
+{
+    ArgLocation location{};
+    uint8_t index{};
+};
 
-    static double GetPrecisionArgumentValue(const PPCContext& ctx, uint8_t* base, size_t arg) noexcept
-    {
-        switch (arg)
-        {
-            case 0: return ctx.f1.f64;
-            case 1: return ctx.f2.f64;
-            case 2: return ctx.f3.f64;
-            case 3: return ctx.f4.f64;
-            case 4: return ctx.f5.f64;
-            case 5: return ctx.f6.f64;
-            case 6: return ctx.f7.f64;
-            case 7: return ctx.f8.f64;
-            case 8: return ctx.f9.f64;
-            case 9: return ctx.f10.f64;
-            case 10: return ctx.f11.f64;
-            case 11: return ctx.f12.f64;
-            case 12: return ctx.f13.f64;
-            [[unlikely]] default: break;
-        }
+constexpr size_t GPR_ARGUMENT_COUNT = 8;
+constexpr size_t FPR_ARGUMENT_COUNT = 13;
 
-        // TODO: get value from stack.
-        return 0;
-    }
+// Offset from r1 of the first stack-only parameter doubleword.
+constexpr uint32_t STACK_ARGUMENT_OFFSET = 0x50;
+
+template<typename... TArgs>
+constexpr std::array<ArgSlot, sizeof...(TArgs)> MakeArgPlan()
+{
+    std::array<ArgSlot, sizeof...(TArgs)> plan{};
 
-    constexpr static void SetIntegerArgumentValue(PPCContext& ctx, uint8_t* base, size_t arg, uint64_t value) noexcept
+    if constexpr (sizeof...(TArgs) != 0)
     {
-        if (arg <= 7)
+        constexpr bool precise[] = { is_precise_v<TArgs>... };
+        uint8_t floatOrdinal{};
+
+        for (size_t i = 0; i < plan.size(); i++)
         {
-            switch (arg)
-            {
-                case 0: ctx.r3.u64 = value; return;
-                case 1: ctx.r4.u64 = value; return;
-                case 2: ctx.r5.u64 = value; return;
-                case 3: ctx.r6.u64 = value; return;
-                case 4: ctx.r7.u64 = value; return;
-                case 5: ctx.r8.u64 = value; return;
-                case 6: ctx.r9.u64 = value; return;
-                case 7: ctx.r10.u64 = value; return;
-                [[unlikely]] default: break;
-            }
+            if (precise[i] && floatOrdinal < FPR_ARGUMENT_COUNT)
+                plan[i] = { ArgLocation::Fpr, floatOrdinal++ };
+            else if (i < GPR_ARGUMENT_COUNT && !precise[i])
+                plan[i] = { ArgLocation::Gpr, static_cast<uint8_t>(i) };
+            else
+                plan[i] = { precise[i] ? ArgLocation::StackFloat : ArgLocation::Stack, static_cast<uint8_t>(i - GPR_ARGUMENT_COUNT) };
         }
-
-        assert(arg < 7 && "Pushing to stack memory is not yet supported.");
     }
 
-    static void SetPrecisionArgumentValue(PPCContext& ctx, uint8_t* base, size_t arg, double value) noexcept
-    {
-        switch (arg)
-        {
-            case 0: ctx.f1.f64 = value; return;
-            case 1: ctx.f2.f64 = value; return;
-            case 2: ctx.f3.f64 = value; return;
-            case 3: ctx.f4.f64 = value; return;
-            case 4: ctx.f5.f64 = value; return;
-            case 5: ctx.f6.f64 = value; return;
-            case 6: ctx.f7.f64 = value; return;
-            case 7: ctx.f8.f64 = value; return;
-            case 8: ctx.f9.f64 = value; return;
-            case 9: ctx.f10.f64 = value; return;
-            case 10: ctx.f11.f64 = value; return;
-            case 11: ctx.f12.f64 = value; return;
-            case 12: ctx.f13.f64 = value; return;
-            [[unlikely]] default: break;
-        }
+    return plan;
+}
 
-        assert(arg < 12 && "Pushing to stack memory is not yet supported.");
-    }
+template<typename... TArgs>
+constexpr std::array<ArgSlot, sizeof...(TArgs)> MakeArgPlan(const std::tuple<TArgs...>&)
+{
+    return MakeArgPlan<TArgs...>();
+}
+
+template<auto Func>
+inline constexpr auto arg_plan_v = MakeArgPlan(function_args(Func));
 
-    template<typename T>
-    constexpr static std::enable_if_t<!std::is_pointer_v<T>, T> GetValue(PPCContext& ctx, uint8_t* base, size_t idx) noexcept
+// Every accessor is selected by a constant slot, so a thunk is a run of plain
+// register and stack moves with no index dispatch left at runtime.
+struct ArgTranslator
+{
+    static constexpr PPCRegister PPCContext::* Gprs[GPR_ARGUMENT_COUNT] =
     {
-        if constexpr (is_precise_v<T>)
-        {
-            return static_cast<T>(GetPrecisionArgumentValue(ctx, base, idx));
-        }
-        else
-        {
-            return static_cast<T>(GetIntegerArgumentValue(ctx, base, idx));
-        }
-    }
+        &PPCContext::r3, &PPCContext::r4, &PPCContext::r5, &PPCContext::r6,
+        &PPCContext::r7, &PPCContext::r8, &PPCContext::r9, &PPCContext::r10
+    };
 
-    template<typename T>
-    constexpr static std::enable_if_t<std::is_pointer_v<T>, T> GetValue(PPCContext& ctx, uint8_t* base, size_t idx) noexcept
+    static constexpr PPCRegister PPCContext::* Fprs[FPR_ARGUMENT_COUNT] =
     {
-        const auto v = GetIntegerArgumentValue(ctx, base, idx);
-        if (!v)
-        {
-            return nullptr;
-        }
+        &PPCContext::f1, &PPCContext::f2, &PPCContext::f3, &PPCContext::f4, &PPCContext::f5,
+        &PPCContext::f6, &PPCContext::f7, &PPCContext::f8, &PPCContext::f9, &PPCContext::f10,
+        &PPCContext::f11, &PPCContext::f12, &PPCContext::f13
+    };
 
-        return reinterpret_cast<T>(base + static_cast<uint32_t>(v));
+    template<ArgSlot Slot>
+    static uint8_t* StackSlot(const PPCContext& ctx, uint8_t* base) noexcept
+    {
+        return base + ctx.r1.u32 + STACK_ARGUMENT_OFFSET + Slot.index * 8;
     }
 
-    template<typename T>
-    constexpr static std::enable_if_t<!std::is_pointer_v<T>, void> SetValue(PPCContext& ctx, uint8_t* base, size_t idx, T value) noexcept
+    template<typename T, ArgSlot Slot>
+    static T GetValue(PPCContext& ctx, uint8_t* base) noexcept
     {
-        if constexpr (is_precise_v<T>)
+        if constexpr (Slot.location == ArgLocation::Fpr)
         {
-            SetPrecisionArgumentValue(ctx, base, idx, value);
+            return static_cast<T>((ctx.*Fprs[Slot.index]).f64);
         }
-        else if constexpr (std::is_null_pointer_v<T>)
+        else if constexpr (Slot.location == ArgLocation::StackFloat)
         {
-            SetIntegerArgumentValue(ctx, base, idx, 0);
+            // Doubles fill the doubleword, singles sit in its second word.
+            if constexpr (std::is_same_v<T, float>)
+                return reinterpret_cast<be<float>*>(StackSlot<Slot>(ctx, base) + 4)->get();
+            else
+                return reinterpret_cast<be<double>*>(StackSlot<Slot>(ctx, base))->get();
         }
-        else if constexpr (std::is_pointer_v<T>)
+        else if constexpr (std::is_integral_v<T> && sizeof(T) == 8)
         {
-            SetIntegerArgumentValue(ctx, base, idx, g_memory.MapVirtual(value));
+            if constexpr (Slot.location == ArgLocation::Gpr)
+                return static_cast<T>((ctx.*Gprs[Slot.index]).u64);
+            else
+                return static_cast<T>(reinterpret_cast<be<uint64_t>*>(StackSlot<Slot>(ctx, base))->get());
         }
         else
         {
-            SetIntegerArgumentValue(ctx, base, idx, value);
+            uint32_t v;
+
+            if constexpr (Slot.location == ArgLocation::Gpr)
+                v = (ctx.*Gprs[Slot.index]).u32;
+            else
+                v = *reinterpret_cast<be<uint32_t>*>(StackSlot<Slot>(ctx, base) + 4);
+
+            if constexpr (std::is_pointer_v<T>)
+                return v != 0 ? reinterpret_cast<T>(base + v) : nullptr;
+            else
+                return static_cast<T>(v);
         }
     }
 
-    template<typename T>
-    constexpr static std::enable_if_t<std::is_pointer_v<T>, void> SetValue(PPCContext& ctx, uint8_t* base, size_t idx, T value) noexcept
+    template<typename T, ArgSlot Slot>
+    static void SetValue(PPCContext& ctx, uint8_t* base, T value) noexcept
     {
-        const auto v = g_memory.MapVirtual((void*)value);
-        if (!v)
+        if constexpr (Slot.location == ArgLocation::Fpr)
+        {
+            (ctx.*Fprs[Slot.index]).f64 = value;
+        }
+        else if constexpr (Slot.location == ArgLocation::StackFloat)
         {
-            return;
+            if constexpr (std::is_same_v<T, float>)
+                *reinterpret_cast<be<float>*>(StackSlot<Slot>(ctx, base) + 4) = value;
+            else
+                *reinterpret_cast<be<double>*>(StackSlot<Slot>(ctx, base)) = value;
         }
+        else
+        {
+            uint64_t v;
 
-        SetValue(ctx, base, idx, v);
-    }
-};
+            if constexpr (std::is_null_pointer_v<T>)
+                v = 0;
+            else if constexpr (std::is_pointer_v<T>)
+                v = value != nullptr ? g_memory.MapVirtual((const void*)value) : 0;
+            else
+                v = (uint64_t)value;
 
-struct Argument
-{
-    int type{};
-    int ordinal{};
+            // Stack arguments take the whole doubleword, like a GPR would.
+            if constexpr (Slot.location == ArgLocation::Gpr)
+                (ctx.*Gprs[Slot.index]).u64 = v;
+            else
+                *reinterpret_cast<be<uint64_t>*>(StackSlot<Slot>(ctx, base)) = v;
+        }
+    }
 };
 
-template<typename T1>
-constexpr std::array<Argument, std::tuple_size_v<T1>> GatherFunctionArguments(const T1& tpl)
+// Bytes a caller has to reserve below r1 to pass `plan`, 0 when everything fits in
+// registers. Kept 16-byte aligned like any other guest frame.
+template<size_t N>
+constexpr uint32_t GetArgumentFrameSize(const std::array<ArgSlot, N>& plan)
 {
-    std::array<Argument, std::tuple_size_v<T1>> args{};
+    uint32_t stackCount{};
 
-    int floatOrdinal{};
-    size_t i{};
-
-    if constexpr (!args.empty())
+    for (const auto& slot : plan)
     {
-        std::apply([&](const auto& first, const auto&... rest)
-            {
-                auto append = [&]<typename T2>(const T2& v)
-                {
-                    if constexpr (is_precise_v<T2>)
-                    {
-                        args[i] = { 1, floatOrdinal++ };
-                    }
-                    else
-                    {
-                        args[i] = { 0, static_cast<int>(i) }; // what the fuck
-                    }
-
-                    i++;
-                };
-
-                append(first);
-                (append(rest), ...);
-            }, tpl);
+        if (slot.location == ArgLocation::Stack || slot.location == ArgLocation::StackFloat)
+            stackCount = std::max<uint32_t>(stackCount, slot.index + 1);
     }
 
-    return args;
-}
-
-template<auto Func>
-constexpr std::array<Argument, arg_count_t<Func>::value> GatherFunctionArguments()
-{
-    return GatherFunctionArguments(function_args(Func));
+    return stackCount == 0 ? 0 : (STACK_ARGUMENT_OFFSET + stackCount * 8 + 15) & ~15u;
 }
 
-template<auto Func, size_t I>
-struct arg_ordinal_t
+template<auto Func, size_t... I>
+auto _call_with_guest_args(PPCContext& ctx, uint8_t* base, std::index_sequence<I...>) noexcept
 {
-    static constexpr size_t value = GatherFunctionArguments<Func>()[I].ordinal;
-};
+    using args_t = decltype(function_args(Func));
+    constexpr auto& plan = arg_plan_v<Func>;
 
-template<auto Func, int I = 0, typename ...TArgs>
-void _translate_args_to_host(PPCContext& ctx, uint8_t* base, std::tuple<TArgs...>&) noexcept
-    requires (I >= sizeof...(TArgs))
-{
+    return Func(ArgTranslator::GetValue<std::tuple_element_t<I, args_t>, plan[I]>(ctx, base)...);
 }
 
-template <auto Func, int I = 0, typename ...TArgs>
-std::enable_if_t<(I < sizeof...(TArgs)), void> _translate_args_to_host(PPCContext& ctx, uint8_t* base, std::tuple<TArgs...>& tpl) noexcept
+template<typename... TArgs, size_t... I>
+void _translate_args_to_guest(PPCContext& ctx, uint8_t* base, std::index_sequence<I...>, const TArgs&... args) noexcept
 {
-    using T = std::tuple_element_t<I, std::remove_reference_t<decltype(tpl)>>;
-    std::get<I>(tpl) = ArgTranslator::GetValue<T>(ctx, base, arg_ordinal_t<Func, I>::value);
-
-    _translate_args_to_host<Func, I + 1>(ctx, base, tpl);
-}
+    constexpr auto plan = MakeArgPlan<TArgs...>();
+    constexpr uint32_t frameSize = GetArgumentFrameSize(plan);
 
-template<int I = 0, typename ...TArgs>
-void _translate_args_to_guest(PPCContext& ctx, uint8_t* base, std::tuple<TArgs...>&) noexcept
-    requires (I >= sizeof...(TArgs))
-{
-}
-
-template <int I = 0, typename ...TArgs>
-std::enable_if_t<(I < sizeof...(TArgs)), void> _translate_args_to_guest(PPCContext& ctx, uint8_t* base, std::tuple<TArgs...>& tpl) noexcept
-{
-    using T = std::tuple_element_t<I, std::remove_reference_t<decltype(tpl)>>;
-    ArgTranslator::SetValue<T>(ctx, base, GatherFunctionArguments(std::tuple<TArgs...>{})[I].ordinal, std::get<I>(tpl));
+    // Arguments past the registers need a frame with a parameter save area below
+    // the caller's stack pointer; the back chain keeps the stack walkable.
+    if constexpr (frameSize != 0)
+    {
+        const uint32_t callerStack = ctx.r1.u32;
+        ctx.r1.u64 = (callerStack - frameSize) & ~15u;
+        *reinterpret_cast<be<uint32_t>*>(base + ctx.r1.u32) = callerStack;
+    }
 
-    _translate_args_to_guest<I + 1>(ctx, base, tpl);
+    (ArgTranslator::SetValue<TArgs, plan[I]>(ctx, base, args), ...);
 }
 
 template<auto Func>
 PPC_FUNC(HostToGuestFunction)
 {
     using ret_t = decltype(std::apply(Func, function_args(Func)));
-
-    auto args = function_args(Func);
-    _translate_args_to_host<Func>(ctx, base, args);
+    constexpr auto indices = std::make_index_sequence<arg_count_t<Func>::value>();
 
     if constexpr (std::is_same_v<ret_t, void>)
     {
-        std::apply(Func, args);
+        _call_with_guest_args<Func>(ctx, base, indices);
     }
     else
     {
-        auto v = std::apply(Func, args);
+        auto v = _call_with_guest_args<Func>(ctx, base, indices);
 
         if constexpr (std::is_pointer<ret_t>())
         {
@@ -312,7 +277,6 @@ PPC_FUNC(HostToGuestFunction)
 template<typename T, typename TFunction, typename... TArgs>
 T GuestToHostFunction(const TFunction& func, TArgs&&... argv)
 {
-    auto args = std::make_tuple(std::forward<TArgs>(argv)...);
     auto& currentCtx = *GetPPCContext();
 
     PPCContext newCtx; // NOTE: No need for zero initialization, has lots of unnecessary code generation.
@@ -320,7 +284,7 @@ T GuestToHostFunction(const TFunction& func, TArgs&&... argv)
     newCtx.r13 = currentCtx.r13;
     newCtx.fpscr = currentCtx.fpscr;
 
-    _translate_args_to_guest(newCtx, g_memory.base, args);
+    _translate_args_to_guest<std::decay_t<TArgs>...>(newCtx, g_memory.base, std::index_sequence_for<TArgs...>(), argv...);
 
     SetPPCContext(newCtx);
 
@@ -329,6 +293,7 @@ T GuestToHostFunction(const TFunction& func, TArgs&&... argv)
     else
         g_memory.FindFunction(func)(newCtx, g_memory.base);
 
+    // The callee's cached FPCR is what the host register holds now.
     currentCtx.fpscr = newCtx.fpscr;
     SetPPCContext(currentCtx);
 
@@ -350,11 +315,15 @@ T GuestToHostFunction(const TFunction& func, TArgs&&... argv)
     }
 }
 
-#define GUEST_FUNCTION_HOOK(subroutine, function) \
-    PPC_FUNC(subroutine) { HostToGuestFunction<function>(ctx, base); }
+// Round-trips a table of signatures through both thunks, then logs the per-call
+// cost of host<->guest thunks for 0-10 argument signatures and callbacks/second.
+void RunFunctionThunkBenchmark();
 
+#define GUEST_FUNCTION_HOOK(subroutine, function) \
+    static ImportLatency subroutine##_latency{ #subroutine }; \
+    PPC_FUNC(subroutine) { ImportTimer timer{ subroutine##_latency }; HostToGuestFunction<function>(ctx, base); }
 
-// #define GUEST_FUNCTION_STUB(subroutine) \
-//     PPC_FUNC(subroutine) { }
 
-#define GUEST_FUNCTION_STUB(x) PPC_FUNC(x) {SDLogger::Log("Stub: " #x);}
+#define GUEST_FUNCTION_STUB(x) \
+    static StubCounter x##_counter{ #x }; \
+    PPC_FUNC(x) { x##_counter.Hit(); }
@@ -0,0 +1,226 @@
+#include "function.h"
+#include "heap.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <tuple>
+#include <utility>
+
+constexpr size_t THUNK_BENCHMARK_ITERATIONS = 1'000'000;
+
+static volatile uint32_t g_thunkSink;
+
+template<size_t I>
+using bench_arg_t = uint32_t;
+
+template<size_t... I>
+[[gnu::noinline]] static uint32_t BenchHostFunction(bench_arg_t<I>... args)
+{
+    return (args + ... + 0u);
+}
+
+[[gnu::noinline]] static uint32_t BenchHostMixed(uint32_t a, double b, uint32_t c, float d, uint32_t e, double f)
+{
+    return a + c + e + uint32_t(b + d + f);
+}
+
+PPC_FUNC(BenchGuestFunction)
+{
+    ctx.r3.u64 = ctx.r3.u32 + 1;
+}
+
+// Called through this so the compiler can't inline the callee and drop the frame,
+// like a real guest target behind PPC_LOOKUP_FUNC.
+static PPCFunc* volatile g_benchGuestTarget = BenchGuestFunction;
+
+// Expected locations for a few signatures, checked at compile time.
+constexpr bool PlanMatches(const auto& plan, std::initializer_list<ArgSlot> expected)
+{
+    if (plan.size() != expected.size())
+        return false;
+
+    size_t i = 0;
+    for (const auto& slot : expected)
+    {
+        if (plan[i].location != slot.location || plan[i].index != slot.index)
+            return false;
+
+        i++;
+    }
+
+    return true;
+}
+
+using enum ArgLocation;
+
+static_assert(PlanMatches(MakeArgPlan<uint32_t, double, void*, float>(),
+    { { Gpr, 0 }, { Fpr, 0 }, { Gpr, 2 }, { Fpr, 1 } }));
+
+static_assert(PlanMatches(MakeArgPlan<uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint64_t>(),
+    { { Gpr, 0 }, { Gpr, 1 }, { Gpr, 2 }, { Gpr, 3 }, { Gpr, 4 }, { Gpr, 5 }, { Gpr, 6 }, { Gpr, 7 }, { Stack, 0 }, { Stack, 1 } }));
+
+static_assert(PlanMatches(MakeArgPlan<double, double, double, double, double, double, double, double, double, double, double, double, double, double, float>(),
+    { { Fpr, 0 }, { Fpr, 1 }, { Fpr, 2 }, { Fpr, 3 }, { Fpr, 4 }, { Fpr, 5 }, { Fpr, 6 }, { Fpr, 7 }, { Fpr, 8 }, { Fpr, 9 },
+      { Fpr, 10 }, { Fpr, 11 }, { Fpr, 12 }, { StackFloat, 5 }, { StackFloat, 6 } }));
+
+static_assert(GetArgumentFrameSize(MakeArgPlan<uint32_t, uint32_t>()) == 0);
+static_assert(GetArgumentFrameSize(MakeArgPlan<int, int, int, int, int, int, int, int, int>()) == 0x60);
+
+// Calls a guest function through GuestToHostFunction, which re-enters the host
+// through HostToGuestFunction; every argument has to survive both directions.
+template<typename... T>
+struct ArgRoundTrip
+{
+    static inline std::tuple<T...> expected;
+    static inline bool matched;
+
+    static uint32_t Check(T... args)
+    {
+        matched = std::tuple<T...>(args...) == expected;
+        return 0x600D;
+    }
+
+    static void Target(PPCContext& ctx, uint8_t* base)
+    {
+        HostToGuestFunction<&Check>(ctx, base);
+    }
+
+    static bool Run(const char* name, T... args)
+    {
+        expected = { args... };
+        matched = false;
+
+        const bool passed = GuestToHostFunction<uint32_t>(Target, args...) == 0x600D && matched;
+        SDLogger::Log("Thunk check - %-24s %s", name, passed ? "ok" : "FAILED");
+
+        return passed;
+    }
+};
+
+static bool RunArgRoundTrips(uint8_t* scratch)
+{
+    auto* pointer = reinterpret_cast<uint32_t*>(scratch);
+    bool passed = true;
+
+    passed &= ArgRoundTrip<uint32_t, double, uint32_t*, float>::Run("registers", 1, 2.5, pointer, 4.25f);
+
+    passed &= ArgRoundTrip<uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t>
+        ::Run("12 integers", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0xFFFFFFFF);
+
+    passed &= ArgRoundTrip<uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint32_t, uint64_t, int32_t, uint32_t*>
+        ::Run("64-bit and pointer stack", 1, 2, 3, 4, 5, 6, 7, 8, 0x123456789ABCDEFull, -5, pointer);
+
+    passed &= ArgRoundTrip<double, double, double, double, double, double, double, double, double, double, double, double, double, double, float>
+        ::Run("15 floating point", 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0, 11.0, 12.0, 13.0, 14.5, 15.25f);
+
+    passed &= ArgRoundTrip<uint32_t, double, uint32_t, double, uint32_t, double, uint32_t, double, uint32_t, double, uint32_t, float>
+        ::Run("interleaved", 1, 1.5, 2, 2.5, 3, 3.5, 4, 4.5, 5, 5.5, 6, 6.5f);
+
+    return passed;
+}
+
+template<auto Func>
+static uint64_t MeasureImportThunk(PPCContext& ctx, uint8_t* base)
+{
+    const uint64_t start = armGetSystemTick();
+
+    for (size_t i = 0; i < THUNK_BENCHMARK_ITERATIONS; i++)
+    {
+        ctx.r3.u64 = i;
+        HostToGuestFunction<Func>(ctx, base);
+        g_thunkSink = ctx.r3.u32;
+    }
+
+    return armTicksToNs(armGetSystemTick() - start);
+}
+
+template<size_t... I>
+static uint64_t MeasureGuestCall(std::index_sequence<I...>)
+{
+    const uint64_t start = armGetSystemTick();
+
+    for (size_t i = 0; i < THUNK_BENCHMARK_ITERATIONS; i++)
+        g_thunkSink = GuestToHostFunction<uint32_t>(*g_benchGuestTarget, uint32_t(i + I)...);
+
+    return armTicksToNs(armGetSystemTick() - start);
+}
+
+constexpr uint32_t NESTED_CALLBACK_DEPTH = 4;
+
+// Calls back into itself through GuestToHostFunction until r3 reaches zero.
+PPC_FUNC(BenchNestedGuestFunction)
+{
+    if (ctx.r3.u32 != 0)
+        ctx.r3.u64 = GuestToHostFunction<uint32_t>(BenchNestedGuestFunction, ctx.r3.u32 - 1) + 1;
+}
+
+static void BenchmarkCallbacks()
+{
+    auto report = [](const char* name, uint64_t ns, size_t callbacks)
+        {
+            SDLogger::Log("Callback bench - %-22s %6llu k callbacks/s", name,
+                (unsigned long long)(ns != 0 ? callbacks * 1'000'000ull / ns : 0));
+        };
+
+    uint64_t start = armGetSystemTick();
+    for (size_t i = 0; i < THUNK_BENCHMARK_ITERATIONS; i++)
+        g_thunkSink = GuestToHostFunction<uint32_t>(*g_benchGuestTarget, uint32_t(i), 1u, 2u, 3u);
+
+    report("4 args", armTicksToNs(armGetSystemTick() - start), THUNK_BENCHMARK_ITERATIONS);
+
+    start = armGetSystemTick();
+    for (size_t i = 0; i < THUNK_BENCHMARK_ITERATIONS; i++)
+        g_thunkSink = GuestToHostFunction<uint32_t>(BenchNestedGuestFunction, NESTED_CALLBACK_DEPTH - 1);
+
+    report("nested", armTicksToNs(armGetSystemTick() - start), THUNK_BENCHMARK_ITERATIONS * NESTED_CALLBACK_DEPTH);
+}
+
+template<size_t N>
+static void BenchmarkSignature(PPCContext& ctx, uint8_t* base)
+{
+    constexpr auto indices = std::make_index_sequence<N>();
+
+    const uint64_t importNs = [&]<size_t... I>(std::index_sequence<I...>)
+        {
+            return MeasureImportThunk<&BenchHostFunction<I...>>(ctx, base);
+        }(indices);
+
+    const uint64_t callNs = MeasureGuestCall(indices);
+
+    SDLogger::Log("Thunk bench - %2zu args: guest->host %4llu ps/call, host->guest %4llu ps/call", N,
+        (unsigned long long)(importNs * 1000 / THUNK_BENCHMARK_ITERATIONS),
+        (unsigned long long)(callNs * 1000 / THUNK_BENCHMARK_ITERATIONS));
+}
+
+void RunFunctionThunkBenchmark()
+{
+    // A scratch guest stack; r1 starts at the top, pushed frames grow down into it.
+    constexpr size_t StackSize = 0x1000;
+
+    uint8_t* stack = (uint8_t*)g_userHeap.Alloc(StackSize);
+    memset(stack, 0, StackSize);
+
+    PPCContext ctx{};
+    ctx.r1.u64 = g_memory.MapVirtual(stack + StackSize - 0x200);
+
+    PPCContext* previous = GetPPCContext();
+    SetPPCContext(ctx);
+
+    if (!RunArgRoundTrips(stack))
+        SDLogger::Log("Thunk check - argument marshalling is broken, timings below are meaningless");
+
+    SDLogger::Log("Thunk bench - %zu calls per signature", THUNK_BENCHMARK_ITERATIONS);
+
+    [&]<size_t... N>(std::index_sequence<N...>)
+        {
+            (BenchmarkSignature<N>(ctx, g_memory.base), ...);
+        }(std::make_index_sequence<11>());
+
+    BenchmarkCallbacks();
+
+    const uint64_t mixedImportNs = MeasureImportThunk<&BenchHostMixed>(ctx, g_memory.base);
+    SDLogger::Log("Thunk bench - mixed 3 int/3 fp: guest->host %4llu ps/call",
+        (unsigned long long)(mixedImportNs * 1000 / THUNK_BENCHMARK_ITERATIONS));
+
+    g_ppcContext = previous;
+    g_userHeap.Free(stack);
+}
@@ -0,0 +1,101 @@
+#include "function_table.h"
+#include "memory.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <algorithm>
+
+// Constant-initialised, Memory's constructor fills it during static initialisation.
+constinit FunctionTable g_functionTable;
+
+PPC_FUNC(FunctionTableAnchor)
+{
+    SDLogger::Log("FunctionTableAnchor - called through a corrupt function table entry");
+}
+
+bool FunctionTable::Insert(uint32_t guest, PPCFunc* host)
+{
+    const uint32_t offset = guest - static_cast<uint32_t>(PPC_CODE_BASE);
+    if (offset >= PPC_CODE_SIZE || (offset & 3) != 0)
+    {
+        SDLogger::Log("FunctionTable::Insert - 0x%08X is outside the code range", guest);
+        return false;
+    }
+
+    const intptr_t relative = reinterpret_cast<intptr_t>(host) - reinterpret_cast<intptr_t>(&FunctionTableAnchor);
+    if (host != nullptr && (relative == 0 || relative != static_cast<int32_t>(relative)))
+    {
+        SDLogger::Log("FunctionTable::Insert - host %p for 0x%08X is out of 32-bit range", (void*)host, guest);
+        return false;
+    }
+
+    uint32_t& page = directory[offset >> PageShift];
+    if (page == 0)
+    {
+        if (host == nullptr)
+            return true;
+
+        pages.resize(pages.size() + PageEntries);
+        page = static_cast<uint32_t>(GetPageCount());
+    }
+
+    pages[(page - 1) * PageEntries + ((offset >> 2) & (PageEntries - 1))] = host != nullptr ? static_cast<int32_t>(relative) : 0;
+    return true;
+}
+
+void FunctionTable::RunBenchmark()
+{
+    constexpr size_t SampleCount = 4096;
+    constexpr size_t Rounds = 256;
+
+    std::vector<uint32_t> samples;
+    for (size_t i = 0; PPCFuncMappings[i].guest != 0; i++)
+    {
+        if (PPCFuncMappings[i].host != nullptr)
+            samples.push_back((uint32_t)PPCFuncMappings[i].guest);
+    }
+
+    if (samples.empty())
+        return;
+
+    // Scatter the lookups across the whole image like vtable calls from all over the game.
+    uint32_t seed = 0x9E3779B9u;
+    std::vector<uint32_t> order(SampleCount);
+    for (auto& guest : order)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        guest = samples[seed % samples.size()];
+    }
+
+    const size_t legacyBytes = (PPC_CODE_SIZE / 4) * sizeof(PPCFunc*);
+
+    SDLogger::Log("FunctionTable bench - %zu functions, %zu/%zu pages, compact %zu KiB vs legacy %zu KiB of guest memory",
+        samples.size(), g_functionTable.GetPageCount(), DirectorySize, g_functionTable.GetFootprint() / 1024, legacyBytes / 1024);
+
+    uintptr_t sink = 0;
+    uint64_t start = armGetSystemTick();
+
+    for (size_t round = 0; round < Rounds; round++)
+    {
+        for (uint32_t guest : order)
+            sink ^= (uintptr_t)g_functionTable.Find(guest);
+    }
+
+    const uint64_t compactNs = armTicksToNs(armGetSystemTick() - start);
+
+#ifndef RXN_COMPACT_FUNCTION_TABLE
+    start = armGetSystemTick();
+
+    for (size_t round = 0; round < Rounds; round++)
+    {
+        for (uint32_t guest : order)
+            sink ^= (uintptr_t)PPC_LOOKUP_FUNC(g_memory.base, guest);
+    }
+
+    const uint64_t legacyNs = armTicksToNs(armGetSystemTick() - start);
+#else
+    const uint64_t legacyNs = 0;
+#endif
+
+    SDLogger::Log("FunctionTable bench - random lookup: compact %.2f ns, legacy %.2f ns (sink %llx)",
+        (double)compactNs / (Rounds * SampleCount), (double)legacyNs / (Rounds * SampleCount), (unsigned long long)(sink & 0xF));
+}
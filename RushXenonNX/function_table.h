@@ -0,0 +1,69 @@
+#pragma once
+
+// Guest code address -> recompiled host function, kept outside guest memory. A page
+// directory covers the code range and points at dense pages holding one 32-bit entry
+// per instruction slot; pages are only allocated for code that actually has function
+// entry points, and entries store the host address relative to FunctionTableAnchor.
+//
+// With RXN_COMPACT_FUNCTION_TABLE the recompiled sources resolve indirect calls
+// through it too and the legacy table at PPC_IMAGE_BASE + PPC_IMAGE_SIZE is never
+// written, which frees the guest range behind the image.
+#ifdef RXN_COMPACT_FUNCTION_TABLE
+#undef PPC_LOOKUP_FUNC
+#define PPC_LOOKUP_FUNC(x, y) g_functionTable.Find(y)
+#endif
+
+#include <ppc_context.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+PPC_EXTERN_FUNC(FunctionTableAnchor);
+
+class FunctionTable
+{
+public:
+    static constexpr uint32_t PageShift = 12;
+    static constexpr size_t PageEntries = (1u << PageShift) / sizeof(uint32_t);
+    static constexpr size_t DirectorySize = (PPC_CODE_SIZE + (1u << PageShift) - 1) >> PageShift;
+
+    PPCFunc* Find(uint32_t guest) const noexcept
+    {
+        const uint32_t offset = guest - static_cast<uint32_t>(PPC_CODE_BASE);
+        if (offset >= PPC_CODE_SIZE)
+            return nullptr;
+
+        const uint32_t page = directory[offset >> PageShift];
+        if (page == 0)
+            return nullptr;
+
+        const int32_t entry = pages[(page - 1) * PageEntries + ((offset >> 2) & (PageEntries - 1))];
+        if (entry == 0)
+            return nullptr;
+
+        return reinterpret_cast<PPCFunc*>(reinterpret_cast<intptr_t>(&FunctionTableAnchor) + entry);
+    }
+
+    // Not synchronised with Find, all functions are inserted before guest threads start.
+    bool Insert(uint32_t guest, PPCFunc* host);
+
+    size_t GetPageCount() const
+    {
+        return pages.size() / PageEntries;
+    }
+
+    // Host bytes used by the directory and the allocated pages.
+    size_t GetFootprint() const
+    {
+        return sizeof(directory) + pages.capacity() * sizeof(int32_t);
+    }
+
+    // Footprint and random lookup latency against the legacy in-guest table.
+    static void RunBenchmark();
+
+private:
+    uint32_t directory[DirectorySize]{};
+    std::vector<int32_t> pages;
+};
+
+extern FunctionTable g_functionTable;
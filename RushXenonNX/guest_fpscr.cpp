@@ -0,0 +1,117 @@
+#include "guest_fpscr.h"
+#include "guest_setjmp.h"
+#include "function.h"
+#include "heap.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+
+constexpr size_t FPSCR_BENCHMARK_ITERATIONS = 1'000'000;
+
+static volatile uint32_t g_fpscrSink;
+
+PPC_FUNC(BenchFpscrTarget)
+{
+    ctx.r3.u64 = ctx.r3.u32 + 1;
+}
+
+// What a boundary that saved and restored the host register itself would add per call.
+[[gnu::noinline]] static uint32_t EagerGuestCall(uint32_t value)
+{
+    PPCFPSCRRegister& fpscr = GetPPCContext()->fpscr;
+    fpscr.loadFromHost();
+
+    const uint32_t result = GuestToHostFunction<uint32_t>(BenchFpscrTarget, value);
+
+    fpscr.setcsr(fpscr.csr);
+    return result;
+}
+
+[[gnu::noinline]] static uint32_t LazyGuestCall(uint32_t value)
+{
+    return GuestToHostFunction<uint32_t>(BenchFpscrTarget, value);
+}
+
+// A callee that turns flush-to-zero on and then longjmps past the code that would turn it off.
+PPC_FUNC(BenchFpscrLongJmp)
+{
+    ctx.fpscr.enableFlushMode();
+    GUEST_LONGJMP(*reinterpret_cast<jmp_buf*>(base + ctx.r3.u32), 1);
+}
+
+PPC_FUNC(BenchFpscrSetJmp)
+{
+    PPCContext env = ctx;
+    const int64_t result = GUEST_SETJMP(*reinterpret_cast<jmp_buf*>(base + ctx.r3.u32));
+    if (result != 0)
+        ctx = env;
+
+    if (result == 0)
+        GuestToHostFunction<void>(BenchFpscrLongJmp, ctx.r3.u32);
+}
+
+void GuestFpscr::RunBenchmark()
+{
+    constexpr size_t StackSize = 0x1000;
+    constexpr size_t JumpBufferSize = 0x200;
+
+    uint8_t* stack = (uint8_t*)g_userHeap.Alloc(StackSize);
+    uint8_t* jumpBuffer = (uint8_t*)g_userHeap.Alloc(JumpBufferSize);
+
+    PPCContext ctx{};
+    ctx.r1.u64 = g_memory.MapVirtual(stack + StackSize - 0x200);
+    ctx.fpscr.loadFromHost();
+
+    PPCContext* previous = GetPPCContext();
+    SetPPCContext(ctx);
+
+    const Control original = ctx.fpscr.csr;
+
+    ctx.fpscr.disableFlushMode();
+    ctx.r3.u64 = g_memory.MapVirtual(jumpBuffer);
+    BenchFpscrSetJmp(ctx, g_memory.base);
+
+    PPCFPSCRRegister host{};
+    host.loadFromHost();
+
+    if (host.csr != ctx.fpscr.csr)
+        SDLogger::Log("GuestFpscr check - host FPCR %llX after longjmp, context expects %llX",
+            (unsigned long long)host.csr, (unsigned long long)ctx.fpscr.csr);
+
+    auto measure = [](const char* name, auto&& body)
+        {
+            const uint64_t start = armGetSystemTick();
+
+            for (size_t i = 0; i < FPSCR_BENCHMARK_ITERATIONS; i++)
+                body(uint32_t(i));
+
+            const uint64_t ns = armTicksToNs(armGetSystemTick() - start);
+            SDLogger::Log("Fpscr bench - %-28s %6llu.%02llu ns/op", name,
+                (unsigned long long)(ns / FPSCR_BENCHMARK_ITERATIONS),
+                (unsigned long long)(ns * 100 / FPSCR_BENCHMARK_ITERATIONS % 100));
+
+            return ns;
+        };
+
+    measure("host FPCR read", [&](uint32_t) { g_fpscrSink = (uint32_t)host.getcsr(); });
+    measure("host FPCR write (same)", [&](uint32_t) { host.setcsr(host.csr); });
+
+    const uint64_t lazy = measure("thunk call, cached mode", [](uint32_t i) { g_fpscrSink = LazyGuestCall(i); });
+    const uint64_t eager = measure("thunk call, read+write FPCR", [](uint32_t i) { g_fpscrSink = EagerGuestCall(i); });
+
+    measure("flush mode, unchanged", [&](uint32_t) { ctx.fpscr.enableFlushMode(); });
+    measure("flush mode, toggled", [&](uint32_t)
+        {
+            ctx.fpscr.disableFlushMode();
+            ctx.fpscr.enableFlushMode();
+        });
+
+    const uint64_t saved = eager > lazy ? (eager - lazy) * 100 / FPSCR_BENCHMARK_ITERATIONS : 0;
+    SDLogger::Log("Fpscr bench - cached mode saves %llu.%02llu ns per host<->guest boundary",
+        (unsigned long long)(saved / 100), (unsigned long long)(saved % 100));
+
+    Switch(ctx.fpscr.csr, original);
+
+    g_ppcContext = previous;
+    g_userHeap.Free(jumpBuffer);
+    g_userHeap.Free(stack);
+}
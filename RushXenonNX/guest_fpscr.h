@@ -0,0 +1,35 @@
+#pragma once
+
+// The host FPCR is only written by the recompiled code when the guest actually changes
+// rounding or flush-to-zero: PPCFPSCRRegister keeps the last value it applied in `csr`
+// and enableFlushMode/disableFlushMode compare against that first. The active context's
+// `csr` therefore doubles as the thread's cache of the host register, and host code
+// only has to keep the two in step when it switches contexts:
+//
+//  - GuestThreadContext reads the register once, when the thread's context is created.
+//  - GuestToHostFunction copies `csr` into the callee's frame and back out, no register access.
+//  - A longjmp lands with the context saved at setjmp time, whose `csr` may predate a
+//    mode change made before the jump; Switch rewrites the register in that case only.
+#include <ppc_context.h>
+
+namespace GuestFpscr {
+
+    using Control = decltype(PPCFPSCRRegister::csr);
+
+    // Brings the host register from `current` (what the active context says it holds)
+    // to `target`, touching it only if the modes differ.
+    inline void Switch(Control current, Control target)
+    {
+        if (current != target) [[unlikely]]
+        {
+            PPCFPSCRRegister host{};
+            host.setcsr(target);
+        }
+    }
+
+    // Cost of a host FPCR read and write against the cached boundary copy, per thunk
+    // call and per flush-mode toggle, plus a check that a longjmp out of a mode change
+    // leaves the register matching the restored context.
+    void RunBenchmark();
+
+} // namespace GuestFpscr
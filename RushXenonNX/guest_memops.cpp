@@ -0,0 +1,602 @@
+#include "guest_memops.h"
+#include "function.h"
+#include "heap.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define RXN_STRINGIFY(x) RXN_STRINGIFY_(x)
+#define RXN_STRINGIFY_(x) #x
+#define RXN_IMP(x) RXN_IMP_(x)
+#define RXN_IMP_(x) __imp__##x
+
+// Guest memory is plain bytes, so none of these need a byte swap. The game mostly
+// moves a few dozen bytes at a time: those sizes take the NEON paths below, which
+// skip newlib's size dispatch, while large copies and fills still go to newlib,
+// whose loops are already vectorised and use DC ZVA for zero fills.
+constexpr uint32_t HOST_MEMOPS_LIBC_THRESHOLD = 512;
+
+// Copies of up to 64 bytes load everything before storing anything, so they are
+// correct for overlapping ranges too and serve memmove as well. Returns false for
+// the sizes it leaves to the caller.
+static bool CopySmall(uint8_t* destination, const uint8_t* source, uint32_t size)
+{
+    if (size >= 16)
+    {
+#if defined(__ARM_NEON)
+        if (size > 64)
+            return false;
+
+        const uint8x16_t head = vld1q_u8(source);
+        const uint8x16_t tail = vld1q_u8(source + size - 16);
+
+        if (size > 32)
+        {
+            const uint8x16_t second = vld1q_u8(source + 16);
+            const uint8x16_t third = vld1q_u8(source + size - 32);
+            vst1q_u8(destination + 16, second);
+            vst1q_u8(destination + size - 32, third);
+        }
+
+        vst1q_u8(destination, head);
+        vst1q_u8(destination + size - 16, tail);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    auto copyEnds = [&]<typename T>(T)
+        {
+            T head, tail;
+            memcpy(&head, source, sizeof(T));
+            memcpy(&tail, source + size - sizeof(T), sizeof(T));
+            memcpy(destination, &head, sizeof(T));
+            memcpy(destination + size - sizeof(T), &tail, sizeof(T));
+        };
+
+    if (size >= 8)
+        copyEnds(uint64_t{});
+    else if (size >= 4)
+        copyEnds(uint32_t{});
+    else if (size >= 2)
+        copyEnds(uint16_t{});
+    else if (size != 0)
+        *destination = *source;
+
+    return true;
+}
+
+#if defined(__ARM_NEON)
+// One nibble per byte of `mask`, set where the byte is 0xFF.
+static uint64_t ByteMaskNibbles(uint8x16_t mask)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(mask), 4)), 0);
+}
+#endif
+
+static void* GuestMemcpy(void* destination, const void* source, uint32_t size)
+{
+    auto* to = static_cast<uint8_t*>(destination);
+    auto* from = static_cast<const uint8_t*>(source);
+
+    if (CopySmall(to, from, size))
+        return destination;
+
+#if defined(__ARM_NEON)
+    // 64-byte rows, then one more row ending at the last byte; the ranges don't overlap,
+    // so rewriting a few bytes of the previous row is harmless.
+    if (size <= HOST_MEMOPS_LIBC_THRESHOLD)
+    {
+        for (uint32_t offset = 0; offset < size - 64; offset += 64)
+        {
+            const uint8x16x4_t row = vld1q_u8_x4(from + offset);
+            vst1q_u8_x4(to + offset, row);
+        }
+
+        vst1q_u8_x4(to + size - 64, vld1q_u8_x4(from + size - 64));
+        return destination;
+    }
+#endif
+
+    return memcpy(destination, source, size);
+}
+
+static void* GuestMemset(void* destination, int32_t value, uint32_t size)
+{
+    auto* to = static_cast<uint8_t*>(destination);
+
+#if defined(__ARM_NEON)
+    if (size >= 16 && size <= HOST_MEMOPS_LIBC_THRESHOLD)
+    {
+        const uint8x16_t fill = vdupq_n_u8(static_cast<uint8_t>(value));
+        uint8_t* const last = to + size - 16;
+
+        for (; to + 64 <= last; to += 64)
+        {
+            vst1q_u8(to, fill);
+            vst1q_u8(to + 16, fill);
+            vst1q_u8(to + 32, fill);
+            vst1q_u8(to + 48, fill);
+        }
+
+        for (; to < last; to += 16)
+            vst1q_u8(to, fill);
+
+        vst1q_u8(last, fill);
+        return destination;
+    }
+#endif
+
+    if (size < 16)
+    {
+        const uint64_t pattern = 0x0101010101010101ull * static_cast<uint8_t>(value);
+        const uint64_t fill[2] = { pattern, pattern };
+
+        CopySmall(to, reinterpret_cast<const uint8_t*>(fill), size);
+        return destination;
+    }
+
+    return memset(destination, value, size);
+}
+
+static void* GuestMemmove(void* destination, const void* source, uint32_t size)
+{
+    if (CopySmall(static_cast<uint8_t*>(destination), static_cast<const uint8_t*>(source), size))
+        return destination;
+
+    return memmove(destination, source, size);
+}
+
+static int32_t GuestMemcmp(const void* lhs, const void* rhs, uint32_t size)
+{
+    auto* left = static_cast<const uint8_t*>(lhs);
+    auto* right = static_cast<const uint8_t*>(rhs);
+    uint32_t offset = 0;
+
+#if defined(__ARM_NEON)
+    if (size >= 16)
+    {
+        while (true)
+        {
+            // The last block ends at the last byte; the bytes it shares with the previous
+            // block already compared equal, so the first mismatch is still the first.
+            if (offset > size - 16)
+                offset = size - 16;
+
+            const uint64_t equal = ByteMaskNibbles(vceqq_u8(vld1q_u8(left + offset), vld1q_u8(right + offset)));
+            if (equal != ~0ull)
+            {
+                offset += __builtin_ctzll(~equal) / 4;
+                return int32_t(left[offset]) - int32_t(right[offset]);
+            }
+
+            offset += 16;
+            if (offset == size)
+                return 0;
+        }
+    }
+#endif
+
+    for (; offset < size; offset++)
+    {
+        if (left[offset] != right[offset])
+            return int32_t(left[offset]) - int32_t(right[offset]);
+    }
+
+    return 0;
+}
+
+static uint32_t GuestStrlen(const char* string)
+{
+#if defined(__ARM_NEON)
+    // Aligned 16-byte loads never cross a page, so reading past the terminator is safe.
+    const uintptr_t address = reinterpret_cast<uintptr_t>(string);
+    const uint8_t* block = reinterpret_cast<const uint8_t*>(address & ~uintptr_t(15));
+    const uint8x16_t zero = vdupq_n_u8(0);
+
+    uint64_t terminators = ByteMaskNibbles(vceqq_u8(vld1q_u8(block), zero)) >> ((address & 15) * 4);
+    if (terminators != 0)
+        return __builtin_ctzll(terminators) / 4;
+
+    while (true)
+    {
+        block += 16;
+
+        terminators = ByteMaskNibbles(vceqq_u8(vld1q_u8(block), zero));
+        if (terminators != 0)
+            return uint32_t(block - reinterpret_cast<const uint8_t*>(string)) + __builtin_ctzll(terminators) / 4;
+    }
+#else
+    return strlen(string);
+#endif
+}
+
+// Unlike GUEST_FUNCTION_HOOK these are not timed, they sit on the game's hottest paths.
+#define GUEST_FUNCTION_REPLACE(subroutine, function) \
+    PPC_EXTERN_FUNC(RXN_IMP(subroutine)); \
+    PPC_FUNC(subroutine) { HostToGuestFunction<function>(ctx, base); }
+
+#ifdef RXN_GUEST_MEMCPY
+GUEST_FUNCTION_REPLACE(RXN_GUEST_MEMCPY, GuestMemcpy)
+#endif
+
+#ifdef RXN_GUEST_MEMSET
+GUEST_FUNCTION_REPLACE(RXN_GUEST_MEMSET, GuestMemset)
+#endif
+
+#ifdef RXN_GUEST_MEMMOVE
+GUEST_FUNCTION_REPLACE(RXN_GUEST_MEMMOVE, GuestMemmove)
+#endif
+
+#ifdef RXN_GUEST_MEMCMP
+GUEST_FUNCTION_REPLACE(RXN_GUEST_MEMCMP, GuestMemcmp)
+#endif
+
+#ifdef RXN_GUEST_STRLEN
+GUEST_FUNCTION_REPLACE(RXN_GUEST_STRLEN, GuestStrlen)
+#endif
+
+namespace {
+
+    enum class RoutineKind
+    {
+        Memcpy,
+        Memset,
+        Memmove,
+        Memcmp,
+        Strlen
+    };
+
+    struct BoundRoutine
+    {
+        RoutineKind kind;
+        const char* name;
+        PPCFunc* original;
+        PPCFunc* replacement;
+    };
+
+    std::vector<BoundRoutine> GetBoundRoutines()
+    {
+        return
+        {
+#ifdef RXN_GUEST_MEMCPY
+            { RoutineKind::Memcpy, "memcpy (" RXN_STRINGIFY(RXN_GUEST_MEMCPY) ")", RXN_IMP(RXN_GUEST_MEMCPY), RXN_GUEST_MEMCPY },
+#endif
+#ifdef RXN_GUEST_MEMSET
+            { RoutineKind::Memset, "memset (" RXN_STRINGIFY(RXN_GUEST_MEMSET) ")", RXN_IMP(RXN_GUEST_MEMSET), RXN_GUEST_MEMSET },
+#endif
+#ifdef RXN_GUEST_MEMMOVE
+            { RoutineKind::Memmove, "memmove (" RXN_STRINGIFY(RXN_GUEST_MEMMOVE) ")", RXN_IMP(RXN_GUEST_MEMMOVE), RXN_GUEST_MEMMOVE },
+#endif
+#ifdef RXN_GUEST_MEMCMP
+            { RoutineKind::Memcmp, "memcmp (" RXN_STRINGIFY(RXN_GUEST_MEMCMP) ")", RXN_IMP(RXN_GUEST_MEMCMP), RXN_GUEST_MEMCMP },
+#endif
+#ifdef RXN_GUEST_STRLEN
+            { RoutineKind::Strlen, "strlen (" RXN_STRINGIFY(RXN_GUEST_STRLEN) ")", RXN_IMP(RXN_GUEST_STRLEN), RXN_GUEST_STRLEN },
+#endif
+        };
+    }
+
+    // Both implementations run on their own copy of the same region; afterwards the
+    // regions and the results (pointers as offsets into the region) must match.
+    constexpr uint32_t RegionSize = 0x20000;
+
+    struct Scratch
+    {
+        uint8_t* original;
+        uint8_t* replacement;
+    };
+
+    struct RoutineArgs
+    {
+        uint32_t first;
+        uint32_t second;
+        uint32_t size;
+    };
+
+    // Returns r3, pointers rebased to an offset inside `region`.
+    uint32_t Invoke(const BoundRoutine& routine, PPCFunc* function, uint8_t* region, const RoutineArgs& args)
+    {
+        const uint32_t guest = g_memory.MapVirtual(region);
+
+        switch (routine.kind)
+        {
+            case RoutineKind::Memcpy:
+            case RoutineKind::Memmove:
+                return GuestToHostFunction<uint32_t>(*function, guest + args.first, guest + args.second, args.size) - guest;
+
+            case RoutineKind::Memset:
+                return GuestToHostFunction<uint32_t>(*function, guest + args.first, args.second, args.size) - guest;
+
+            case RoutineKind::Memcmp:
+            {
+                const int32_t result = GuestToHostFunction<int32_t>(*function, guest + args.first, guest + args.second, args.size);
+                return (result > 0) - (result < 0);
+            }
+
+            case RoutineKind::Strlen:
+                return GuestToHostFunction<uint32_t>(*function, guest + args.first);
+        }
+
+        return 0;
+    }
+
+    struct Random
+    {
+        uint64_t state = 0x853C49E6748FEA9Bull;
+
+        uint32_t Next()
+        {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            return static_cast<uint32_t>(state >> 33);
+        }
+
+        uint32_t Below(uint32_t limit)
+        {
+            return limit != 0 ? Next() % limit : 0;
+        }
+
+        // Mostly small copies, like the game's, with the odd large one.
+        uint32_t Size()
+        {
+            const uint32_t pick = Below(10);
+            return Below(pick < 5 ? 64 : pick < 8 ? 512 : RegionSize / 4);
+        }
+    };
+
+    RoutineArgs MakeCase(RoutineKind kind, Random& random, uint8_t* region)
+    {
+        for (uint32_t i = 0; i < RegionSize; i++)
+            region[i] = static_cast<uint8_t>(random.Next());
+
+        const uint32_t size = random.Size();
+        const uint32_t half = RegionSize / 2;
+
+        switch (kind)
+        {
+            case RoutineKind::Memcpy:
+                return { random.Below(half - size), half + random.Below(half - size), size };
+
+            case RoutineKind::Memmove:
+                return { random.Below(RegionSize - size), random.Below(RegionSize - size), size };
+
+            case RoutineKind::Memset:
+                return { random.Below(RegionSize - size), random.Next() & 0x1FF, size };
+
+            case RoutineKind::Memcmp:
+            {
+                const RoutineArgs args{ random.Below(half - size), half + random.Below(half - size), size };
+                memcpy(region + args.second, region + args.first, size);
+
+                if (size != 0 && random.Below(4) != 0)
+                    region[args.second + random.Below(size)] ^= static_cast<uint8_t>(1 + random.Below(255));
+
+                return args;
+            }
+
+            case RoutineKind::Strlen:
+            {
+                const uint32_t start = random.Below(half);
+                for (uint32_t i = 0; i < size; i++)
+                    region[start + i] |= region[start + i] == 0;
+
+                region[start + size] = 0;
+                return { start, 0, 0 };
+            }
+        }
+
+        return {};
+    }
+
+    bool Fuzz(const BoundRoutine& routine, const Scratch& scratch)
+    {
+        constexpr size_t Cases = 2000;
+
+        Random random;
+
+        for (size_t i = 0; i < Cases; i++)
+        {
+            const RoutineArgs args = MakeCase(routine.kind, random, scratch.original);
+            memcpy(scratch.replacement, scratch.original, RegionSize);
+
+            const uint32_t expected = Invoke(routine, routine.original, scratch.original, args);
+            const uint32_t actual = Invoke(routine, routine.replacement, scratch.replacement, args);
+
+            if (expected != actual || memcmp(scratch.original, scratch.replacement, RegionSize) != 0)
+            {
+                SDLogger::Log("GuestMemops - %s mismatch: args 0x%X 0x%X size %u, result 0x%X vs 0x%X", routine.name,
+                    args.first, args.second, args.size, expected, actual);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    constexpr uint64_t BytesPerRun = 64ull << 20;
+
+    // Full-length work for `size`: equal ranges for memcmp, no early terminator for strlen.
+    RoutineArgs MakeMeasureCase(RoutineKind kind, uint8_t* region, uint32_t size)
+    {
+        const uint32_t half = RegionSize / 2;
+        RoutineArgs args{ 0, half, size };
+
+        if (kind == RoutineKind::Memset)
+            args.second = 0x5A;
+
+        if (kind == RoutineKind::Memcmp)
+            memcpy(region + half, region, size);
+
+        if (kind == RoutineKind::Strlen)
+        {
+            memset(region, 'a', size);
+            region[size] = 0;
+        }
+
+        return args;
+    }
+
+    double MeasureThroughput(const BoundRoutine& routine, PPCFunc* function, uint8_t* region, uint32_t size)
+    {
+        const RoutineArgs args = MakeMeasureCase(routine.kind, region, size);
+
+        const uint64_t iterations = BytesPerRun / size;
+        const uint64_t start = armGetSystemTick();
+
+        for (uint64_t i = 0; i < iterations; i++)
+            Invoke(routine, function, region, args);
+
+        const uint64_t ns = armTicksToNs(armGetSystemTick() - start);
+        return ns != 0 ? (double)(iterations * size) / ns : 0.0;
+    }
+
+    // The host kernels on their own, without the thunk, against newlib. Runs whether or
+    // not anything is bound, so the kernels can be judged on the device first.
+    constexpr std::pair<RoutineKind, const char*> HostKernels[] =
+    {
+        { RoutineKind::Memcpy, "memcpy" },
+        { RoutineKind::Memset, "memset" },
+        { RoutineKind::Memmove, "memmove" },
+        { RoutineKind::Memcmp, "memcmp" },
+        { RoutineKind::Strlen, "strlen" },
+    };
+
+    volatile uint32_t g_hostKernelSink;
+
+    // Same result convention as Invoke, on host pointers.
+    uint32_t InvokeHost(RoutineKind kind, bool libc, uint8_t* region, const RoutineArgs& args)
+    {
+        uint8_t* first = region + args.first;
+        uint8_t* second = region + args.second;
+
+        switch (kind)
+        {
+            case RoutineKind::Memcpy:
+                return uint32_t(static_cast<uint8_t*>(libc ? memcpy(first, second, args.size) : GuestMemcpy(first, second, args.size)) - region);
+
+            case RoutineKind::Memmove:
+                return uint32_t(static_cast<uint8_t*>(libc ? memmove(first, second, args.size) : GuestMemmove(first, second, args.size)) - region);
+
+            case RoutineKind::Memset:
+                return uint32_t(static_cast<uint8_t*>(libc ? memset(first, args.second, args.size) : GuestMemset(first, args.second, args.size)) - region);
+
+            case RoutineKind::Memcmp:
+            {
+                const int32_t result = libc ? memcmp(first, second, args.size) : GuestMemcmp(first, second, args.size);
+                return (result > 0) - (result < 0);
+            }
+
+            case RoutineKind::Strlen:
+                return libc ? uint32_t(strlen(reinterpret_cast<char*>(first))) : GuestStrlen(reinterpret_cast<char*>(first));
+        }
+
+        return 0;
+    }
+
+    bool FuzzHost(RoutineKind kind, const char* name, uint8_t* kernel, uint8_t* libc)
+    {
+        constexpr size_t Cases = 20000;
+
+        Random random;
+
+        for (size_t i = 0; i < Cases; i++)
+        {
+            const RoutineArgs args = MakeCase(kind, random, libc);
+            memcpy(kernel, libc, RegionSize);
+
+            const uint32_t expected = InvokeHost(kind, true, libc, args);
+            const uint32_t actual = InvokeHost(kind, false, kernel, args);
+
+            if (expected != actual || memcmp(kernel, libc, RegionSize) != 0)
+            {
+                SDLogger::Log("GuestMemops host - %s mismatch: args 0x%X 0x%X size %u, result 0x%X vs 0x%X", name,
+                    args.first, args.second, args.size, expected, actual);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    double MeasureHost(RoutineKind kind, bool libc, uint8_t* region, uint32_t size)
+    {
+        const RoutineArgs args = MakeMeasureCase(kind, region, size);
+
+        const uint64_t iterations = BytesPerRun / size;
+        const uint64_t start = armGetSystemTick();
+
+        for (uint64_t i = 0; i < iterations; i++)
+            g_hostKernelSink = InvokeHost(kind, libc, region, args);
+
+        const uint64_t ns = armTicksToNs(armGetSystemTick() - start);
+        return ns != 0 ? (double)(iterations * size) / ns : 0.0;
+    }
+
+    void BenchmarkHostKernels()
+    {
+        std::vector<uint8_t> kernel(RegionSize), libc(RegionSize);
+
+        for (const auto& [kind, name] : HostKernels)
+        {
+            if (!FuzzHost(kind, name, kernel.data(), libc.data()))
+                continue;
+
+            for (uint32_t size : { 16u, 48u, 256u, 4096u })
+            {
+                SDLogger::Log("GuestMemops host - %-8s %5u bytes: newlib %6.2f GB/s, kernel %6.2f GB/s", name, size,
+                    MeasureHost(kind, true, libc.data(), size), MeasureHost(kind, false, kernel.data(), size));
+            }
+        }
+    }
+
+} // namespace
+
+void GuestMemops::RunBenchmark()
+{
+    BenchmarkHostKernels();
+
+    const auto routines = GetBoundRoutines();
+    if (routines.empty())
+    {
+        SDLogger::Log("GuestMemops - no routines bound, add <routine>_address entries to RXN.toml");
+        return;
+    }
+
+    // A scratch guest stack for the calls, like the thunk benchmark.
+    constexpr size_t StackSize = 0x1000;
+
+    uint8_t* stack = (uint8_t*)g_userHeap.Alloc(StackSize);
+    const Scratch scratch{ (uint8_t*)g_userHeap.Alloc(RegionSize), (uint8_t*)g_userHeap.Alloc(RegionSize) };
+
+    PPCContext ctx{};
+    ctx.r1.u64 = g_memory.MapVirtual(stack + StackSize - 0x200);
+
+    PPCContext* previous = GetPPCContext();
+    SetPPCContext(ctx);
+
+    for (const auto& routine : routines)
+    {
+        if (!Fuzz(routine, scratch))
+            continue;
+
+        for (uint32_t size : { 16u, 256u, 4096u, RegionSize / 4 })
+        {
+            SDLogger::Log("GuestMemops bench - %-28s %6u bytes: recompiled %6.2f GB/s, host %6.2f GB/s", routine.name, size,
+                MeasureThroughput(routine, routine.original, scratch.original, size),
+                MeasureThroughput(routine, routine.replacement, scratch.replacement, size));
+        }
+    }
+
+    g_ppcContext = previous;
+
+    g_userHeap.Free(scratch.replacement);
+    g_userHeap.Free(scratch.original);
+    g_userHeap.Free(stack);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// Host replacements for the game's C runtime memory routines (memcpy, memset, memmove,
+// memcmp, strlen). Their guest addresses come from `<routine>_address` entries in
+// RXN.toml: CMake turns each one into RXN_GUEST_<ROUTINE>=sub_XXXXXXXX, and
+// guest_memops.cpp defines that symbol, overriding the recompiler's weak alias so both
+// direct calls and PPC_LOOKUP_FUNC dispatch land in host code. The recompiled body
+// stays reachable as __imp__sub_XXXXXXXX for the self-test.
+namespace GuestMemops {
+
+    // Fuzzes the host kernels against newlib and logs both, then fuzzes each bound
+    // replacement against the recompiled original on guest memory and logs throughput
+    // of both for a few sizes.
+    void RunBenchmark();
+
+} // namespace GuestMemops
@@ -0,0 +1,162 @@
+#include "guest_setjmp.h"
+#include "function.h"
+#include "heap.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <cstdlib>
+
+// Its address tells the threads apart, a jmp_buf is only valid on the thread that armed it.
+static thread_local char g_jumpThreadTag;
+
+void** GuestSetJmp::Arm(void* buffer, PPCContext& ctx)
+{
+    auto* jump = static_cast<GuestJumpBuffer*>(buffer);
+    jump->context = &ctx;
+    jump->thread = &g_jumpThreadTag;
+    jump->fpscr = ctx.fpscr.csr;
+    jump->value = 0;
+
+    return jump->frame;
+}
+
+void GuestSetJmp::Jump(void* buffer, int32_t value)
+{
+    auto* jump = static_cast<GuestJumpBuffer*>(buffer);
+
+    if (jump->thread != &g_jumpThreadTag)
+    {
+        SDLogger::Log("GuestSetJmp::Jump - jmp_buf was armed on another thread");
+        abort();
+    }
+
+    jump->value = value != 0 ? value : 1;
+
+    // The landing restores the context copied at setjmp time, cached FPCR included.
+    GuestFpscr::Switch(GetPPCContext()->fpscr.csr, jump->fpscr);
+    SetPPCContext(*jump->context);
+
+    __builtin_longjmp(jump->frame, 1);
+}
+
+// Benchmark bodies shaped like the recompiler's output around setjmp_address.
+constexpr size_t SETJMP_BENCHMARK_ITERATIONS = 1'000'000;
+
+PPC_FUNC(BenchLongJmpLibc)
+{
+    ctx.r1.u64 -= 0x80;
+    (longjmp)(*reinterpret_cast<jmp_buf*>(base + ctx.r3.u32), ctx.r4.s32);
+}
+
+PPC_FUNC(BenchLongJmpGuest)
+{
+    ctx.r1.u64 -= 0x80;
+    GUEST_LONGJMP(*reinterpret_cast<jmp_buf*>(base + ctx.r3.u32), ctx.r4.s32);
+}
+
+PPC_FUNC(BenchLongJmpThunk)
+{
+    GuestToHostFunction<void>(BenchLongJmpGuest, ctx.r3.u32, ctx.r4.u32);
+}
+
+static PPCFunc* volatile g_benchLongJmpLibc = BenchLongJmpLibc;
+static PPCFunc* volatile g_benchLongJmpGuest = BenchLongJmpGuest;
+static PPCFunc* volatile g_benchLongJmpThunk = BenchLongJmpThunk;
+
+PPC_FUNC(BenchSetJmpLibc)
+{
+    PPCContext env = ctx;
+    const int64_t result = (setjmp)(*reinterpret_cast<jmp_buf*>(base + ctx.r3.u32));
+    if (result != 0)
+        ctx = env;
+
+    ctx.r3.s64 = result;
+    if (result == 0)
+    {
+        ctx.r3.u64 = env.r3.u64;
+        g_benchLongJmpLibc(ctx, base);
+    }
+}
+
+PPC_FUNC(BenchSetJmpGuest)
+{
+    PPCContext env = ctx;
+    const int64_t result = GUEST_SETJMP(*reinterpret_cast<jmp_buf*>(base + ctx.r3.u32));
+    if (result != 0)
+        ctx = env;
+
+    ctx.r3.s64 = result;
+    if (result == 0)
+    {
+        ctx.r3.u64 = env.r3.u64;
+        (ctx.r5.u32 != 0 ? g_benchLongJmpThunk : g_benchLongJmpGuest)(ctx, base);
+    }
+}
+
+void GuestSetJmp::RunBenchmark()
+{
+    constexpr size_t StackSize = 0x1000;
+    constexpr size_t JumpBufferSize = 0x200;
+
+    uint8_t* stack = (uint8_t*)g_userHeap.Alloc(StackSize);
+    uint8_t* jumpBuffer = (uint8_t*)g_userHeap.Alloc(JumpBufferSize);
+
+    PPCContext ctx{};
+    ctx.r1.u64 = g_memory.MapVirtual(stack + StackSize - 0x200);
+
+    PPCContext* previous = GetPPCContext();
+    SetPPCContext(ctx);
+
+    // Values, r1 and the current context have to come back as they were at setjmp.
+    auto check = [&](PPCFunc* function, uint32_t thunk)
+        {
+            for (int32_t value : { 0, 1, -7, 0x12345678 })
+            {
+                const uint64_t stackPointer = ctx.r1.u64;
+                ctx.r3.u64 = g_memory.MapVirtual(jumpBuffer);
+                ctx.r4.s64 = value;
+                ctx.r5.u64 = thunk;
+
+                function(ctx, g_memory.base);
+
+                if (ctx.r3.s32 != (value != 0 ? value : 1) || ctx.r1.u64 != stackPointer
+                    || GetPPCContext() != &ctx)
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        };
+
+    auto measure = [&](const char* name, PPCFunc* function, uint32_t thunk)
+        {
+            ctx.r3.u64 = g_memory.MapVirtual(jumpBuffer);
+            ctx.r4.s64 = 1;
+            ctx.r5.u64 = thunk;
+
+            const uint32_t buffer = ctx.r3.u32;
+            const uint64_t start = armGetSystemTick();
+
+            for (size_t i = 0; i < SETJMP_BENCHMARK_ITERATIONS; i++)
+            {
+                ctx.r3.u64 = buffer;
+                function(ctx, g_memory.base);
+            }
+
+            const uint64_t ns = armTicksToNs(armGetSystemTick() - start);
+            SDLogger::Log("SetJmp bench - %-22s %6llu ns/pair, %9llu pairs/s", name,
+                (unsigned long long)(ns / SETJMP_BENCHMARK_ITERATIONS),
+                (unsigned long long)(ns != 0 ? SETJMP_BENCHMARK_ITERATIONS * 1'000'000'000ull / ns : 0));
+        };
+
+    if (!check(BenchSetJmpLibc, 0) || !check(BenchSetJmpGuest, 0) || !check(BenchSetJmpGuest, 1))
+        SDLogger::Log("SetJmp check - a longjmp did not restore the setjmp state, timings below are meaningless");
+
+    measure("libc setjmp", BenchSetJmpLibc, 0);
+    measure("guest setjmp", BenchSetJmpGuest, 0);
+    measure("guest setjmp + thunk", BenchSetJmpGuest, 1);
+
+    g_ppcContext = previous;
+    g_userHeap.Free(jumpBuffer);
+    g_userHeap.Free(stack);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Guest setjmp/longjmp for the calls XenonRecomp emits at setjmp_address and
+// longjmp_address. The recompiler copies the whole PPCContext around the call and
+// hands the guest jmp_buf to the host setjmp; these replacements keep that copy but
+// save only what __builtin_setjmp needs (frame, stack and resume address) and record
+// which thread and PPCContext the buffer belongs to, so a longjmp out of a callback
+// nested under host code leaves the thread consistent.
+//
+// With RXN_GUEST_SETJMP this header is force-included into the recompiled sources and
+// takes over their setjmp/longjmp. Host frames skipped by a longjmp still don't run
+// their destructors, exactly like with the C library longjmp.
+#include "guest_fpscr.h"
+#include <ppc_context.h>
+#include <csetjmp>
+#include <cstdint>
+
+// Lives in the guest jmp_buf, which is far larger than this.
+struct GuestJumpBuffer
+{
+    void* frame[5];
+    PPCContext* context;
+    const void* thread;
+    GuestFpscr::Control fpscr;
+    int32_t value;
+};
+
+namespace GuestSetJmp {
+
+    void** Arm(void* buffer, PPCContext& ctx);
+
+    inline int32_t Value(void* buffer)
+    {
+        return static_cast<GuestJumpBuffer*>(buffer)->value;
+    }
+
+    [[noreturn]] void Jump(void* buffer, int32_t value);
+
+    // setjmp/longjmp pairs per second against the C library version, thrown directly
+    // and from under a host->guest thunk.
+    void RunBenchmark();
+
+} // namespace GuestSetJmp
+
+#define GUEST_SETJMP(env) (__builtin_setjmp(GuestSetJmp::Arm(&(env), ctx)) == 0 ? 0 : GuestSetJmp::Value(&(env)))
+#define GUEST_LONGJMP(env, value) GuestSetJmp::Jump(&(env), (value))
+
+#ifdef RXN_GUEST_SETJMP
+#undef setjmp
+#undef longjmp
+#define setjmp(env) GUEST_SETJMP(env)
+#define longjmp(env, value) GUEST_LONGJMP(env, value)
+#endif
@@ -3,12 +3,14 @@
 #include "byteswap.h"
 #include "ppc_context.h"
 #include "nx/log/nxlogger.h"
+#include "function.h"
 
 #include <cstring>
 #include <cassert>
 #include <algorithm>
 #include <bit>
 #include <iostream>
+#include <vector>
 
 constexpr size_t PCR_SIZE = 0xAB0;
 constexpr size_t TLS_SIZE = 0x100;
@@ -18,6 +20,39 @@ constexpr size_t TOTAL_SIZE = PCR_SIZE + TLS_SIZE + TEB_SIZE + STACK_SIZE;
 
 constexpr size_t TEB_OFFSET = PCR_SIZE + TLS_SIZE;
 
+static thread_local GuestThreadContext* g_currentThreadContext = nullptr;
+
+// KeTls slots live directly in the TLS block that follows the PCR, so reading one
+// from guest code is a bounds check and a load off r13.
+constexpr uint32_t TLS_SLOT_COUNT = TLS_SIZE / sizeof(uint32_t);
+constexpr uint32_t TLS_OUT_OF_INDEXES = 0xFFFFFFFF;
+
+static_assert(TLS_SLOT_COUNT == 64, "The slot bitmap is a single 64-bit word.");
+
+// Slot 4 is preset to -1 for every thread below and is never handed out or freed.
+constexpr uint64_t TLS_RESERVED_MASK = 1ull << 4;
+static std::atomic<uint64_t> g_tlsSlotMask{ TLS_RESERVED_MASK };
+
+// Every live guest thread; KeTls alloc/free reset a slot in all of them, like on
+// the console, and APCs from other threads are routed through it.
+static Mutex g_threadsMutex;
+static std::vector<GuestThreadContext*> g_threads;
+
+static inline be<uint32_t>* GetTlsSlots(uint8_t* base, uint32_t pcr)
+{
+    return reinterpret_cast<be<uint32_t>*>(base + pcr + PCR_SIZE);
+}
+
+static void ResetTlsSlotForAllThreads(uint32_t index)
+{
+    mutexLock(&g_threadsMutex);
+
+    for (GuestThreadContext* context : g_threads)
+        reinterpret_cast<be<uint32_t>*>(context->thread + PCR_SIZE)[index] = 0;
+
+    mutexUnlock(&g_threadsMutex);
+}
+
 // libnx thread entry point wrapper
 void GuestThreadFuncWrapper(void* arg)
 {
@@ -54,19 +89,76 @@ GuestThreadContext::GuestThreadContext(uint32_t cpuNumber)
 
     ppcContext.r1.u64 = g_memory.MapVirtual(thread + PCR_SIZE + TLS_SIZE + TEB_SIZE + STACK_SIZE);
     ppcContext.r13.u64 = g_memory.MapVirtual(thread);
+    // The only host FPCR read for this thread; from here on the context caches it (guest_fpscr.h).
     ppcContext.fpscr.loadFromHost();
 
     SDLogger::Log(("GuestThreadContext - Context initialized for CPU " + std::to_string(cpuNumber)).c_str());
     assert(GetPPCContext() == nullptr);
     SetPPCContext(ppcContext);
+    g_currentThreadContext = this;
+
+    mutexLock(&g_threadsMutex);
+    g_threads.push_back(this);
+    mutexUnlock(&g_threadsMutex);
 }
 
 GuestThreadContext::~GuestThreadContext()
 {
+    if (g_currentThreadContext == this)
+        g_currentThreadContext = nullptr;
+
+    mutexLock(&g_threadsMutex);
+    g_threads.erase(std::remove(g_threads.begin(), g_threads.end(), this), g_threads.end());
+    mutexUnlock(&g_threadsMutex);
+
     SDLogger::Log(("GuestThreadContext - Freeing thread context at " + std::to_string((uintptr_t)thread)).c_str());
     g_userHeap.Free(thread);
 }
 
+GuestThreadContext* GuestThreadContext::GetCurrent()
+{
+    return g_currentThreadContext;
+}
+
+void GuestThreadContext::QueueApc(const GuestApc& apc)
+{
+    mutexLock(&apcMutex);
+    apcQueue.push_back(apc);
+    mutexUnlock(&apcMutex);
+
+    alerted.store(true, std::memory_order_release);
+}
+
+bool GuestThreadContext::QueueApc(uint32_t pcr, const GuestApc& apc)
+{
+    mutexLock(&g_threadsMutex);
+
+    auto it = std::find_if(g_threads.begin(), g_threads.end(), [pcr](GuestThreadContext* context)
+        {
+            return context->ppcContext.r13.u32 == pcr;
+        });
+
+    // Holding the registry lock keeps the thread from tearing its context down.
+    if (it != g_threads.end())
+        (*it)->QueueApc(apc);
+
+    mutexUnlock(&g_threadsMutex);
+    return it != g_threads.end();
+}
+
+bool GuestThreadContext::DeliverApcs()
+{
+    mutexLock(&apcMutex);
+    std::vector<GuestApc> pending;
+    pending.swap(apcQueue);
+    mutexUnlock(&apcMutex);
+
+    for (const auto& apc : pending)
+        GuestToHostFunction<void>(apc.routine, apc.arguments[0], apc.arguments[1], apc.arguments[2]);
+
+    return !pending.empty();
+}
+
 GuestThreadHandle::GuestThreadHandle(const GuestThreadParams& params)
     : params(params), suspended((params.flags & 0x1) != 0)
 {
@@ -214,4 +306,82 @@ uint32_t SetThreadIdealProcessorImpl(GuestThreadHandle* hThread, uint32_t dwIdea
     SDLogger::Log(("SetThreadIdealProcessorImpl - ThreadID=" + std::to_string(hThread->GetThreadId()) +
                    ", IdealProcessor=" + std::to_string(dwIdealProcessor)).c_str());
     return 0;
-}
\ No newline at end of file
+}
+
+uint32_t KeTlsAlloc()
+{
+    uint64_t mask = g_tlsSlotMask.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+        if (mask == UINT64_MAX)
+        {
+            SDLogger::Log("KeTlsAlloc - Out of TLS slots");
+            return TLS_OUT_OF_INDEXES;
+        }
+
+        const uint32_t index = std::countr_one(mask);
+        if (g_tlsSlotMask.compare_exchange_weak(mask, mask | (1ull << index), std::memory_order_acq_rel))
+        {
+            ResetTlsSlotForAllThreads(index);
+            return index;
+        }
+    }
+}
+
+uint32_t KeTlsFree(uint32_t dwTlsIndex)
+{
+    if (dwTlsIndex >= TLS_SLOT_COUNT)
+        return FALSE;
+
+    const uint64_t bit = 1ull << dwTlsIndex;
+    if (bit & TLS_RESERVED_MASK)
+        return FALSE;
+
+    if ((g_tlsSlotMask.fetch_and(~bit, std::memory_order_acq_rel) & bit) == 0)
+        return FALSE;
+
+    ResetTlsSlotForAllThreads(dwTlsIndex);
+    return TRUE;
+}
+
+uint32_t KeTlsGetValue(uint32_t dwTlsIndex)
+{
+    if (dwTlsIndex >= TLS_SLOT_COUNT)
+        return 0;
+
+    return GetTlsSlots(g_memory.base, GetPPCContext()->r13.u32)[dwTlsIndex];
+}
+
+uint32_t KeTlsSetValue(uint32_t dwTlsIndex, uint32_t tlsValue)
+{
+    if (dwTlsIndex >= TLS_SLOT_COUNT)
+        return FALSE;
+
+    GetTlsSlots(g_memory.base, GetPPCContext()->r13.u32)[dwTlsIndex] = tlsValue;
+    return TRUE;
+}
+
+// Get/set are called on very hot paths, so they read their arguments straight out of
+// the guest registers instead of going through HostToGuestFunction and GetPPCContext().
+PPC_FUNC(__imp__KeTlsGetValue)
+{
+    const uint32_t index = ctx.r3.u32;
+    ctx.r3.u64 = index < TLS_SLOT_COUNT ? GetTlsSlots(base, ctx.r13.u32)[index].get() : 0;
+}
+
+PPC_FUNC(__imp__KeTlsSetValue)
+{
+    const uint32_t index = ctx.r3.u32;
+    if (index >= TLS_SLOT_COUNT)
+    {
+        ctx.r3.u64 = FALSE;
+        return;
+    }
+
+    GetTlsSlots(base, ctx.r13.u32)[index] = ctx.r4.u32;
+    ctx.r3.u64 = TRUE;
+}
+
+GUEST_FUNCTION_HOOK(__imp__KeTlsAlloc, KeTlsAlloc);
+GUEST_FUNCTION_HOOK(__imp__KeTlsFree, KeTlsFree);
@@ -1,18 +1,42 @@
 #pragma once
 
 #include <atomic>
+#include <vector>
 #include "xdm.h"
 #include <switch.h>
 
 #define CURRENT_THREAD_HANDLE uint32_t(-2)
 
+struct GuestApc
+{
+    uint32_t routine;
+    uint32_t arguments[3];
+};
+
 struct GuestThreadContext
 {
     PPCContext ppcContext{};
     uint8_t* thread = nullptr;
 
+    // Raised to wake the thread out of an alertable wait.
+    std::atomic<bool> alerted{ false };
+
+    Mutex apcMutex{};
+    std::vector<GuestApc> apcQueue;
+
     GuestThreadContext(uint32_t cpuNumber);
     ~GuestThreadContext();
+
+    // Queues a user APC and alerts the thread; it runs at the next alertable wait.
+    void QueueApc(const GuestApc& apc);
+
+    // Same, for the thread whose PCR is at `pcr`; false if it has already exited.
+    static bool QueueApc(uint32_t pcr, const GuestApc& apc);
+
+    // Runs queued user APCs, must be called on the owning thread.
+    bool DeliverApcs();
+
+    static GuestThreadContext* GetCurrent();
 };
 
 struct GuestThreadParams
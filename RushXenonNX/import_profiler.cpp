@@ -0,0 +1,177 @@
+#include "import_profiler.h"
+#include "export_table.h"
+#include "nx/log/nxlogger.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+std::atomic<bool> ImportProfiler::g_enabled{ false };
+
+// Static initialisation only, like the stub counters.
+static constinit ImportLatency* g_importLatencies = nullptr;
+
+// Finds which library exports `name` so the report can show library and ordinal.
+static const char* FindImportOrdinal(const char* name, uint32_t& ordinal)
+{
+    ExportLibrary library;
+    ExportTable::FindOrdinal(name, library, ordinal);
+    return ExportTable::GetLibraryName(library);
+}
+
+ImportLatency::ImportLatency(const char* name)
+    : name(name), next(g_importLatencies)
+{
+    g_importLatencies = this;
+}
+
+void ImportLatency::Record(uint64_t ticks)
+{
+    calls.fetch_add(1, std::memory_order_relaxed);
+    totalTicks.fetch_add(ticks, std::memory_order_relaxed);
+    buckets[BucketOf(ticks)].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t currentMax = maxTicks.load(std::memory_order_relaxed);
+    while (ticks > currentMax && !maxTicks.compare_exchange_weak(currentMax, ticks, std::memory_order_relaxed))
+    {
+    }
+}
+
+void ImportLatency::Reset()
+{
+    calls.store(0, std::memory_order_relaxed);
+    totalTicks.store(0, std::memory_order_relaxed);
+    maxTicks.store(0, std::memory_order_relaxed);
+
+    for (auto& bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+}
+
+struct ImportSample
+{
+    const ImportLatency* latency;
+    uint64_t calls;
+    uint64_t totalTicks;
+    uint64_t maxTicks;
+    uint32_t buckets[ImportLatency::BucketCount];
+
+    // Upper edge of the bucket holding the given percentile, in ticks.
+    uint64_t Percentile(uint32_t percent) const
+    {
+        const uint64_t target = (calls * percent + 99) / 100;
+        uint64_t seen = 0;
+
+        for (size_t i = 0; i < ImportLatency::BucketCount; i++)
+        {
+            seen += buckets[i];
+            if (seen >= target && seen != 0)
+                return std::min(ImportLatency::BucketLowerBound(i + 1) - 1, maxTicks);
+        }
+
+        return maxTicks;
+    }
+};
+
+static std::vector<ImportSample> SnapshotImports()
+{
+    std::vector<ImportSample> samples;
+
+    for (const ImportLatency* latency = g_importLatencies; latency != nullptr; latency = latency->next)
+    {
+        const uint64_t calls = latency->calls.load(std::memory_order_relaxed);
+        if (calls == 0)
+            continue;
+
+        ImportSample& sample = samples.emplace_back();
+        sample.latency = latency;
+        sample.calls = calls;
+        sample.totalTicks = latency->totalTicks.load(std::memory_order_relaxed);
+        sample.maxTicks = latency->maxTicks.load(std::memory_order_relaxed);
+
+        for (size_t i = 0; i < ImportLatency::BucketCount; i++)
+            sample.buckets[i] = latency->buckets[i].load(std::memory_order_relaxed);
+    }
+
+    std::sort(samples.begin(), samples.end(), [](const ImportSample& lhs, const ImportSample& rhs)
+        {
+            return lhs.totalTicks > rhs.totalTicks;
+        });
+
+    return samples;
+}
+
+void ImportProfiler::SetEnabled(bool value)
+{
+    g_enabled.store(value, std::memory_order_relaxed);
+    SDLogger::Log("ImportProfiler - %s", value ? "enabled" : "disabled");
+}
+
+void ImportProfiler::Report(size_t maxEntries)
+{
+    const auto samples = SnapshotImports();
+
+    SDLogger::Log("=== Import latency: %zu imports called ===", samples.size());
+    SDLogger::Log("%-40s %-8s %6s %10s %10s %9s %9s %9s %9s", "import", "library", "ord", "calls", "total_us",
+        "mean_ns", "p50_ns", "p99_ns", "max_ns");
+
+    for (size_t i = 0; i < std::min(maxEntries, samples.size()); i++)
+    {
+        const auto& sample = samples[i];
+
+        uint32_t ordinal;
+        const char* library = FindImportOrdinal(sample.latency->name, ordinal);
+
+        SDLogger::Log("%-40s %-8s %6u %10llu %10llu %9llu %9llu %9llu %9llu", sample.latency->name, library, ordinal,
+            (unsigned long long)sample.calls,
+            (unsigned long long)(armTicksToNs(sample.totalTicks) / 1000),
+            (unsigned long long)(armTicksToNs(sample.totalTicks) / sample.calls),
+            (unsigned long long)armTicksToNs(sample.Percentile(50)),
+            (unsigned long long)armTicksToNs(sample.Percentile(99)),
+            (unsigned long long)armTicksToNs(sample.maxTicks));
+    }
+}
+
+bool ImportProfiler::WriteCsv(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+    {
+        SDLogger::Log("ImportProfiler::WriteCsv - Failed to open %s", path);
+        return false;
+    }
+
+    fprintf(file, "import,library,ordinal,calls,total_ns,p50_ns,p99_ns,max_ns,histogram\n");
+
+    for (const auto& sample : SnapshotImports())
+    {
+        uint32_t ordinal;
+        const char* library = FindImportOrdinal(sample.latency->name, ordinal);
+
+        fprintf(file, "%s,%s,%u,%llu,%llu,%llu,%llu,%llu,", sample.latency->name, library, ordinal,
+            (unsigned long long)sample.calls,
+            (unsigned long long)armTicksToNs(sample.totalTicks),
+            (unsigned long long)armTicksToNs(sample.Percentile(50)),
+            (unsigned long long)armTicksToNs(sample.Percentile(99)),
+            (unsigned long long)armTicksToNs(sample.maxTicks));
+
+        const char* separator = "";
+        for (size_t i = 0; i < ImportLatency::BucketCount; i++)
+        {
+            if (sample.buckets[i] == 0)
+                continue;
+
+            fprintf(file, "%s%llu:%u", separator, (unsigned long long)armTicksToNs(ImportLatency::BucketLowerBound(i)), sample.buckets[i]);
+            separator = " ";
+        }
+
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+    return true;
+}
+
+void ImportProfiler::Reset()
+{
+    for (ImportLatency* latency = g_importLatencies; latency != nullptr; latency = latency->next)
+        latency->Reset();
+}
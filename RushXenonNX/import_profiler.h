@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <switch.h>
+
+// Latency histogram of one host-implemented import. Buckets are log-linear: exact
+// below 8 ticks, then four sub-buckets per power of two (<= 25% error), in units
+// of the 19.2 MHz system counter, the finest clock readable from user mode.
+struct ImportLatency
+{
+    static constexpr uint32_t SubBucketBits = 2;
+    static constexpr size_t BucketCount = 128;
+
+    const char* name;
+    std::atomic<uint64_t> calls{ 0 };
+    std::atomic<uint64_t> totalTicks{ 0 };
+    std::atomic<uint64_t> maxTicks{ 0 };
+    std::atomic<uint32_t> buckets[BucketCount]{};
+    ImportLatency* next{};
+
+    explicit ImportLatency(const char* name);
+
+    void Record(uint64_t ticks);
+    void Reset();
+
+    static constexpr size_t BucketOf(uint64_t ticks)
+    {
+        constexpr uint64_t Linear = 2ull << SubBucketBits;
+        if (ticks < Linear)
+            return ticks;
+
+        const uint32_t exponent = std::bit_width(ticks) - 1;
+        const uint64_t sub = (ticks >> (exponent - SubBucketBits)) & ((1ull << SubBucketBits) - 1);
+        const size_t bucket = ((exponent - SubBucketBits + 1) << SubBucketBits) + sub;
+
+        return bucket < BucketCount ? bucket : BucketCount - 1;
+    }
+
+    static constexpr uint64_t BucketLowerBound(size_t bucket)
+    {
+        constexpr size_t Linear = 2ull << SubBucketBits;
+        if (bucket < Linear)
+            return bucket;
+
+        const uint32_t exponent = (bucket >> SubBucketBits) + SubBucketBits - 1;
+        const uint64_t sub = bucket & ((1ull << SubBucketBits) - 1);
+
+        return ((1ull << SubBucketBits) + sub) << (exponent - SubBucketBits);
+    }
+};
+
+static_assert(ImportLatency::BucketOf(7) == 7 && ImportLatency::BucketOf(8) == 8 && ImportLatency::BucketOf(12) == 10);
+static_assert(ImportLatency::BucketLowerBound(ImportLatency::BucketOf(1000)) <= 1000
+    && ImportLatency::BucketLowerBound(ImportLatency::BucketOf(1000) + 1) > 1000);
+
+namespace ImportProfiler {
+
+    extern std::atomic<bool> g_enabled;
+
+    inline bool IsEnabled()
+    {
+        return g_enabled.load(std::memory_order_relaxed);
+    }
+
+    void SetEnabled(bool value);
+
+    // Logs the `maxEntries` imports with the most total time.
+    void Report(size_t maxEntries = 32);
+
+    // Every import that was called, with its non-empty buckets as lower_ns:count pairs.
+    bool WriteCsv(const char* path);
+
+    void Reset();
+
+} // namespace ImportProfiler
+
+// Times the enclosing scope into `latency` while import profiling is on. Imports
+// that call back into the guest include the time spent there.
+class ImportTimer
+{
+public:
+    explicit ImportTimer(ImportLatency& latency)
+        : latency(latency), start(ImportProfiler::IsEnabled() ? armGetSystemTick() : 0)
+    {
+    }
+
+    ~ImportTimer()
+    {
+        if (start != 0) [[unlikely]]
+            latency.Record(armGetSystemTick() - start);
+    }
+
+private:
+    ImportLatency& latency;
+    uint64_t start;
+};
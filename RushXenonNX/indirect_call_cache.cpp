@@ -0,0 +1,224 @@
+#include "indirect_call_cache.h"
+#include "memory.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+std::atomic<bool> IndirectCallProfiler::g_enabled{ false };
+
+// Sites register themselves on their first miss, from whichever guest thread gets there.
+static std::atomic<IndirectCallSite*> g_indirectCallSites{ nullptr };
+
+PPC_FUNC(IndirectCallAnchor)
+{
+    SDLogger::Log("IndirectCallAnchor - indirect call to guest address 0, r3 0x%08X", ctx.r3.u32);
+}
+
+PPCFunc* IndirectCallSite::Miss(uint32_t guest)
+{
+    if (!registered.load(std::memory_order_relaxed) && !registered.exchange(true, std::memory_order_acq_rel))
+    {
+        next = g_indirectCallSites.load(std::memory_order_relaxed);
+        while (!g_indirectCallSites.compare_exchange_weak(next, this, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    Profile(guest, false);
+
+    PPCFunc* host = g_memory.FindFunction(guest);
+    const intptr_t offset = reinterpret_cast<intptr_t>(host) - reinterpret_cast<intptr_t>(&IndirectCallAnchor);
+
+    if (host != nullptr && offset == static_cast<int32_t>(offset))
+    {
+        const size_t way = victim.fetch_add(1, std::memory_order_relaxed) % Ways;
+        ways[way].store((static_cast<uint64_t>(static_cast<uint32_t>(offset)) << 32) | guest, std::memory_order_relaxed);
+    }
+
+    return host;
+}
+
+void IndirectCallProfiler::SetEnabled(bool value)
+{
+    g_enabled.store(value, std::memory_order_relaxed);
+    SDLogger::Log("IndirectCallProfiler - %s", value ? "enabled" : "disabled");
+}
+
+struct IndirectCallSample
+{
+    const IndirectCallSite* site;
+    uint64_t calls;
+    uint64_t hits;
+    size_t targetCount;
+};
+
+static std::vector<IndirectCallSample> SnapshotSites()
+{
+    std::vector<IndirectCallSample> samples;
+
+    for (const IndirectCallSite* site = g_indirectCallSites.load(std::memory_order_acquire); site != nullptr; site = site->next)
+    {
+        const uint64_t hits = site->hits.load(std::memory_order_relaxed);
+        const uint64_t calls = hits + site->misses.load(std::memory_order_relaxed);
+        if (calls == 0)
+            continue;
+
+        size_t targetCount = 0;
+        for (const auto& target : site->targets)
+            targetCount += target.guest.load(std::memory_order_relaxed) != 0;
+
+        if (site->otherCalls.load(std::memory_order_relaxed) != 0)
+            targetCount++;
+
+        samples.push_back({ site, calls, hits, targetCount });
+    }
+
+    std::sort(samples.begin(), samples.end(), [](const IndirectCallSample& lhs, const IndirectCallSample& rhs)
+        {
+            return lhs.calls > rhs.calls;
+        });
+
+    return samples;
+}
+
+static const char* DescribeSpread(size_t targetCount)
+{
+    if (targetCount <= 1)
+        return "mono";
+
+    if (targetCount <= IndirectCallSite::Ways)
+        return "bi";
+
+    return targetCount <= IndirectCallSite::TrackedTargets ? "poly" : "mega";
+}
+
+static int FormatTargets(const IndirectCallSite& site, char* buffer, size_t size, char separator)
+{
+    const char delimiter[] = { separator, '\0' };
+    int length = 0;
+    buffer[0] = '\0';
+
+    for (const auto& target : site.targets)
+    {
+        const uint32_t guest = target.guest.load(std::memory_order_relaxed);
+        if (guest == 0 || length >= (int)size)
+            continue;
+
+        length += snprintf(buffer + length, size - length, "%ssub_%08X:%llu", length != 0 ? delimiter : "",
+            guest, (unsigned long long)target.calls.load(std::memory_order_relaxed));
+    }
+
+    const uint64_t other = site.otherCalls.load(std::memory_order_relaxed);
+    if (other != 0 && length < (int)size)
+        length += snprintf(buffer + length, size - length, "%sother:%llu", length != 0 ? delimiter : "",
+            (unsigned long long)other);
+
+    return length;
+}
+
+void IndirectCallProfiler::Report(size_t maxEntries)
+{
+    const auto samples = SnapshotSites();
+
+    SDLogger::Log("=== Indirect calls: %zu sites ===", samples.size());
+    SDLogger::Log("%-24s %7s %12s %7s %-5s %s", "function", "line", "calls", "hit%", "kind", "targets");
+
+    for (size_t i = 0; i < std::min(maxEntries, samples.size()); i++)
+    {
+        const auto& sample = samples[i];
+        char targets[192];
+        FormatTargets(*sample.site, targets, sizeof(targets), ' ');
+
+        SDLogger::Log("%-24s %7u %12llu %6.1f%% %-5s %s", sample.site->function, sample.site->line,
+            (unsigned long long)sample.calls, 100.0 * sample.hits / sample.calls, DescribeSpread(sample.targetCount), targets);
+    }
+}
+
+bool IndirectCallProfiler::WriteCsv(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+    {
+        SDLogger::Log("IndirectCallProfiler::WriteCsv - Failed to open %s", path);
+        return false;
+    }
+
+    fprintf(file, "function,line,calls,hits,kind,targets\n");
+
+    for (const auto& sample : SnapshotSites())
+    {
+        char targets[192];
+        FormatTargets(*sample.site, targets, sizeof(targets), ';');
+
+        fprintf(file, "%s,%u,%llu,%llu,%s,%s\n", sample.site->function, sample.site->line, (unsigned long long)sample.calls,
+            (unsigned long long)sample.hits, DescribeSpread(sample.targetCount), targets);
+    }
+
+    fclose(file);
+    return true;
+}
+
+void IndirectCallProfiler::Reset()
+{
+    for (IndirectCallSite* site = g_indirectCallSites.load(std::memory_order_acquire); site != nullptr; site = site->next)
+    {
+        site->hits.store(0, std::memory_order_relaxed);
+        site->misses.store(0, std::memory_order_relaxed);
+        site->otherCalls.store(0, std::memory_order_relaxed);
+
+        for (auto& target : site->targets)
+        {
+            target.calls.store(0, std::memory_order_relaxed);
+            target.guest.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void IndirectCallProfiler::RunBenchmark()
+{
+    constexpr size_t Iterations = 1'000'000;
+    constexpr size_t MaxTargets = 8;
+
+    uint32_t targets[MaxTargets];
+    size_t targetCount = 0;
+
+    for (size_t i = 0; PPCFuncMappings[i].guest != 0 && targetCount < MaxTargets; i++)
+    {
+        if (PPCFuncMappings[i].host != nullptr)
+            targets[targetCount++] = (uint32_t)PPCFuncMappings[i].guest;
+    }
+
+    if (targetCount == 0)
+        return;
+
+    // Only the lookup is timed, nothing is called.
+    auto run = [&](const char* pattern, size_t spread)
+        {
+            static constinit IndirectCallSite sites[] = { { "RunBenchmark", 1 }, { "RunBenchmark", 2 }, { "RunBenchmark", 3 } };
+            IndirectCallSite& site = sites[spread == 1 ? 0 : spread == 2 ? 1 : 2];
+            spread = std::min(spread, targetCount);
+
+            uintptr_t sink = 0;
+            uint64_t start = armGetSystemTick();
+
+            for (size_t i = 0; i < Iterations; i++)
+                sink ^= (uintptr_t)g_memory.FindFunction(targets[i % spread]);
+
+            const uint64_t tableNs = armTicksToNs(armGetSystemTick() - start);
+            start = armGetSystemTick();
+
+            for (size_t i = 0; i < Iterations; i++)
+                sink ^= (uintptr_t)site.Resolve(targets[i % spread]);
+
+            const uint64_t cacheNs = armTicksToNs(armGetSystemTick() - start);
+
+            SDLogger::Log("IndirectCallCache bench - %-4s (%zu targets): table %.2f ns, inline cache %.2f ns (sink %llx)",
+                pattern, spread, (double)tableNs / Iterations, (double)cacheNs / Iterations, (unsigned long long)(sink & 0xF));
+        };
+
+    run("mono", 1);
+    run("bi", 2);
+    run("mega", MaxTargets);
+}
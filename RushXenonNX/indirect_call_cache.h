@@ -0,0 +1,133 @@
+#pragma once
+
+// Inline caches for indirect guest calls (bctrl through vtables and function pointers).
+// With RXN_INDIRECT_CALL_CACHE this header is force-included into the recompiled
+// sources ahead of ppc_context.h, so every PPC_CALL_INDIRECT_FUNC expansion gets its
+// own static IndirectCallSite remembering the last targets seen there.
+#ifdef RXN_INDIRECT_CALL_CACHE
+#define PPC_CALL_INDIRECT_FUNC(x) \
+    do { static constinit IndirectCallSite _indirectSite{ __func__, __LINE__ }; _indirectSite.Call((x), ctx, base); } while (0)
+#endif
+
+#include <ppc_context.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Host entry points are stored as 32-bit offsets from this function, so a cache way
+// (guest address + offset) fits one 64-bit atomic and can't be read torn. Empty ways
+// decode to it as well; it only runs if the guest calls address 0.
+PPC_EXTERN_FUNC(IndirectCallAnchor);
+
+class IndirectCallSite
+{
+public:
+    // Two ways cover the common monomorphic and bimorphic vtable sites; sites that
+    // see more targets keep missing into the function table and show up in the report.
+    static constexpr size_t Ways = 2;
+
+    // Per-target counters kept while profiling, anything beyond lands in `otherCalls`.
+    static constexpr size_t TrackedTargets = 4;
+
+    struct Target
+    {
+        std::atomic<uint32_t> guest;
+        std::atomic<uint64_t> calls;
+    };
+
+    const char* function;
+    uint32_t line;
+
+    std::atomic<uint64_t> ways[Ways]{};
+    std::atomic<uint8_t> victim{ 0 };
+
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> misses{ 0 };
+    std::atomic<uint64_t> otherCalls{ 0 };
+    Target targets[TrackedTargets]{};
+
+    std::atomic<bool> registered{ false };
+    IndirectCallSite* next{};
+
+    constexpr IndirectCallSite(const char* function, uint32_t line)
+        : function(function), line(line)
+    {
+    }
+
+    PPCFunc* Resolve(uint32_t guest)
+    {
+        for (auto& way : ways)
+        {
+            const uint64_t entry = way.load(std::memory_order_relaxed);
+            if (static_cast<uint32_t>(entry) == guest)
+            {
+                Profile(guest, true);
+                return Decode(entry);
+            }
+        }
+
+        return Miss(guest);
+    }
+
+    void Call(uint32_t guest, PPCContext& __restrict ctx, uint8_t* base)
+    {
+        Resolve(guest)(ctx, base);
+    }
+
+    static PPCFunc* Decode(uint64_t entry)
+    {
+        return reinterpret_cast<PPCFunc*>(reinterpret_cast<intptr_t>(&IndirectCallAnchor) + static_cast<int32_t>(entry >> 32));
+    }
+
+private:
+    void Profile(uint32_t guest, bool hit);
+    PPCFunc* Miss(uint32_t guest);
+};
+
+namespace IndirectCallProfiler {
+
+    extern std::atomic<bool> g_enabled;
+
+    inline bool IsEnabled()
+    {
+        return g_enabled.load(std::memory_order_relaxed);
+    }
+
+    void SetEnabled(bool value);
+
+    // Logs the `maxEntries` busiest call sites with hit rate and target spread.
+    void Report(size_t maxEntries = 32);
+
+    // Every site that ran, with its tracked targets as sub_XXXXXXXX:count pairs.
+    bool WriteCsv(const char* path);
+
+    void Reset();
+
+    // Cached resolve vs. Memory::FindFunction on mono-, bi- and megamorphic patterns.
+    void RunBenchmark();
+
+} // namespace IndirectCallProfiler
+
+inline void IndirectCallSite::Profile(uint32_t guest, bool hit)
+{
+    if (!IndirectCallProfiler::IsEnabled()) [[likely]]
+        return;
+
+    (hit ? hits : misses).fetch_add(1, std::memory_order_relaxed);
+
+    for (auto& target : targets)
+    {
+        uint32_t current = target.guest.load(std::memory_order_relaxed);
+
+        if (current == 0 && target.guest.compare_exchange_strong(current, guest, std::memory_order_relaxed))
+            current = guest;
+
+        if (current == guest)
+        {
+            target.calls.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    otherCalls.fetch_add(1, std::memory_order_relaxed);
+}
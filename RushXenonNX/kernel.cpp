@@ -4,7 +4,15 @@
 #include "function.h"
 #include "ppc/ppc_recomp_shared.h"
 #include "nx/log/nxlogger.h"
+#include "NX/time/precise_sleep.h"
+#include "guest_thread.h"
+#include "kernel_time.h"
+#include "contention_profiler.h"
+#include "reservation.h"
+#include "sha1_engine.h"
+#include <algorithm>
 #include <atomic>
+#include <cstring>
 
 uint32_t KeGetCurrentProcessType()
 {
@@ -23,14 +31,20 @@ uint32_t RtlInitializeCriticalSection(XRTL_CRITICAL_SECTION* cs)
     return 0;
 }
 
-void RtlEnterCriticalSection(XRTL_CRITICAL_SECTION* cs)
+ContentionProfiler g_criticalSectionProfiler("critical section");
+
+// `caller` is the host return address into the recompiled caller, see the hook below.
+static void RtlEnterCriticalSection(XRTL_CRITICAL_SECTION* cs, const void* caller)
 {
     uint32_t thisThread = g_ppcContext->r13.u32;
-    // printf("RtlEnterCriticalSection %x %x %x %x\n", thisThread, cs->OwningThread, cs->LockCount, cs->RecursionCount);
     assert(thisThread != NULL);
 
     std::atomic_ref owningThread(cs->OwningThread);
 
+    const bool profiling = g_criticalSectionProfiler.IsEnabled();
+    uint64_t waitStart = 0;
+    const void* blocker = nullptr;
+
     while (true)
     {
         be<unsigned> previousOwner = 0;
@@ -38,15 +52,41 @@ void RtlEnterCriticalSection(XRTL_CRITICAL_SECTION* cs)
         if (owningThread.compare_exchange_weak(previousOwner, thisThread) || previousOwner == thisThread)
         {
             cs->RecursionCount = cs->RecursionCount.get() + 1;
+
+            if (profiling)
+            {
+                const uint32_t address = g_memory.MapVirtual(cs);
+
+                if (waitStart != 0)
+                    g_criticalSectionProfiler.RecordContended(address, armGetSystemTick() - waitStart, blocker);
+
+                g_criticalSectionProfiler.RecordAcquire(address, caller);
+            }
+
             return;
         }
 
-        // printf("wait start %x\n", cs);
+        if (profiling && waitStart == 0)
+        {
+            waitStart = armGetSystemTick();
+            blocker = g_criticalSectionProfiler.GetOwner(g_memory.MapVirtual(cs));
+        }
+
         owningThread.wait(previousOwner);
-        // printf("wait end\n");
     }
 }
 
+// Hooked by hand rather than through GUEST_FUNCTION_HOOK: recompiled code carries no
+// guest LR, so the host return address is what identifies the calling function.
+// Timed like a GUEST_FUNCTION_HOOK, it is the import most likely to show up in the latency report.
+static ImportLatency __imp__RtlEnterCriticalSection_latency{ "__imp__RtlEnterCriticalSection" };
+
+PPC_FUNC(__imp__RtlEnterCriticalSection)
+{
+    ImportTimer timer{ __imp__RtlEnterCriticalSection_latency };
+    RtlEnterCriticalSection(reinterpret_cast<XRTL_CRITICAL_SECTION*>(base + ctx.r3.u32), __builtin_return_address(0));
+}
+
 void RtlLeaveCriticalSection(XRTL_CRITICAL_SECTION* cs)
 {
     // printf("RtlLeaveCriticalSection");
@@ -60,6 +100,129 @@ void RtlLeaveCriticalSection(XRTL_CRITICAL_SECTION* cs)
     owningThread.notify_one();
 }
 
+uint32_t KeDelayExecutionThread(uint32_t waitMode, bool alertable, be<int64_t>* timeout)
+{
+    GuestThreadContext* threadContext = alertable ? GuestThreadContext::GetCurrent() : nullptr;
+    const std::atomic<bool>* alert = threadContext != nullptr ? &threadContext->alerted : nullptr;
+
+    if (alert != nullptr && threadContext->alerted.exchange(false))
+    {
+        threadContext->DeliverApcs();
+        return STATUS_USER_APC;
+    }
+
+    const int64_t interval = timeout != nullptr ? timeout->get() : 0;
+
+    // A zero interval is the guest's way of yielding the rest of its quantum.
+    if (timeout != nullptr && interval == 0)
+    {
+        PreciseSleep::Yield();
+        return STATUS_SUCCESS;
+    }
+
+    const uint64_t deadline = timeout != nullptr ? GuestTimeoutToDeadlineTicks(interval) : GUEST_TIMEOUT_INFINITE;
+
+    if (!PreciseSleep::SleepUntil(deadline, alert))
+    {
+        threadContext->alerted.store(false);
+        threadContext->DeliverApcs();
+        return STATUS_USER_APC;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+uint32_t NtYieldExecution()
+{
+    PreciseSleep::Yield();
+    return STATUS_SUCCESS;
+}
+
+// The SList header is one big-endian doubleword: Next << 32 | Depth << 16 | Sequence.
+// Updates go through the reservation table so a pop that raced with a pop and a push
+// of the same entry fails instead of linking a stale Next.
+static uint64_t PackSListHeader(uint32_t next, uint32_t depth, uint32_t sequence)
+{
+    return ((uint64_t)next << 32) | ((uint64_t)(depth & 0xFFFF) << 16) | (sequence & 0xFFFF);
+}
+
+uint32_t InterlockedPushEntrySList(XSLIST_HEADER* header, XSINGLE_LIST_ENTRY* entry)
+{
+    const uint32_t headerAddress = g_memory.MapVirtual(header);
+    const uint32_t entryAddress = g_memory.MapVirtual(entry);
+
+    while (true)
+    {
+        const auto reservation = GuestReservation::LoadReserved<uint64_t>(headerAddress);
+        const uint32_t first = (uint32_t)(reservation.value >> 32);
+        const uint32_t depth = (uint32_t)(reservation.value >> 16);
+        const uint32_t sequence = (uint32_t)reservation.value;
+
+        entry->Next = first;
+
+        if (GuestReservation::StoreConditional(reservation, PackSListHeader(entryAddress, depth + 1, sequence + 1)))
+            return first;
+    }
+}
+
+uint32_t InterlockedPopEntrySList(XSLIST_HEADER* header)
+{
+    const uint32_t headerAddress = g_memory.MapVirtual(header);
+
+    while (true)
+    {
+        const auto reservation = GuestReservation::LoadReserved<uint64_t>(headerAddress);
+        const uint32_t first = (uint32_t)(reservation.value >> 32);
+
+        if (first == 0)
+            return 0;
+
+        const uint32_t depth = (uint32_t)(reservation.value >> 16);
+        const uint32_t sequence = (uint32_t)reservation.value;
+        const uint32_t next = reinterpret_cast<XSINGLE_LIST_ENTRY*>(g_memory.base + first)->Next;
+
+        if (GuestReservation::StoreConditional(reservation, PackSListHeader(next, depth - 1, sequence)))
+            return first;
+    }
+}
+
+uint32_t InterlockedFlushSList(XSLIST_HEADER* header)
+{
+    const uint32_t headerAddress = g_memory.MapVirtual(header);
+
+    while (true)
+    {
+        const auto reservation = GuestReservation::LoadReserved<uint64_t>(headerAddress);
+        const uint32_t first = (uint32_t)(reservation.value >> 32);
+
+        if (first == 0)
+            return 0;
+
+        if (GuestReservation::StoreConditional(reservation, PackSListHeader(0, 0, (uint32_t)reservation.value)))
+            return first;
+    }
+}
+
+// SHA-1 over up to three buffers in sequence; any of them may be null. The digest is
+// truncated to `outputSize` bytes.
+void XeCryptSha(const void* input1, uint32_t input1Size, const void* input2, uint32_t input2Size,
+    const void* input3, uint32_t input3Size, uint8_t* output, uint32_t outputSize)
+{
+    Sha1::Context sha;
+
+    if (input1 != nullptr)
+        sha.Update(input1, input1Size);
+    if (input2 != nullptr)
+        sha.Update(input2, input2Size);
+    if (input3 != nullptr)
+        sha.Update(input3, input3Size);
+
+    uint8_t digest[Sha1::DigestSize];
+    sha.Final(digest);
+
+    if (output != nullptr)
+        memcpy(output, digest, std::min<uint32_t>(outputSize, Sha1::DigestSize));
+}
 
 GUEST_FUNCTION_STUB(__imp__XNotifyGetNext);//XNotifyGetNext);;
 GUEST_FUNCTION_STUB(__imp__XamMarketplaceAcquireFreeContent);//XamMarketplaceAcquireFreeContent);;
@@ -124,10 +287,6 @@ GUEST_FUNCTION_STUB(__imp__RtlInitializeCriticalSectionAndSpinCount);//RtlInitia
 GUEST_FUNCTION_STUB(__imp__RtlTryEnterCriticalSection);//RtlTryEnterCriticalSection);;
 GUEST_FUNCTION_STUB(__imp__KeBugCheck);//KeBugCheck);;
 GUEST_FUNCTION_STUB(__imp__RtlUnwind);//RtlUnwind);;
-GUEST_FUNCTION_STUB(__imp__KeTlsGetValue);//KeTlsGetValue);;
-GUEST_FUNCTION_STUB(__imp__KeTlsSetValue);//KeTlsSetValue);;
-GUEST_FUNCTION_STUB(__imp__KeTlsFree);//KeTlsFree);;
-GUEST_FUNCTION_STUB(__imp__KeTlsAlloc);//KeTlsAlloc);;
 GUEST_FUNCTION_STUB(__imp__NtQueryVirtualMemory);//NtQueryVirtualMemory);;
 GUEST_FUNCTION_STUB(__imp__MmQueryStatistics);//MmQueryStatistics);;
 GUEST_FUNCTION_STUB(__imp__NtClose);//NtClose);;
@@ -147,7 +306,6 @@ GUEST_FUNCTION_STUB(__imp__ObReferenceObjectByHandle);//ObReferenceObjectByHandl
 GUEST_FUNCTION_STUB(__imp__KeQueryBasePriorityThread);//KeQueryBasePriorityThread);;
 GUEST_FUNCTION_STUB(__imp__KeSetDisableBoostThread);//KeSetDisableBoostThread);;
 GUEST_FUNCTION_STUB(__imp__KeSetAffinityThread);//KeSetAffinityThread);;
-GUEST_FUNCTION_STUB(__imp__KeDelayExecutionThread);//KeDelayExecutionThread);;
 GUEST_FUNCTION_STUB(__imp__XexUnloadImage);//XexUnloadImage);;
 GUEST_FUNCTION_STUB(__imp__XexGetProcedureAddress);//XexGetProcedureAddress);;
 GUEST_FUNCTION_STUB(__imp__XexLoadImage);//XexLoadImage);;
@@ -166,7 +324,6 @@ GUEST_FUNCTION_STUB(__imp__StfsCreateDevice);//StfsCreateDevice);;
 GUEST_FUNCTION_STUB(__imp__NtQueryVolumeInformationFile);//NtQueryVolumeInformationFile);;
 GUEST_FUNCTION_STUB(__imp__RtlImageXexHeaderField);//RtlImageXexHeaderField);;
 GUEST_FUNCTION_STUB(__imp__XeKeysConsoleSignatureVerification);//XeKeysConsoleSignatureVerification);;
-GUEST_FUNCTION_STUB(__imp__XeCryptSha);//XeCryptSha);;
 GUEST_FUNCTION_STUB(__imp__NtWriteFile);//NtWriteFile);;
 GUEST_FUNCTION_STUB(__imp__NtReadFile);//NtReadFile);;
 GUEST_FUNCTION_STUB(__imp__XeKeysConsolePrivateKeySign);//XeKeysConsolePrivateKeySign);;
@@ -214,8 +371,6 @@ GUEST_FUNCTION_STUB(__imp__ExFreePool);//ExFreePool);;
 GUEST_FUNCTION_STUB(__imp__RtlCompareStringN);//RtlCompareStringN);;
 GUEST_FUNCTION_STUB(__imp__IoCompleteRequest);//IoCompleteRequest);;
 GUEST_FUNCTION_STUB(__imp__NtWriteFileGather);//NtWriteFileGather);;
-GUEST_FUNCTION_STUB(__imp__KfReleaseSpinLock);//KfReleaseSpinLock);;
-GUEST_FUNCTION_STUB(__imp__KfAcquireSpinLock);//KfAcquireSpinLock);;
 GUEST_FUNCTION_STUB(__imp__RtlUpcaseUnicodeChar);//RtlUpcaseUnicodeChar);;
 GUEST_FUNCTION_STUB(__imp__ObIsTitleObject);//ObIsTitleObject);;
 GUEST_FUNCTION_STUB(__imp__IoCheckShareAccess);//IoCheckShareAccess);;
@@ -241,9 +396,6 @@ GUEST_FUNCTION_STUB(__imp__XAudioGetDuckerReleaseTime);//XAudioGetDuckerReleaseT
 GUEST_FUNCTION_STUB(__imp__XAudioGetDuckerAttackTime);//XAudioGetDuckerAttackTime);;
 GUEST_FUNCTION_STUB(__imp__XAudioGetDuckerHoldTime);//XAudioGetDuckerHoldTime);;
 GUEST_FUNCTION_STUB(__imp__XAudioGetDuckerThreshold);//XAudioGetDuckerThreshold);;
-GUEST_FUNCTION_STUB(__imp__KeReleaseSpinLockFromRaisedIrql);//KeReleaseSpinLockFromRaisedIrql);;
-GUEST_FUNCTION_STUB(__imp__KeAcquireSpinLockAtRaisedIrql);//KeAcquireSpinLockAtRaisedIrql);;
-GUEST_FUNCTION_STUB(__imp__KeInsertQueueDpc);//KeInsertQueueDpc);;
 GUEST_FUNCTION_STUB(__imp__KiApcNormalRoutineNop);//KiApcNormalRoutineNop);;
 GUEST_FUNCTION_STUB(__imp__VdEnableRingBufferRPtrWriteBack);//VdEnableRingBufferRPtrWriteBack);;
 GUEST_FUNCTION_STUB(__imp__VdInitializeRingBuffer);//VdInitializeRingBuffer);;
@@ -264,9 +416,6 @@ GUEST_FUNCTION_STUB(__imp__VdShutdownEngines);//VdShutdownEngines);;
 GUEST_FUNCTION_STUB(__imp__VdSetGraphicsInterruptCallback);//VdSetGraphicsInterruptCallback);;
 GUEST_FUNCTION_STUB(__imp__VdInitializeEngines);//VdInitializeEngines);;
 GUEST_FUNCTION_STUB(__imp__VdIsHSIOTrainingSucceeded);//VdIsHSIOTrainingSucceeded);;
-GUEST_FUNCTION_STUB(__imp__KeLockL2);//KeLockL2);;
-GUEST_FUNCTION_STUB(__imp__KeUnlockL2);//KeUnlockL2);;
-GUEST_FUNCTION_STUB(__imp__KeInitializeDpc);//KeInitializeDpc);;
 GUEST_FUNCTION_STUB(__imp__VdQueryVideoFlags);//VdQueryVideoFlags);;
 GUEST_FUNCTION_STUB(__imp__VdInitializeScalerCommandBuffer);//VdInitializeScalerCommandBuffer);;
 GUEST_FUNCTION_STUB(__imp__VdRetrainEDRAM);//VdRetrainEDRAM);;
@@ -350,12 +499,13 @@ GUEST_FUNCTION_STUB(__imp__XamGetToken);//XamGetToken);;
 GUEST_FUNCTION_STUB(__imp__XampXAuthStartup);//XampXAuthStartup);;
 GUEST_FUNCTION_STUB(__imp__XampXAuthGetTitleBuffer);//XampXAuthGetTitleBuffer);;
 GUEST_FUNCTION_STUB(__imp__XampXAuthShutdown);//XampXAuthShutdown);;
-GUEST_FUNCTION_STUB(__imp__NtYieldExecution);//NtYieldExecution);;
-GUEST_FUNCTION_STUB(__imp__NtCancelTimer);//NtCancelTimer);;
-GUEST_FUNCTION_STUB(__imp__NtSetTimerEx);//NtSetTimerEx);;
-GUEST_FUNCTION_STUB(__imp__NtCreateTimer);//NtCreateTimer);
 
 GUEST_FUNCTION_HOOK(__imp__RtlLeaveCriticalSection,RtlLeaveCriticalSection);
 GUEST_FUNCTION_HOOK(__imp__RtlInitializeCriticalSection,RtlInitializeCriticalSection);
 GUEST_FUNCTION_HOOK(__imp__KeGetCurrentProcessType,KeGetCurrentProcessType);
-GUEST_FUNCTION_HOOK(__imp__RtlEnterCriticalSection,RtlEnterCriticalSection);;
\ No newline at end of file
+GUEST_FUNCTION_HOOK(__imp__KeDelayExecutionThread,KeDelayExecutionThread);
+GUEST_FUNCTION_HOOK(__imp__NtYieldExecution,NtYieldExecution);
+GUEST_FUNCTION_HOOK(__imp__InterlockedPushEntrySList,InterlockedPushEntrySList);
+GUEST_FUNCTION_HOOK(__imp__InterlockedPopEntrySList,InterlockedPopEntrySList);
+GUEST_FUNCTION_HOOK(__imp__InterlockedFlushSList,InterlockedFlushSList);
+GUEST_FUNCTION_HOOK(__imp__XeCryptSha,XeCryptSha);
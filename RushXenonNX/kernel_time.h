@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <switch.h>
+
+// Guest kernel times are 100ns intervals. Negative values are relative to now,
+// positive values are absolute system times counted from 1601-01-01.
+constexpr uint64_t GUEST_TIME_UNITS_PER_SECOND = 10'000'000;
+constexpr uint64_t GUEST_TIME_EPOCH_OFFSET = 11'644'473'600ull * GUEST_TIME_UNITS_PER_SECOND;
+constexpr uint64_t GUEST_TIMEOUT_INFINITE = UINT64_MAX;
+
+inline uint64_t GetGuestSystemTime()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return GUEST_TIME_EPOCH_OFFSET + uint64_t(ts.tv_sec) * GUEST_TIME_UNITS_PER_SECOND + uint64_t(ts.tv_nsec) / 100;
+}
+
+inline uint64_t GuestTimeToTicks(uint64_t guestTime)
+{
+    const uint64_t frequency = armGetSystemTickFreq();
+    const uint64_t seconds = guestTime / GUEST_TIME_UNITS_PER_SECOND;
+
+    if (seconds >= UINT64_MAX / frequency)
+        return GUEST_TIMEOUT_INFINITE;
+
+    return seconds * frequency + (guestTime % GUEST_TIME_UNITS_PER_SECOND) * frequency / GUEST_TIME_UNITS_PER_SECOND;
+}
+
+inline uint64_t AddTicksSaturated(uint64_t tick, uint64_t delta)
+{
+    return delta > GUEST_TIMEOUT_INFINITE - tick ? GUEST_TIMEOUT_INFINITE : tick + delta;
+}
+
+// Converts a guest timeout into an armGetSystemTick() deadline.
+inline uint64_t GuestTimeoutToDeadlineTicks(int64_t timeout)
+{
+    const uint64_t now = armGetSystemTick();
+
+    if (timeout < 0)
+        return AddTicksSaturated(now, GuestTimeToTicks(uint64_t(0) - uint64_t(timeout)));
+
+    const uint64_t systemTime = GetGuestSystemTime();
+    if (uint64_t(timeout) <= systemTime)
+        return now;
+
+    return AddTicksSaturated(now, GuestTimeToTicks(uint64_t(timeout) - systemTime));
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "guest_thread.h"
+#include "timer_wheel.h"
+#include "xdm.h"
+
+// All kernel timers share one timer wheel driven by a dedicated scheduler thread.
+// Callbacks run on that thread with the service lock held, so they must not block.
+namespace TimerService {
+
+    // `node->deadline` (system ticks) and `node->callback` must be set. Returns false
+    // when the scheduler thread could not be started, the node would never fire.
+    bool Schedule(TimerWheelNode* node);
+    void Cancel(TimerWheelNode* node);
+
+    void RunBenchmark();
+
+} // namespace TimerService
+
+// Timer objects behind NtCreateTimer/NtSetTimerEx. Expiry signals waiters and queues
+// the optional APC; NtSetTimerEx carries no DPC, and the KDPC-based KeSetTimer(Ex)
+// imports are not implemented, so DPC delivery is out of scope here.
+struct GuestTimer : KernelObject
+{
+    struct Node : TimerWheelNode
+    {
+        GuestTimer* timer;
+    };
+
+    Node node{};
+    CondVar condVar{};
+
+    // Notification timers stay signaled until re-armed, synchronization timers
+    // release a single waiter.
+    bool manualReset;
+    bool signaled = false;
+    uint64_t periodTicks = 0;
+
+    GuestApc apc{};
+    uint32_t apcThread = 0;
+
+    GuestTimer(bool manualReset);
+    ~GuestTimer() override;
+
+    // Returns false when the scheduler thread could not be started.
+    bool Set(uint64_t deadlineTicks, uint64_t periodTicks, const GuestApc& apc, uint32_t apcThread);
+    bool Cancel();
+
+    uint32_t Wait(uint32_t timeout) override;
+};
@@ -1,4 +1,6 @@
 #include <switch.h>
+#include <sys/stat.h>
+#include <atomic>
 #include <iostream>
 #include <cstring>
 #include <cstdint>
@@ -10,6 +12,22 @@
 #include "heap.h"
 #include "xdbf_wrapper.h"
 #include "image.h"
+#include "NX/time/precise_sleep.h"
+#include "spin_lock.h"
+#include "kernel_timer.h"
+#include "stub_registry.h"
+#include "import_profiler.h"
+#include "export_table.h"
+#include "indirect_call_cache.h"
+#include "guest_memops.h"
+#include "register_save.h"
+#include "guest_setjmp.h"
+#include "guest_fpscr.h"
+#include "reservation.h"
+#include "vmx_ops.h"
+#include "xex_loader.h"
+#include "aes_cbc.h"
+#include "sha1_engine.h"
 
 Memory g_memory;
 Heap g_userHeap;
@@ -19,41 +37,27 @@ XDBFWrapper g_xdbfWrapper;
 uint32_t LdrLoadModule() {
     SDLogger::Log("=== LdrLoadModule START ===");
 
-    std::vector<uint8_t> data;
-    SDLogger::Log("Vector data inicializado (size=%zu)", data.size());
+    // Se descomprime directamente en la memoria del invitado, sin copias intermedias.
+    // La imagen descomprimida se guarda en cache/ y los arranques siguientes la leen de ahí.
+    FSHelpers::CreateSubdir("sdmc:/RushXenonNX", "cache");
 
-    BinaryReader br;
-    SDLogger::Log("Creado BinaryReader");
-    SDLogger::Log("Intentando abrir archivo default_patched.xex...");
+    // Si hay actualización en update/, se aplica al cargar la XEX base; si no, se usa la
+    // default_patched.xex generada con XexPatcher.
+    constexpr const char* UpdatePath = "sdmc:/RushXenonNX/update/default.xexp";
+    struct stat updateInfo{};
+    const bool hasUpdate = stat(UpdatePath, &updateInfo) == 0;
+    const char* xexPath = hasUpdate ? "sdmc:/RushXenonNX/game/default.xex" : "sdmc:/RushXenonNX/game/default_patched.xex";
 
-    if (!br.Open("sdmc:/RushXenonNX/game/default_patched.xex")) {
-        SDLogger::Log("ERROR: No se pudo abrir default_patched.xex");
-        return 0;
-    }
-    SDLogger::Log("Archivo default_patched.xex abierto correctamente");
+    XexLoadStats stats;
+    const auto image = XexLoader::Load(xexPath, &stats, XexVerifyMode::Full, "sdmc:/RushXenonNX/cache/default.img",
+        hasUpdate ? UpdatePath : nullptr);
 
-    SDLogger::Log("Leyendo todos los datos del archivo...");
-    if (!br.ReadAll(data)) {
-        SDLogger::Log("ERROR leyendo el archivo completo");
-        br.Close();
+    if (image.size == 0) {
+        SDLogger::Log("ERROR: No se pudo cargar %s", xexPath);
         return 0;
     }
-    SDLogger::Log("Leído %zu bytes desde default_patched.xex", data.size());
-
-    // Cerrar archivo ya que no se usará más
-    br.Close();
-
-    // Verificar que hay datos
-    if (data.empty()) {
-        SDLogger::Log("ERROR: data está vacío, no se puede cargar módulo");
-        return 0;
-    }
-
-    SDLogger::Log("Parseando imagen...");
-    const auto image = Image::ParseImage(data.data(), data.size());
 
-    SDLogger::Log("Copiando imagen a memoria traducida...");
-    memcpy(g_memory.Translate(image.base), image.data.get(), image.size);
+    stats.Report();
 
     SDLogger::Log("Inicializando XDBFWrapper...");
     g_xdbfWrapper = XDBFWrapper(
@@ -65,6 +69,92 @@ uint32_t LdrLoadModule() {
     return image.entry_point;
 }
 
+static void DumpProfilerReports()
+{
+    if (g_spinLockProfiler.IsEnabled())
+        g_spinLockProfiler.Report();
+
+    if (g_criticalSectionProfiler.IsEnabled())
+        g_criticalSectionProfiler.Report();
+
+    if (ImportProfiler::IsEnabled())
+    {
+        ImportProfiler::Report();
+        ImportProfiler::WriteCsv("sdmc:/RushXenonNX/imports.csv");
+    }
+
+    if (IndirectCallProfiler::IsEnabled())
+    {
+        IndirectCallProfiler::Report();
+        IndirectCallProfiler::WriteCsv("sdmc:/RushXenonNX/indirect_calls.csv");
+    }
+
+    // Stub counters are always on, they cost a relaxed increment per call.
+    StubRegistry::Dump();
+    StubRegistry::WriteCsv("sdmc:/RushXenonNX/stubs.csv");
+}
+
+// GuestThread::Start runs the game on the main thread, so the profiler buttons are read
+// by a host thread of their own: Minus dumps the reports, ZR toggles import timing.
+constexpr size_t PROFILER_PAD_STACK_SIZE = 0x10000;
+constexpr uint64_t PROFILER_PAD_POLL_NS = 16'000'000;
+
+static Thread g_profilerPadThread;
+static std::atomic<bool> g_profilerPadStop{ false };
+
+static void ProfilerPadFunc(void*)
+{
+    PadState pad;
+    padInitializeDefault(&pad);
+
+    while (!g_profilerPadStop.load(std::memory_order_relaxed))
+    {
+        padUpdate(&pad);
+        const u64 kDown = padGetButtonsDown(&pad);
+
+        if (kDown & HidNpadButton_Minus)
+            DumpProfilerReports();
+
+        // Import timing can be switched on mid-session, the histograms restart empty.
+        if (kDown & HidNpadButton_ZR)
+        {
+            if (!ImportProfiler::IsEnabled())
+                ImportProfiler::Reset();
+
+            ImportProfiler::SetEnabled(!ImportProfiler::IsEnabled());
+        }
+
+        svcSleepThread(PROFILER_PAD_POLL_NS);
+    }
+}
+
+static bool StartProfilerPad()
+{
+    Result rc = threadCreate(&g_profilerPadThread, ProfilerPadFunc, nullptr, nullptr, PROFILER_PAD_STACK_SIZE, 0x2C, -2);
+
+    if (R_FAILED(rc))
+    {
+        SDLogger::Log("ProfilerPad - Failed to create thread: %u", rc);
+        return false;
+    }
+
+    if (R_FAILED(rc = threadStart(&g_profilerPadThread)))
+    {
+        SDLogger::Log("ProfilerPad - Failed to start thread: %u", rc);
+        threadClose(&g_profilerPadThread);
+        return false;
+    }
+
+    return true;
+}
+
+static void StopProfilerPad()
+{
+    g_profilerPadStop.store(true, std::memory_order_relaxed);
+    threadWaitForExit(&g_profilerPadThread);
+    threadClose(&g_profilerPadThread);
+}
+
 int main()
 {
     consoleInit(NULL);
@@ -82,12 +172,40 @@ int main()
     SDLogger::Log(buffer);
 
     g_userHeap.Init();
+    PreciseSleep::Calibrate();
+
+#ifdef RXN_BENCHMARKS
+    PreciseSleep::RunJitterBenchmark();
+    TimerService::RunBenchmark();
+    RunFunctionThunkBenchmark();
+    ExportTable::RunBenchmark();
+    IndirectCallProfiler::RunBenchmark();
+    FunctionTable::RunBenchmark();
+    GuestMemops::RunBenchmark();
+    RegisterSave::RunBenchmark();
+    GuestSetJmp::RunBenchmark();
+    GuestFpscr::RunBenchmark();
+    GuestReservation::RunBenchmark();
+    VmxOps::RunBenchmark();
+    XexBlockVerifier::RunBenchmark();
+    AesCbc::RunBenchmark();
+    Sha1::RunBenchmark();
+#endif
+
+#ifdef RXN_PROFILING
+    g_spinLockProfiler.SetEnabled(true);
+    g_criticalSectionProfiler.SetEnabled(true);
+    ImportProfiler::SetEnabled(true);
+    IndirectCallProfiler::SetEnabled(true);
+#endif
 
     padConfigureInput(1, HidNpadStyleSet_NpadStandard);
     PadState pad;
     padInitializeDefault(&pad);
     uint32_t entry = LdrLoadModule();
 
+    const bool profilerPad = StartProfilerPad();
+
     GuestThread::Start({ entry, 0, 0 });
     SDLogger::Log("Started game!");
 
@@ -102,5 +220,10 @@ int main()
 
         consoleUpdate(NULL);
     }
+
+    if (profilerPad)
+        StopProfilerPad();
+
+    DumpProfilerReports();
     return 0;
 }
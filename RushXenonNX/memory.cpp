@@ -1,6 +1,9 @@
 #include "Memory.h"
 #include <switch.h>
 #include "nx/log/nxlogger.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 Memory::Memory() {
     SDLogger::Log("Memory constructor called");
@@ -31,9 +34,37 @@ Memory::Memory() {
         }
     }
 
+    SDLogger::Log("FunctionTable - %zu pages, %zu KiB", g_functionTable.GetPageCount(), g_functionTable.GetFootprint() / 1024);
     SDLogger::Log("Memory initialization complete");
 }
 
+uint32_t Memory::FindGuestFunction(const void* hostCode) const
+{
+    // Host entry points sorted by address; the closest one at or below a code address
+    // is the function it belongs to.
+    static const auto functions = []
+        {
+            std::vector<std::pair<uintptr_t, uint32_t>> sorted;
+
+            for (size_t i = 0; PPCFuncMappings[i].guest != 0; i++)
+            {
+                if (PPCFuncMappings[i].host != nullptr)
+                    sorted.emplace_back((uintptr_t)PPCFuncMappings[i].host, PPCFuncMappings[i].guest);
+            }
+
+            std::sort(sorted.begin(), sorted.end());
+            return sorted;
+        }();
+
+    const uintptr_t address = (uintptr_t)hostCode;
+    auto it = std::upper_bound(functions.begin(), functions.end(), address, [](uintptr_t value, const auto& entry)
+        {
+            return value < entry.first;
+        });
+
+    return it == functions.begin() ? 0 : std::prev(it)->second;
+}
+
 void* MmGetHostAddress(uint32_t ptr) {
     void* addr = g_memory.Translate(ptr);
     SDLogger::Log(("Translating guest address " + std::to_string(ptr) +
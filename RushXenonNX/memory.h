@@ -1,7 +1,7 @@
 #pragma once
 #include <cassert>
 #include <cstring>
-#include <ppc_context.h>
+#include "function_table.h"
 #include <switch.h>
 
 #include "NX/log/nxlogger.h"
@@ -34,16 +34,24 @@ struct Memory {
         return static_cast<uint32_t>(static_cast<const uint8_t*>(host) - base);
     }
 
-    // Example function, modify according to actual need
     PPCFunc* FindFunction(uint32_t guest) const noexcept
     {
-        return PPC_LOOKUP_FUNC(base, guest);
+        return g_functionTable.Find(guest);
     }
 
+    // The legacy in-guest table is kept in sync for recompiled code that still uses it.
     void InsertFunction(uint32_t guest, PPCFunc* host)
     {
+        g_functionTable.Insert(guest, host);
+#ifndef RXN_COMPACT_FUNCTION_TABLE
         PPC_LOOKUP_FUNC(base, guest) = host;
+#endif
     }
+
+    // Maps a host code address (e.g. a return address) back to the guest address of
+    // the recompiled function containing it, 0 if it isn't recompiled code. The lookup
+    // table is built on first use, keep this off hot paths.
+    uint32_t FindGuestFunction(const void* hostCode) const;
 };
 
 extern "C" void* MmGetHostAddress(uint32_t ptr);
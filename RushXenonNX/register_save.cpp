@@ -0,0 +1,266 @@
+#include "register_save.h"
+#include "function.h"
+#include "heap.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <cstddef>
+#include <cstring>
+
+#ifndef PPC_CONFIG_NON_VOLATILE_AS_LOCAL
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+    // Guest stores are big-endian: 64-bit registers swap within each doubleword,
+    // vector registers reverse all 16 bytes.
+    inline void StoreSwapped64(uint8_t* destination, const PPCRegister* source, size_t count)
+    {
+        size_t i = 0;
+#if defined(__aarch64__)
+        for (; i + 2 <= count; i += 2)
+            vst1q_u8(destination + i * 8, vrev64q_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(source + i))));
+#endif
+        for (; i < count; i++)
+        {
+            const uint64_t value = __builtin_bswap64(source[i].u64);
+            memcpy(destination + i * 8, &value, sizeof(value));
+        }
+    }
+
+    inline void LoadSwapped64(PPCRegister* destination, const uint8_t* source, size_t count)
+    {
+        size_t i = 0;
+#if defined(__aarch64__)
+        for (; i + 2 <= count; i += 2)
+            vst1q_u8(reinterpret_cast<uint8_t*>(destination + i), vrev64q_u8(vld1q_u8(source + i * 8)));
+#endif
+        for (; i < count; i++)
+        {
+            uint64_t value;
+            memcpy(&value, source + i * 8, sizeof(value));
+            destination[i].u64 = __builtin_bswap64(value);
+        }
+    }
+
+    inline void CopyReversed128(uint8_t* destination, const uint8_t* source, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+#if defined(__aarch64__)
+            const uint8x16_t value = vrev64q_u8(vld1q_u8(source + i * 16));
+            vst1q_u8(destination + i * 16, vextq_u8(value, value, 8));
+#else
+            uint64_t halves[2];
+            memcpy(halves, source + i * 16, sizeof(halves));
+
+            const uint64_t swapped[2] = { __builtin_bswap64(halves[1]), __builtin_bswap64(halves[0]) };
+            memcpy(destination + i * 16, swapped, sizeof(swapped));
+#endif
+        }
+    }
+
+    // The register runs are walked as arrays, which relies on the fields being adjacent.
+    static_assert(offsetof(PPCContext, r31) - offsetof(PPCContext, r14) == 17 * sizeof(PPCRegister));
+    static_assert(offsetof(PPCContext, f31) - offsetof(PPCContext, f14) == 17 * sizeof(PPCRegister));
+    static_assert(offsetof(PPCContext, v31) - offsetof(PPCContext, v14) == 17 * sizeof(PPCVRegister));
+    static_assert(offsetof(PPCContext, v127) - offsetof(PPCContext, v64) == 63 * sizeof(PPCVRegister));
+
+    // std r14..r31 at r1 - 0x98.. r1 - 0x10, stw r12 (the caller's LR) at r1 - 8.
+    template<uint32_t First>
+    void SaveGprLr(PPCContext& ctx, uint8_t* base)
+    {
+        constexpr size_t Count = 32 - First;
+        StoreSwapped64(base + ctx.r1.u32 - 8 - Count * 8, &ctx.r14 + (First - 14), Count);
+        PPC_STORE_U32(ctx.r1.u32 - 8, ctx.r12.u32);
+    }
+
+    template<uint32_t First>
+    void RestGprLr(PPCContext& ctx, uint8_t* base)
+    {
+        constexpr size_t Count = 32 - First;
+        LoadSwapped64(&ctx.r14 + (First - 14), base + ctx.r1.u32 - 8 - Count * 8, Count);
+        ctx.r12.u64 = PPC_LOAD_U32(ctx.r1.u32 - 8);
+    }
+
+    // stfd f14..f31 at r12 - 0x90.. r12 - 8.
+    template<uint32_t First>
+    void SaveFpr(PPCContext& ctx, uint8_t* base)
+    {
+        constexpr size_t Count = 32 - First;
+        StoreSwapped64(base + ctx.r12.u32 - Count * 8, &ctx.f14 + (First - 14), Count);
+    }
+
+    template<uint32_t First>
+    void RestFpr(PPCContext& ctx, uint8_t* base)
+    {
+        constexpr size_t Count = 32 - First;
+        LoadSwapped64(&ctx.f14 + (First - 14), base + ctx.r12.u32 - Count * 8, Count);
+    }
+
+    template<uint32_t First>
+    PPCVRegister* VmxRun(PPCContext& ctx)
+    {
+        if constexpr (First >= 64)
+            return &ctx.v64 + (First - 64);
+        else
+            return &ctx.v14 + (First - 14);
+    }
+
+    // stvx vN, r11, r12 with r11 stepping from -16 * count to -16; r11 is left at -16.
+    template<uint32_t First, uint32_t End>
+    void SaveVmx(PPCContext& ctx, uint8_t* base)
+    {
+        constexpr size_t Count = End - First;
+        CopyReversed128(base + ((ctx.r12.u32 - Count * 16) & ~0xFu), VmxRun<First>(ctx)->u8, Count);
+        ctx.r11.s64 = -16;
+    }
+
+    template<uint32_t First, uint32_t End>
+    void RestVmx(PPCContext& ctx, uint8_t* base)
+    {
+        constexpr size_t Count = End - First;
+        CopyReversed128(VmxRun<First>(ctx)->u8, base + ((ctx.r12.u32 - Count * 16) & ~0xFu), Count);
+        ctx.r11.s64 = -16;
+    }
+
+} // namespace
+
+#define REGISTER_SAVE_ENTRY(symbol, helper) \
+    PPC_EXTERN_FUNC(__imp__##symbol); \
+    PPC_FUNC(symbol) { helper(ctx, base); }
+
+#define REGISTER_SAVE_14_31(X) \
+    X(14) X(15) X(16) X(17) X(18) X(19) X(20) X(21) X(22) \
+    X(23) X(24) X(25) X(26) X(27) X(28) X(29) X(30) X(31)
+
+#define REGISTER_SAVE_64_127(X) \
+    X(64) X(65) X(66) X(67) X(68) X(69) X(70) X(71) X(72) X(73) X(74) X(75) X(76) X(77) X(78) X(79) \
+    X(80) X(81) X(82) X(83) X(84) X(85) X(86) X(87) X(88) X(89) X(90) X(91) X(92) X(93) X(94) X(95) \
+    X(96) X(97) X(98) X(99) X(100) X(101) X(102) X(103) X(104) X(105) X(106) X(107) X(108) X(109) X(110) X(111) \
+    X(112) X(113) X(114) X(115) X(116) X(117) X(118) X(119) X(120) X(121) X(122) X(123) X(124) X(125) X(126) X(127)
+
+#define SAVE_GPR(N) REGISTER_SAVE_ENTRY(__savegprlr_##N, SaveGprLr<N>)
+#define REST_GPR(N) REGISTER_SAVE_ENTRY(__restgprlr_##N, RestGprLr<N>)
+#define SAVE_FPR(N) REGISTER_SAVE_ENTRY(__savefpr_##N, SaveFpr<N>)
+#define REST_FPR(N) REGISTER_SAVE_ENTRY(__restfpr_##N, RestFpr<N>)
+#define SAVE_VMX_14(N) REGISTER_SAVE_ENTRY(__savevmx_##N, (SaveVmx<N, 32>))
+#define REST_VMX_14(N) REGISTER_SAVE_ENTRY(__restvmx_##N, (RestVmx<N, 32>))
+#define SAVE_VMX_64(N) REGISTER_SAVE_ENTRY(__savevmx_##N, (SaveVmx<N, 128>))
+#define REST_VMX_64(N) REGISTER_SAVE_ENTRY(__restvmx_##N, (RestVmx<N, 128>))
+
+REGISTER_SAVE_14_31(SAVE_GPR)
+REGISTER_SAVE_14_31(REST_GPR)
+REGISTER_SAVE_14_31(SAVE_FPR)
+REGISTER_SAVE_14_31(REST_FPR)
+REGISTER_SAVE_14_31(SAVE_VMX_14)
+REGISTER_SAVE_14_31(REST_VMX_14)
+REGISTER_SAVE_64_127(SAVE_VMX_64)
+REGISTER_SAVE_64_127(REST_VMX_64)
+
+namespace {
+
+    struct HelperPair
+    {
+        const char* name;
+        PPCFunc* original;
+        PPCFunc* host;
+    };
+
+    // The full-width entry of each family; shorter entries run a suffix of the same code.
+    const HelperPair Helpers[] =
+    {
+        { "savegprlr_14", __imp____savegprlr_14, __savegprlr_14 },
+        { "restgprlr_14", __imp____restgprlr_14, __restgprlr_14 },
+        { "savefpr_14", __imp____savefpr_14, __savefpr_14 },
+        { "restfpr_14", __imp____restfpr_14, __restfpr_14 },
+        { "savevmx_14", __imp____savevmx_14, __savevmx_14 },
+        { "restvmx_14", __imp____restvmx_14, __restvmx_14 },
+        { "savevmx_64", __imp____savevmx_64, __savevmx_64 },
+        { "restvmx_64", __imp____restvmx_64, __restvmx_64 },
+        { "savegprlr_28", __imp____savegprlr_28, __savegprlr_28 },
+        { "restgprlr_28", __imp____restgprlr_28, __restgprlr_28 },
+    };
+
+    void FillContext(PPCContext& ctx, uint32_t seed)
+    {
+        auto* bytes = reinterpret_cast<uint8_t*>(&ctx);
+        for (size_t i = 0; i < sizeof(ctx); i++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            bytes[i] = static_cast<uint8_t>(seed >> 24);
+        }
+    }
+
+} // namespace
+
+void RegisterSave::RunBenchmark()
+{
+    constexpr size_t Iterations = 1'000'000;
+    constexpr size_t FrameSize = 0x1000;
+
+    // r1 sits in the middle of the frame and r12 just below it, like the prologues set
+    // it up; both runs start from the same frame contents and the same context.
+    uint8_t* frame = (uint8_t*)g_userHeap.Alloc(FrameSize);
+    uint8_t* snapshot = new uint8_t[FrameSize];
+
+    auto resetFrame = [&]
+        {
+            for (size_t i = 0; i < FrameSize; i++)
+                frame[i] = static_cast<uint8_t>(i * 131 + 7);
+        };
+
+    for (const auto& helper : Helpers)
+    {
+        PPCContext expected;
+        FillContext(expected, 0x1234);
+        expected.r1.u64 = g_memory.MapVirtual(frame + FrameSize / 2);
+        expected.r12.u64 = expected.r1.u32 - 0x100;
+
+        PPCContext actual = expected;
+
+        resetFrame();
+        helper.original(expected, g_memory.base);
+        memcpy(snapshot, frame, FrameSize);
+
+        resetFrame();
+        helper.host(actual, g_memory.base);
+
+        if (memcmp(snapshot, frame, FrameSize) != 0 || memcmp(&expected, &actual, sizeof(actual)) != 0)
+        {
+            SDLogger::Log("RegisterSave - %s differs from the recompiled helper", helper.name);
+            continue;
+        }
+
+        auto measure = [&](PPCFunc* function)
+            {
+                PPCContext ctx = expected;
+                const uint64_t start = armGetSystemTick();
+
+                for (size_t i = 0; i < Iterations; i++)
+                    function(ctx, g_memory.base);
+
+                return armTicksToNs(armGetSystemTick() - start);
+            };
+
+        const uint64_t originalNs = measure(helper.original);
+        const uint64_t hostNs = measure(helper.host);
+
+        SDLogger::Log("RegisterSave bench - %-13s recompiled %5llu ps/call, host %5llu ps/call", helper.name,
+            (unsigned long long)(originalNs * 1000 / Iterations), (unsigned long long)(hostNs * 1000 / Iterations));
+    }
+
+    delete[] snapshot;
+    g_userHeap.Free(frame);
+}
+
+#else
+
+void RegisterSave::RunBenchmark()
+{
+    SDLogger::Log("RegisterSave - non_volatile_as_local is on, the recompiler elides save/restore helper calls");
+}
+
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+
+// Host versions of the compiler's register save/restore helpers (__savegprlr_N,
+// __restgprlr_N, __savefpr_N, __restfpr_N, __savevmx_N, __restvmx_N) at the
+// addresses RXN.toml gives XenonRecomp. Each family is one routine with an entry
+// point per first register; the host side stores or loads the whole run of registers
+// with a single byte-swap pass.
+//
+// With non_volatile_as_local (the current RXN.toml) the recompiler drops every call to
+// these helpers and the registers they touch aren't part of PPCContext, so this only
+// compiles when that option is off.
+namespace RegisterSave {
+
+    // Checks each helper against its recompiled body and logs the per-call cost of both.
+    void RunBenchmark();
+
+} // namespace RegisterSave
@@ -0,0 +1,174 @@
+#include "reservation.h"
+#include "heap.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <algorithm>
+
+GuestReservation::Slot GuestReservation::g_slots[SlotCount];
+
+namespace {
+
+    constexpr size_t IncrementsPerThread = 200'000;
+    constexpr size_t MaxThreads = 4;
+
+    // Granules searched for private words with pairwise different slots.
+    constexpr size_t CandidateGranules = 16;
+
+    enum class IncrementMode
+    {
+        Reservation,
+        GlobalLock
+    };
+
+    struct IncrementJob
+    {
+        IncrementMode mode;
+        uint32_t address;
+        std::atomic<bool>* start;
+    };
+
+    Mutex g_globalLock;
+
+    void IncrementWorker(void* argument)
+    {
+        const auto* job = static_cast<const IncrementJob*>(argument);
+
+        while (!job->start->load(std::memory_order_acquire))
+        {
+        }
+
+        for (size_t i = 0; i < IncrementsPerThread; i++)
+        {
+            if (job->mode == IncrementMode::Reservation)
+            {
+                GuestReservation::Reservation<uint32_t> reservation;
+                do
+                {
+                    reservation = GuestReservation::LoadReserved<uint32_t>(job->address);
+                } while (!GuestReservation::StoreConditional(reservation, reservation.value + 1));
+            }
+            else
+            {
+                mutexLock(&g_globalLock);
+                auto* word = reinterpret_cast<be<uint32_t>*>(g_memory.base + job->address);
+                *word = *word + 1;
+                mutexUnlock(&g_globalLock);
+            }
+        }
+    }
+
+    // Slots are picked by hashing the granule, so words in different granules can still
+    // share a slot and contend. Private words are taken from granules whose slots differ.
+    bool PickPrivateWords(uint8_t* region, uint8_t* (&words)[MaxThreads])
+    {
+        auto slotOf = [](uint8_t* word) { return &GuestReservation::SlotOf(g_memory.MapVirtual(word)); };
+
+        size_t picked = 0;
+        for (size_t i = 0; i < CandidateGranules && picked < MaxThreads; i++)
+        {
+            uint8_t* candidate = region + (i << GuestReservation::GranuleShift);
+
+            if (std::none_of(words, words + picked, [&](uint8_t* word) { return slotOf(word) == slotOf(candidate); }))
+                words[picked++] = candidate;
+        }
+
+        return picked == MaxThreads;
+    }
+
+    // Returns the elapsed ns, or 0 if an increment was lost. `words` holds one private
+    // word per thread; shared runs all use the first.
+    uint64_t RunIncrements(IncrementMode mode, size_t threadCount, bool shared, uint8_t* const* words)
+    {
+        constexpr size_t StackSize = 0x4000;
+
+        std::atomic<bool> start{ false };
+        Thread threads[MaxThreads];
+        IncrementJob jobs[MaxThreads];
+
+        auto wordOf = [&](size_t thread) { return words[shared ? 0 : thread]; };
+
+        // Workers already running spin on `start`, so a failed launch still has to release
+        // them and wait before returning.
+        auto joinStarted = [&](size_t started)
+            {
+                start.store(true, std::memory_order_release);
+
+                for (size_t i = 0; i < started; i++)
+                {
+                    threadWaitForExit(&threads[i]);
+                    threadClose(&threads[i]);
+                }
+            };
+
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            *reinterpret_cast<be<uint32_t>*>(wordOf(i)) = 0;
+            jobs[i] = { mode, g_memory.MapVirtual(wordOf(i)), &start };
+
+            // Spread over the application's three cores; the default core would serialise them.
+            if (R_FAILED(threadCreate(&threads[i], IncrementWorker, &jobs[i], nullptr, StackSize, 0x2C, int(i % 3))))
+            {
+                SDLogger::Log("GuestReservation bench - failed to create thread %zu", i);
+                joinStarted(i);
+                return 0;
+            }
+
+            if (R_FAILED(threadStart(&threads[i])))
+            {
+                SDLogger::Log("GuestReservation bench - failed to start thread %zu", i);
+                threadClose(&threads[i]);
+                joinStarted(i);
+                return 0;
+            }
+        }
+
+        const uint64_t begin = armGetSystemTick();
+        joinStarted(threadCount);
+
+        const uint64_t ns = armTicksToNs(armGetSystemTick() - begin);
+
+        uint64_t total = 0;
+        for (size_t i = 0; i < (shared ? 1 : threadCount); i++)
+            total += *reinterpret_cast<be<uint32_t>*>(wordOf(i));
+
+        return total == threadCount * IncrementsPerThread ? std::max<uint64_t>(ns, 1) : 0;
+    }
+
+} // namespace
+
+void GuestReservation::RunBenchmark()
+{
+    mutexInit(&g_globalLock);
+
+    uint8_t* region = (uint8_t*)g_userHeap.Alloc(CandidateGranules << GranuleShift);
+
+    uint8_t* words[MaxThreads]{};
+    if (!PickPrivateWords(region, words))
+    {
+        SDLogger::Log("GuestReservation bench - no %zu granules with distinct slots", MaxThreads);
+        g_userHeap.Free(region);
+        return;
+    }
+
+    for (int shared = 1; shared >= 0; shared--)
+    {
+        for (size_t threadCount = 1; threadCount <= MaxThreads; threadCount++)
+        {
+            const uint64_t reservationNs = RunIncrements(IncrementMode::Reservation, threadCount, shared, words);
+            const uint64_t lockNs = RunIncrements(IncrementMode::GlobalLock, threadCount, shared, words);
+
+            if (reservationNs == 0 || lockNs == 0)
+            {
+                SDLogger::Log("GuestReservation bench - lost increments with %zu threads (%s)", threadCount,
+                    reservationNs == 0 ? "reservation" : "global lock");
+                continue;
+            }
+
+            const double increments = double(threadCount * IncrementsPerThread);
+            SDLogger::Log("GuestReservation bench - %-7s word, %zu threads: reservation %6.2f Mops/s, global lock %6.2f Mops/s",
+                shared ? "shared" : "private", threadCount, increments * 1000.0 / reservationNs, increments * 1000.0 / lockNs);
+        }
+    }
+
+    g_userHeap.Free(region);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "memory.h"
+#include "xbox.h"
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// Load-reserved/store-conditional on guest words for host code implementing guest
+// atomics. With reserved_as_local XenonRecomp lowers lwarx/stwcx. to a load and a
+// compare-and-swap against the loaded value: atomic, but blind to a word that went
+// A -> B -> A in between. Here every 128-byte reservation granule (the Xenon cache
+// line) hashes to a versioned slot; a store-conditional first claims the version seen
+// by its load-reserved, so any other store-conditional to that granule in between
+// makes it fail even if the value looks unchanged. Stores that bypass the table
+// (recompiled guest code) are still caught by the value compare.
+namespace GuestReservation {
+
+    constexpr uint32_t GranuleShift = 7;
+    constexpr size_t SlotCount = 1024;
+
+    struct alignas(64) Slot
+    {
+        // Odd while a store-conditional is writing the granule.
+        std::atomic<uint32_t> version;
+    };
+
+    extern Slot g_slots[SlotCount];
+
+    template<typename T>
+    struct Reservation
+    {
+        uint32_t address;
+        uint32_t version;
+        T value;
+    };
+
+    inline Slot& SlotOf(uint32_t address)
+    {
+        return g_slots[((address >> GranuleShift) * 0x9E3779B1u) >> (32 - std::bit_width(SlotCount - 1))];
+    }
+
+    // Returns the word in host byte order.
+    template<typename T>
+    Reservation<T> LoadReserved(uint32_t address)
+    {
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8);
+
+        Slot& slot = SlotOf(address);
+        uint32_t version = slot.version.load(std::memory_order_acquire);
+
+        while (version & 1) [[unlikely]]
+            version = slot.version.load(std::memory_order_acquire);
+
+        const T value = std::atomic_ref<T>(*reinterpret_cast<T*>(g_memory.base + address)).load(std::memory_order_acquire);
+        return { address, version, ByteSwap(value) };
+    }
+
+    template<typename T>
+    bool StoreConditional(const Reservation<T>& reservation, T value)
+    {
+        Slot& slot = SlotOf(reservation.address);
+        uint32_t version = reservation.version;
+
+        if (!slot.version.compare_exchange_strong(version, version + 1, std::memory_order_acquire, std::memory_order_relaxed))
+            return false;
+
+        T expected = ByteSwap(reservation.value);
+        const bool stored = std::atomic_ref<T>(*reinterpret_cast<T*>(g_memory.base + reservation.address))
+            .compare_exchange_strong(expected, ByteSwap(value), std::memory_order_acq_rel, std::memory_order_relaxed);
+
+        slot.version.store(version + 2, std::memory_order_release);
+        return stored;
+    }
+
+    // Multi-threaded increments on one shared word and on one word per thread,
+    // against a single global mutex around plain loads and stores.
+    void RunBenchmark();
+
+} // namespace GuestReservation
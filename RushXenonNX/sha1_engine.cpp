@@ -0,0 +1,499 @@
+#include "sha1_engine.h"
+#include "TinySHA1.hpp"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SHA1_NEON 1
+#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+#define SHA1_ARMV8 1
+#endif
+#endif
+
+using namespace Sha1;
+
+namespace {
+
+    using CompressFunction = void (*)(uint32_t* state, const uint8_t* blocks, size_t count);
+
+    constexpr uint32_t InitialState[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    constexpr uint32_t RoundConstants[4] = { 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+
+    inline uint32_t Rotate(uint32_t value, int shift)
+    {
+        return (value << shift) | (value >> (32 - shift));
+    }
+
+    inline uint32_t LoadBigEndian(const uint8_t* bytes)
+    {
+        return uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 | uint32_t(bytes[2]) << 8 | bytes[3];
+    }
+
+    // The 80 rounds over a message schedule that already has the round constants added.
+    void RunRounds(uint32_t* state, const uint32_t* wk)
+    {
+        uint32_t a = state[0];
+        uint32_t b = state[1];
+        uint32_t c = state[2];
+        uint32_t d = state[3];
+        uint32_t e = state[4];
+
+        auto round = [&](uint32_t f, uint32_t w)
+            {
+                const uint32_t temp = Rotate(a, 5) + f + e + w;
+                e = d;
+                d = c;
+                c = Rotate(b, 30);
+                b = a;
+                a = temp;
+            };
+
+        for (int i = 0; i < 20; i++)
+            round(d ^ (b & (c ^ d)), wk[i]);
+        for (int i = 20; i < 40; i++)
+            round(b ^ c ^ d, wk[i]);
+        for (int i = 40; i < 60; i++)
+            round((b & c) | (d & (b | c)), wk[i]);
+        for (int i = 60; i < 80; i++)
+            round(b ^ c ^ d, wk[i]);
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+
+    void CompressScalar(uint32_t* state, const uint8_t* blocks, size_t count)
+    {
+        uint32_t w[80];
+
+        for (; count != 0; count--, blocks += BlockSize)
+        {
+            for (int i = 0; i < 16; i++)
+                w[i] = LoadBigEndian(blocks + 4 * i);
+            for (int i = 16; i < 80; i++)
+                w[i] = Rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+            for (int i = 0; i < 80; i++)
+                w[i] += RoundConstants[i / 20];
+
+            RunRounds(state, w);
+        }
+    }
+
+#ifdef SHA1_NEON
+    inline uint32x4_t RotateLeft1(uint32x4_t value)
+    {
+        return vorrq_u32(vshlq_n_u32(value, 1), vshrq_n_u32(value, 31));
+    }
+
+    void CompressNeon(uint32_t* state, const uint8_t* blocks, size_t count)
+    {
+        alignas(16) uint32_t wk[80];
+        const uint32x4_t zero = vdupq_n_u32(0);
+
+        for (; count != 0; count--, blocks += BlockSize)
+        {
+            uint32x4_t w[20];
+            for (int g = 0; g < 4; g++)
+                w[g] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 16 * g)));
+
+            // W[t..t+3] from W[t-16..t-1]. The last lane also depends on W[t], which only
+            // exists once the first lane is done, so it is patched in afterwards.
+            for (int g = 4; g < 20; g++)
+            {
+                const uint32x4_t x = veorq_u32(veorq_u32(w[g - 4], vextq_u32(w[g - 4], w[g - 3], 2)),
+                    veorq_u32(w[g - 2], vextq_u32(w[g - 1], zero, 1)));
+                const uint32x4_t r = RotateLeft1(x);
+                w[g] = veorq_u32(r, RotateLeft1(vextq_u32(zero, r, 1)));
+            }
+
+            for (int g = 0; g < 20; g++)
+                vst1q_u32(wk + 4 * g, vaddq_u32(w[g], vdupq_n_u32(RoundConstants[g / 5])));
+
+            RunRounds(state, wk);
+        }
+    }
+#endif
+
+#ifdef SHA1_ARMV8
+    void CompressArmCrypto(uint32_t* state, const uint8_t* blocks, size_t count)
+    {
+        uint32x4_t abcd = vld1q_u32(state);
+        uint32_t e = state[4];
+
+        for (; count != 0; count--, blocks += BlockSize)
+        {
+            const uint32x4_t abcdSaved = abcd;
+            const uint32_t eSaved = e;
+
+            uint32x4_t w[4];
+            for (int g = 0; g < 4; g++)
+                w[g] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 16 * g)));
+
+            // Twenty groups of four rounds; from the fifth on, each group's words replace
+            // the ones from four groups back.
+#pragma GCC unroll 20
+            for (int g = 0; g < 20; g++)
+            {
+                if (g >= 4)
+                    w[g % 4] = vsha1su1q_u32(vsha1su0q_u32(w[g % 4], w[(g + 1) % 4], w[(g + 2) % 4]), w[(g + 3) % 4]);
+
+                const uint32x4_t wk = vaddq_u32(w[g % 4], vdupq_n_u32(RoundConstants[g / 5]));
+                const uint32_t nextE = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+
+                if (g < 5)
+                    abcd = vsha1cq_u32(abcd, e, wk);
+                else if (g < 10 || g >= 15)
+                    abcd = vsha1pq_u32(abcd, e, wk);
+                else
+                    abcd = vsha1mq_u32(abcd, e, wk);
+
+                e = nextE;
+            }
+
+            abcd = vaddq_u32(abcd, abcdSaved);
+            e += eSaved;
+        }
+
+        vst1q_u32(state, abcd);
+        state[4] = e;
+    }
+#endif
+
+    CompressFunction GetCompressFunction(Backend backend)
+    {
+        switch (backend)
+        {
+#ifdef SHA1_ARMV8
+        case Backend::ArmCrypto:
+            return CompressArmCrypto;
+#endif
+#ifdef SHA1_NEON
+        case Backend::Neon:
+            return CompressNeon;
+#endif
+        default:
+            return CompressScalar;
+        }
+    }
+
+    struct KnownAnswer
+    {
+        const char* message;
+        size_t repeat;
+        uint8_t digest[DigestSize];
+    };
+
+    const KnownAnswer KnownAnswers[] = {
+        { "", 1, { 0xDA, 0x39, 0xA3, 0xEE, 0x5E, 0x6B, 0x4B, 0x0D, 0x32, 0x55, 0xBF, 0xEF, 0x95, 0x60, 0x18, 0x90, 0xAF, 0xD8, 0x07, 0x09 } },
+        { "abc", 1, { 0xA9, 0x99, 0x3E, 0x36, 0x47, 0x06, 0x81, 0x6A, 0xBA, 0x3E, 0x25, 0x71, 0x78, 0x50, 0xC2, 0x6C, 0x9C, 0xD0, 0xD8, 0x9D } },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+            { 0x84, 0x98, 0x3E, 0x44, 0x1C, 0x3B, 0xD2, 0x6E, 0xBA, 0xAE, 0x4A, 0xA1, 0xF9, 0x51, 0x29, 0xE5, 0xE5, 0x46, 0x70, 0xF1 } },
+        { "a", 1'000'000, { 0x34, 0xAA, 0x97, 0x3C, 0xD4, 0xC4, 0xDA, 0xA4, 0xF6, 0x1E, 0xEB, 0x2B, 0xDB, 0xAD, 0x27, 0x31, 0x65, 0x34, 0x01, 0x6F } },
+        { "0123456701234567012345670123456701234567012345670123456701234567", 10,
+            { 0xDE, 0xA3, 0x56, 0xA2, 0xCD, 0xDD, 0x90, 0xC7, 0xA7, 0xEC, 0xED, 0xC5, 0xEB, 0xB5, 0x63, 0x93, 0x4F, 0x46, 0x04, 0x52 } },
+    };
+
+    bool PassesKnownAnswers(Backend backend)
+    {
+        for (const KnownAnswer& vector : KnownAnswers)
+        {
+            const size_t size = strlen(vector.message);
+
+            Context sha(backend);
+            for (size_t i = 0; i < vector.repeat; i++)
+                sha.Update(vector.message, size);
+
+            uint8_t digest[DigestSize];
+            sha.Final(digest);
+
+            if (memcmp(digest, vector.digest, DigestSize) != 0)
+            {
+                SDLogger::Log("Sha1 - %s backend fails the vector \"%.16s\" x%zu", GetBackendName(backend), vector.message, vector.repeat);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    Backend SelectBackend()
+    {
+        for (Backend backend : { Backend::ArmCrypto, Backend::Neon })
+        {
+            if (IsAvailable(backend) && PassesKnownAnswers(backend))
+            {
+                SDLogger::Log("Sha1 - using the %s backend", GetBackendName(backend));
+                return backend;
+            }
+        }
+
+        return Backend::Scalar;
+    }
+
+    Backend& SelectedBackend()
+    {
+        static Backend backend = SelectBackend();
+        return backend;
+    }
+
+} // namespace
+
+Sha1::Context::Context(Backend backend)
+    : compress(GetCompressFunction(IsAvailable(backend) ? backend : Backend::Scalar))
+{
+    Reset();
+}
+
+void Sha1::Context::Reset()
+{
+    memcpy(state, InitialState, sizeof(state));
+    buffered = 0;
+    length = 0;
+}
+
+void Sha1::Context::Update(const void* data, size_t size)
+{
+    auto* bytes = static_cast<const uint8_t*>(data);
+    length += size;
+
+    if (buffered != 0)
+    {
+        const size_t copy = std::min(size, BlockSize - buffered);
+        memcpy(buffer + buffered, bytes, copy);
+        buffered += copy;
+        bytes += copy;
+        size -= copy;
+
+        if (buffered < BlockSize)
+            return;
+
+        compress(state, buffer, 1);
+        buffered = 0;
+    }
+
+    // Whole blocks are hashed where they are.
+    const size_t blocks = size / BlockSize;
+    if (blocks != 0)
+    {
+        compress(state, bytes, blocks);
+        bytes += blocks * BlockSize;
+        size -= blocks * BlockSize;
+    }
+
+    memcpy(buffer, bytes, size);
+    buffered = size;
+}
+
+void Sha1::Context::Final(uint8_t* digest)
+{
+    const uint64_t bits = length * 8;
+
+    buffer[buffered++] = 0x80;
+    if (buffered > BlockSize - 8)
+    {
+        memset(buffer + buffered, 0, BlockSize - buffered);
+        compress(state, buffer, 1);
+        buffered = 0;
+    }
+
+    memset(buffer + buffered, 0, BlockSize - 8 - buffered);
+    for (int i = 0; i < 8; i++)
+        buffer[BlockSize - 8 + i] = uint8_t(bits >> (56 - 8 * i));
+
+    compress(state, buffer, 1);
+
+    for (int i = 0; i < 5; i++)
+    {
+        digest[4 * i] = uint8_t(state[i] >> 24);
+        digest[4 * i + 1] = uint8_t(state[i] >> 16);
+        digest[4 * i + 2] = uint8_t(state[i] >> 8);
+        digest[4 * i + 3] = uint8_t(state[i]);
+    }
+}
+
+void Sha1::Hash(const void* data, size_t size, uint8_t* digest)
+{
+    Context sha;
+    sha.Update(data, size);
+    sha.Final(digest);
+}
+
+Backend Sha1::GetBackend()
+{
+    return SelectedBackend();
+}
+
+bool Sha1::SetBackend(Backend backend)
+{
+    if (!IsAvailable(backend))
+        return false;
+
+    SelectedBackend() = backend;
+    return true;
+}
+
+bool Sha1::IsAvailable(Backend backend)
+{
+    switch (backend)
+    {
+    case Backend::Scalar:
+        return true;
+    case Backend::Neon:
+#ifdef SHA1_NEON
+        return true;
+#else
+        return false;
+#endif
+    case Backend::ArmCrypto:
+#ifdef SHA1_ARMV8
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    return false;
+}
+
+const char* Sha1::GetBackendName(Backend backend)
+{
+    switch (backend)
+    {
+    case Backend::Scalar:
+        return "scalar";
+    case Backend::Neon:
+        return "NEON schedule";
+    case Backend::ArmCrypto:
+        return "ARMv8 SHA1";
+    }
+
+    return "unknown";
+}
+
+bool Sha1::RunSelfTest()
+{
+    bool passed = true;
+
+    for (Backend backend : { Backend::Scalar, Backend::Neon, Backend::ArmCrypto })
+    {
+        if (IsAvailable(backend))
+            passed &= PassesKnownAnswers(backend);
+    }
+
+    // Random messages against TinySHA1, fed in random pieces so every buffering path is taken.
+    std::mt19937 rng{ 0x53484131 };
+    std::vector<uint8_t> message(0x4000);
+
+    for (int iteration = 0; iteration < 200 && passed; iteration++)
+    {
+        const size_t size = iteration < 160 ? iteration : rng() % message.size();
+        for (size_t i = 0; i < size; i++)
+            message[i] = uint8_t(rng());
+
+        uint8_t expected[DigestSize];
+        sha1::SHA1 reference;
+        reference.processBytes(message.data(), size);
+        reference.finalize(expected);
+
+        for (Backend backend : { Backend::Scalar, Backend::Neon, Backend::ArmCrypto })
+        {
+            if (!IsAvailable(backend))
+                continue;
+
+            Context sha(backend);
+            for (size_t offset = 0; offset < size;)
+            {
+                const size_t piece = std::min(size - offset, size_t(rng() % 150));
+                sha.Update(message.data() + offset, piece);
+                offset += piece;
+            }
+
+            uint8_t actual[DigestSize];
+            sha.Final(actual);
+
+            if (memcmp(actual, expected, DigestSize) != 0)
+            {
+                SDLogger::Log("Sha1 - %s backend differs from TinySHA1 on a %zu byte message", GetBackendName(backend), size);
+                passed = false;
+            }
+        }
+    }
+
+    SDLogger::Log("Sha1 self-test: %s", passed ? "all backends match" : "FAILED");
+    return passed;
+}
+
+void Sha1::RunBenchmark()
+{
+    // A retail image's worth of compressed blocks, and the short buffers games tend to
+    // pass to XeCryptSha.
+    constexpr size_t LargeSize = 0x10000;
+    constexpr size_t LargeCount = 64;
+    constexpr size_t SmallSize = 64;
+    constexpr size_t SmallCount = 100'000;
+
+    if (!RunSelfTest())
+        return;
+
+    auto data = std::make_unique<uint8_t[]>(LargeSize * LargeCount);
+    std::mt19937 rng{ 0x58435348 };
+    for (size_t i = 0; i < LargeSize * LargeCount; i++)
+        data[i] = uint8_t(rng());
+
+    volatile uint8_t sink = 0;
+
+    auto measure = [&](auto&& hash, size_t size, size_t count)
+        {
+            uint8_t digest[DigestSize];
+            const uint64_t start = armGetSystemTick();
+
+            for (size_t i = 0; i < count; i++)
+            {
+                hash(data.get() + (i % LargeCount) * LargeSize, size, digest);
+                sink = sink + digest[0];
+            }
+
+            const uint64_t ns = armTicksToNs(armGetSystemTick() - start);
+            return ns != 0 ? double(size) * count / (1024.0 * 1024.0) * 1e9 / double(ns) : 0.0;
+        };
+
+    auto tiny = [](const uint8_t* message, size_t size, uint8_t* digest)
+        {
+            sha1::SHA1 sha;
+            sha.processBytes(message, size);
+            sha.finalize(digest);
+        };
+
+    SDLogger::Log("Sha1::RunBenchmark - selected backend: %s", GetBackendName(GetBackend()));
+    SDLogger::Log("%-14s %14s %8s %14s %8s", "backend", "64 KiB MB/s", "speedup", "64 B MB/s", "speedup");
+
+    const double tinyLarge = measure(tiny, LargeSize, LargeCount);
+    const double tinySmall = measure(tiny, SmallSize, SmallCount);
+    SDLogger::Log("%-14s %14.1f %7.2fx %14.1f %7.2fx", "TinySHA1", tinyLarge, 1.0, tinySmall, 1.0);
+
+    for (Backend backend : { Backend::Scalar, Backend::Neon, Backend::ArmCrypto })
+    {
+        if (!IsAvailable(backend))
+            continue;
+
+        auto engine = [backend](const uint8_t* message, size_t size, uint8_t* digest)
+            {
+                Context sha(backend);
+                sha.Update(message, size);
+                sha.Final(digest);
+            };
+
+        const double large = measure(engine, LargeSize, LargeCount);
+        const double small = measure(engine, SmallSize, SmallCount);
+        SDLogger::Log("%-14s %14.1f %7.2fx %14.1f %7.2fx", GetBackendName(backend), large,
+            tinyLarge > 0.0 ? large / tinyLarge : 0.0, small, tinySmall > 0.0 ? small / tinySmall : 0.0);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// SHA-1 for the XEX block hashes and the guest's XeCryptSha. TinySHA1 feeds the
+// compression function one byte at a time and builds the message schedule in scalar
+// code; here whole blocks go straight to one of:
+//
+//  - Scalar:    portable rounds, scalar schedule.
+//  - Neon:      the schedule four words at a time in NEON registers, rounds in scalar.
+//  - ArmCrypto: SHA1C/SHA1P/SHA1M/SHA1H rounds with SHA1SU0/SHA1SU1 for the schedule.
+namespace Sha1 {
+
+    constexpr size_t DigestSize = 20;
+    constexpr size_t BlockSize = 64;
+
+    enum class Backend : uint8_t
+    {
+        Scalar,
+        Neon,
+        ArmCrypto,
+    };
+
+    // Picked on first use like AesCbc: the fastest backend built in that passes the test
+    // vectors. RXN_SHA1_ARMV8 decides whether ArmCrypto is built.
+    Backend GetBackend();
+    bool SetBackend(Backend backend);
+    bool IsAvailable(Backend backend);
+    const char* GetBackendName(Backend backend);
+
+    class Context
+    {
+    public:
+        Context()
+            : Context(GetBackend())
+        {
+        }
+
+        // Hashes with `backend`, or Scalar if it is not built in.
+        explicit Context(Backend backend);
+
+        void Reset();
+        void Update(const void* data, size_t size);
+        void Final(uint8_t* digest);
+
+    private:
+        using CompressFunction = void (*)(uint32_t* state, const uint8_t* blocks, size_t count);
+
+        CompressFunction compress;
+        uint32_t state[5];
+        uint8_t buffer[BlockSize];
+        size_t buffered;
+        uint64_t length;
+    };
+
+    void Hash(const void* data, size_t size, uint8_t* digest);
+
+    // FIPS 180 / RFC 3174 vectors on every available backend, then random messages fed in
+    // random pieces against TinySHA1.
+    bool RunSelfTest();
+
+    // MB/s of each backend against TinySHA1, on XEX-sized blocks and on short messages.
+    void RunBenchmark();
+
+} // namespace Sha1
@@ -0,0 +1,141 @@
+#include "spin_lock.h"
+#include "function.h"
+#include "memory.h"
+#include "xdm.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+
+ContentionProfiler g_spinLockProfiler("spinlock");
+
+constexpr uint8_t PASSIVE_LEVEL = 0;
+constexpr uint8_t DISPATCH_LEVEL = 2;
+
+// Spin this many times waiting for the owner before giving the core away.
+constexpr uint32_t SPIN_LIMIT = 128;
+
+static thread_local uint8_t g_currentIrql = PASSIVE_LEVEL;
+
+static inline uint32_t LoadLockWord(uint32_t* word)
+{
+#if defined(__aarch64__)
+    // Load-exclusive arms the monitor so the following WFE wakes up as soon as the
+    // owner's release store hits this cache line.
+    uint32_t value;
+    __asm__ __volatile__("ldaxr %w0, [%1]" : "=&r"(value) : "r"(word) : "memory");
+    return value;
+#else
+    return std::atomic_ref<uint32_t>(*word).load(std::memory_order_acquire);
+#endif
+}
+
+static inline void WaitForLockEvent()
+{
+#if defined(__aarch64__)
+    __asm__ __volatile__("wfe" ::: "memory");
+#endif
+}
+
+static inline void ClearLockMonitor()
+{
+#if defined(__aarch64__)
+    __asm__ __volatile__("clrex" ::: "memory");
+#endif
+}
+
+bool SpinLock::TryAcquire(be<uint32_t>* lock, uint32_t owner)
+{
+    uint32_t expected = 0;
+    return std::atomic_ref<uint32_t>(lock->value).compare_exchange_strong(expected, ByteSwap(owner),
+        std::memory_order_acquire, std::memory_order_relaxed);
+}
+
+void SpinLock::Acquire(be<uint32_t>* lock, uint32_t owner)
+{
+    if (TryAcquire(lock, owner)) [[likely]]
+    {
+        if (g_spinLockProfiler.IsEnabled())
+            g_spinLockProfiler.RecordAcquire(g_memory.MapVirtual(lock));
+
+        return;
+    }
+
+    const uint64_t start = armGetSystemTick();
+
+    while (true)
+    {
+        for (uint32_t i = 0; i < SPIN_LIMIT; i++)
+        {
+            if (LoadLockWord(&lock->value) == 0)
+            {
+                ClearLockMonitor();
+
+                if (TryAcquire(lock, owner))
+                {
+                    if (g_spinLockProfiler.IsEnabled())
+                    {
+                        const uint32_t address = g_memory.MapVirtual(lock);
+                        g_spinLockProfiler.RecordContended(address, armGetSystemTick() - start);
+                        g_spinLockProfiler.RecordAcquire(address);
+                    }
+
+                    return;
+                }
+
+                continue;
+            }
+
+            WaitForLockEvent();
+        }
+
+        // The owner is probably descheduled, let it run.
+        svcSleepThread(YieldType_WithoutCoreMigration);
+    }
+}
+
+void SpinLock::Release(be<uint32_t>* lock)
+{
+    std::atomic_ref<uint32_t>(lock->value).store(0, std::memory_order_release);
+}
+
+uint32_t KfAcquireSpinLock(be<uint32_t>* spinLock)
+{
+    const uint8_t oldIrql = g_currentIrql;
+    g_currentIrql = DISPATCH_LEVEL;
+
+    SpinLock::Acquire(spinLock, GetPPCContext()->r13.u32);
+    return oldIrql;
+}
+
+void KfReleaseSpinLock(be<uint32_t>* spinLock, uint32_t oldIrql)
+{
+    SpinLock::Release(spinLock);
+    g_currentIrql = static_cast<uint8_t>(oldIrql);
+}
+
+void KeAcquireSpinLockAtRaisedIrql(be<uint32_t>* spinLock)
+{
+    SpinLock::Acquire(spinLock, GetPPCContext()->r13.u32);
+}
+
+void KeReleaseSpinLockFromRaisedIrql(be<uint32_t>* spinLock)
+{
+    SpinLock::Release(spinLock);
+}
+
+// L2 locking pins cache ways for the GPU/XPS on the console. There is no cache to
+// pin here, so these only report success.
+uint32_t KeLockL2()
+{
+    return STATUS_SUCCESS;
+}
+
+void KeUnlockL2()
+{
+}
+
+GUEST_FUNCTION_HOOK(__imp__KfAcquireSpinLock, KfAcquireSpinLock);
+GUEST_FUNCTION_HOOK(__imp__KfReleaseSpinLock, KfReleaseSpinLock);
+GUEST_FUNCTION_HOOK(__imp__KeAcquireSpinLockAtRaisedIrql, KeAcquireSpinLockAtRaisedIrql);
+GUEST_FUNCTION_HOOK(__imp__KeReleaseSpinLockFromRaisedIrql, KeReleaseSpinLockFromRaisedIrql);
+GUEST_FUNCTION_HOOK(__imp__KeLockL2, KeLockL2);
+GUEST_FUNCTION_HOOK(__imp__KeUnlockL2, KeUnlockL2);
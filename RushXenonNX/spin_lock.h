@@ -0,0 +1,18 @@
+#pragma once
+
+#include "xbox.h"
+#include "contention_profiler.h"
+
+// Guest spinlocks are a single big-endian word holding the owner's PCR address
+// (r13), zero when free. These operate on that word with host atomics so guest
+// code spinning on the same lock with lwarx/stwcx observes the same state.
+namespace SpinLock {
+
+    void Acquire(be<uint32_t>* lock, uint32_t owner);
+    bool TryAcquire(be<uint32_t>* lock, uint32_t owner);
+    void Release(be<uint32_t>* lock);
+
+} // namespace SpinLock
+
+// Samples contended acquisitions only, the uncontended fast path stays a single CAS.
+extern ContentionProfiler g_spinLockProfiler;
@@ -0,0 +1,91 @@
+#include "stub_registry.h"
+#include "export_table.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// Static initialisation only, nothing registers once the game is running.
+static constinit StubCounter* g_stubCounters = nullptr;
+
+static uint64_t g_stubBaseTick = armGetSystemTick();
+
+StubCounter::StubCounter(const char* name)
+    : name(name), next(g_stubCounters)
+{
+    g_stubCounters = this;
+}
+
+void StubCounter::FirstHit()
+{
+    firstTick.store(armGetSystemTick(), std::memory_order_relaxed);
+    SDLogger::Log("Stub: %s (first call, further calls are only counted)", name);
+}
+
+struct StubSample
+{
+    const char* name;
+    uint64_t calls;
+    uint64_t firstMs;
+};
+
+static std::vector<StubSample> SnapshotStubs(bool includeUnused)
+{
+    std::vector<StubSample> samples;
+
+    for (const StubCounter* counter = g_stubCounters; counter != nullptr; counter = counter->next)
+    {
+        const uint64_t calls = counter->calls.load(std::memory_order_relaxed);
+        if (calls == 0 && !includeUnused)
+            continue;
+
+        const uint64_t firstTick = counter->firstTick.load(std::memory_order_relaxed);
+        const uint64_t firstMs = firstTick > g_stubBaseTick ? armTicksToNs(firstTick - g_stubBaseTick) / 1'000'000 : 0;
+
+        samples.push_back({ counter->name, calls, firstMs });
+    }
+
+    std::sort(samples.begin(), samples.end(), [](const StubSample& lhs, const StubSample& rhs)
+        {
+            return lhs.calls != rhs.calls ? lhs.calls > rhs.calls : lhs.firstMs < rhs.firstMs;
+        });
+
+    return samples;
+}
+
+void StubRegistry::Dump()
+{
+    const auto samples = SnapshotStubs(false);
+
+    SDLogger::Log("=== Stub calls: %zu stubs hit ===", samples.size());
+    SDLogger::Log("%-48s %12s %12s", "stub", "calls", "first_ms");
+
+    for (const auto& sample : samples)
+        SDLogger::Log("%-48s %12llu %12llu", sample.name, (unsigned long long)sample.calls, (unsigned long long)sample.firstMs);
+}
+
+bool StubRegistry::WriteCsv(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+    {
+        SDLogger::Log("StubRegistry::WriteCsv - Failed to open %s", path);
+        return false;
+    }
+
+    fprintf(file, "name,library,ordinal,calls,first_call_ms\n");
+
+    for (const auto& sample : SnapshotStubs(true))
+    {
+        ExportLibrary library;
+        uint32_t ordinal;
+        ExportTable::FindOrdinal(sample.name, library, ordinal);
+
+        fprintf(file, "%s,%s,%u,%llu,%llu\n", sample.name, ExportTable::GetLibraryName(library), ordinal,
+            (unsigned long long)sample.calls, (unsigned long long)sample.firstMs);
+    }
+
+    fclose(file);
+    return true;
+}
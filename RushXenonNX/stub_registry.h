@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// One per GUEST_FUNCTION_STUB. Counters link themselves into a global list during
+// static initialisation; a hit is a relaxed increment, and only the first one is
+// logged so a stub in a hot loop can't stall the game on SD card writes.
+struct StubCounter
+{
+    const char* name;
+    std::atomic<uint64_t> calls{ 0 };
+    std::atomic<uint64_t> firstTick{ 0 };
+    StubCounter* next{};
+
+    explicit StubCounter(const char* name);
+
+    void Hit()
+    {
+        if (calls.fetch_add(1, std::memory_order_relaxed) == 0) [[unlikely]]
+            FirstHit();
+    }
+
+private:
+    void FirstHit();
+};
+
+namespace StubRegistry {
+
+    // Logs every stub that was hit, most called first.
+    void Dump();
+
+    // Same as Dump as CSV (name,library,ordinal,calls,first_call_ms), every registered
+    // stub included; library and ordinal come from the export tables.
+    bool WriteCsv(const char* path);
+
+} // namespace StubRegistry
@@ -0,0 +1,199 @@
+#include "timer_wheel.h"
+#include <algorithm>
+#include <bit>
+
+static constexpr uint64_t ToGranule(uint64_t ticks)
+{
+    // Round up so a timer never fires before its deadline.
+    return ticks > TimerWheel::NoDeadline - ((1ull << TimerWheel::GranuleShift) - 1)
+        ? TimerWheel::NoDeadline >> TimerWheel::GranuleShift
+        : (ticks + (1ull << TimerWheel::GranuleShift) - 1) >> TimerWheel::GranuleShift;
+}
+
+static constexpr uint32_t LevelShift(uint32_t level)
+{
+    return level * TimerWheel::LevelBits;
+}
+
+TimerWheel::TimerWheel(uint64_t nowTicks)
+    : current(nowTicks >> GranuleShift)
+{
+}
+
+void TimerWheel::Place(TimerWheelNode* node)
+{
+    constexpr uint64_t Range = 1ull << (LevelBits * LevelCount);
+
+    const uint64_t expires = std::max(node->expires, current);
+    const uint64_t placed = std::min(expires, current + Range - 1);
+    const uint64_t delta = placed - current;
+
+    uint32_t level = 0;
+    while (level + 1 < LevelCount && delta >= (1ull << LevelShift(level + 1)))
+        level++;
+
+    const uint32_t index = (placed >> LevelShift(level)) & (SlotCount - 1);
+    TimerWheelNode*& head = slots[level][index];
+
+    node->prev = nullptr;
+    node->next = head;
+    if (head != nullptr)
+        head->prev = node;
+
+    head = node;
+    node->slot = (int32_t)(level * SlotCount + index);
+    occupied[level] |= 1ull << index;
+}
+
+void TimerWheel::Insert(TimerWheelNode* node)
+{
+    if (node->IsScheduled())
+        Remove(node);
+
+    node->expires = ToGranule(node->deadline);
+    Place(node);
+}
+
+void TimerWheel::Remove(TimerWheelNode* node)
+{
+    if (!node->IsScheduled())
+        return;
+
+    const uint32_t level = node->slot / SlotCount;
+    const uint32_t index = node->slot % SlotCount;
+    TimerWheelNode*& head = node->slot == FiringSlot ? firing : slots[level][index];
+
+    if (node->prev != nullptr)
+        node->prev->next = node->next;
+    else
+        head = node->next;
+
+    if (node->next != nullptr)
+        node->next->prev = node->prev;
+
+    if (node->slot != FiringSlot && head == nullptr)
+        occupied[level] &= ~(1ull << index);
+
+    node->prev = nullptr;
+    node->next = nullptr;
+    node->slot = -1;
+}
+
+void TimerWheel::Cascade(uint32_t level, uint32_t index)
+{
+    TimerWheelNode* node = slots[level][index];
+    slots[level][index] = nullptr;
+    occupied[level] &= ~(1ull << index);
+
+    while (node != nullptr)
+    {
+        TimerWheelNode* next = node->next;
+        Place(node);
+        node = next;
+    }
+}
+
+uint64_t TimerWheel::NextEvent() const
+{
+    uint64_t next = NoDeadline;
+
+    for (uint32_t level = 0; level < LevelCount; level++)
+    {
+        if (occupied[level] == 0)
+            continue;
+
+        const uint32_t shift = LevelShift(level);
+        const uint64_t block = current >> shift;
+        const uint32_t index = block & (SlotCount - 1);
+
+        // Slots at or after the current index first, then the ones that wrapped.
+        const uint64_t rotated = std::rotr(occupied[level], (int)index);
+        uint64_t distance = std::countr_zero(rotated);
+
+        // Level 0 fires on its own tick; a higher level's current slot is only
+        // still pending if we sit exactly on its block boundary.
+        if (level == 0)
+        {
+            next = std::min(next, current + distance);
+        }
+        else
+        {
+            if (distance == 0 && (current & ((1ull << shift) - 1)) != 0)
+            {
+                const uint64_t others = rotated & ~1ull;
+                distance = others != 0 ? std::countr_zero(others) : SlotCount;
+            }
+
+            next = std::min(next, distance == 0 ? current : (block + distance) << shift);
+        }
+    }
+
+    return next;
+}
+
+size_t TimerWheel::Advance(uint64_t nowTicks)
+{
+    const uint64_t now = nowTicks >> GranuleShift;
+    size_t fired = 0;
+
+    while (current <= now)
+    {
+        const uint64_t next = NextEvent();
+        if (next > now)
+        {
+            current = now + 1;
+            break;
+        }
+
+        current = next;
+
+        // Pull down every level whose block starts here, top-down so timers can
+        // fall through several levels in one step.
+        for (uint32_t level = LevelCount - 1; level > 0; level--)
+        {
+            const uint32_t shift = LevelShift(level);
+            if ((current & ((1ull << shift) - 1)) == 0)
+                Cascade(level, (current >> shift) & (SlotCount - 1));
+        }
+
+        // Expired timers move to a separate list so callbacks can remove any of
+        // them, and re-inserted timers can't land in the list being drained.
+        const uint32_t index = current & (SlotCount - 1);
+        firing = slots[0][index];
+        slots[0][index] = nullptr;
+        occupied[0] &= ~(1ull << index);
+
+        for (TimerWheelNode* node = firing; node != nullptr; node = node->next)
+            node->slot = FiringSlot;
+
+        current++;
+
+        while (firing != nullptr)
+        {
+            TimerWheelNode* node = firing;
+            Remove(node);
+
+            node->callback(node);
+            fired++;
+        }
+    }
+
+    return fired;
+}
+
+uint64_t TimerWheel::NextDeadline() const
+{
+    const uint64_t next = NextEvent();
+    return next == NoDeadline ? NoDeadline : next << GranuleShift;
+}
+
+bool TimerWheel::IsEmpty() const
+{
+    for (uint64_t mask : occupied)
+    {
+        if (mask != 0)
+            return false;
+    }
+
+    return true;
+}
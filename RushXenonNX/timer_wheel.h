@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct TimerWheelNode;
+
+using TimerWheelCallback = void (*)(TimerWheelNode* node);
+
+// Intrusive entry, owned by whoever embeds it. `deadline` is in system ticks.
+struct TimerWheelNode
+{
+    TimerWheelNode* prev{};
+    TimerWheelNode* next{};
+    uint64_t deadline{};
+    uint64_t expires{};
+    int32_t slot{ -1 };
+    TimerWheelCallback callback{};
+
+    bool IsScheduled() const
+    {
+        return slot >= 0;
+    }
+};
+
+// Hierarchical timing wheel: 4 levels of 64 slots, one level-0 slot per granule of
+// 2^GranuleShift system ticks (~53us on the Switch). Insert and remove are O(1);
+// advancing jumps straight to the next occupied slot or pending cascade, so an idle
+// wheel costs nothing. Timers past the last level are parked in its farthest slot
+// and re-cascaded. Not thread safe, the owner serialises access.
+class TimerWheel
+{
+public:
+    static constexpr uint32_t GranuleShift = 10;
+    static constexpr uint32_t LevelBits = 6;
+    static constexpr uint32_t LevelCount = 4;
+    static constexpr uint32_t SlotCount = 1u << LevelBits;
+    static constexpr uint64_t NoDeadline = UINT64_MAX;
+
+    explicit TimerWheel(uint64_t nowTicks = 0);
+
+    void Insert(TimerWheelNode* node);
+    void Remove(TimerWheelNode* node);
+
+    // Fires every timer whose deadline is <= nowTicks. Callbacks may re-insert
+    // their own node or remove others.
+    size_t Advance(uint64_t nowTicks);
+
+    // System tick of the next expiry or cascade, NoDeadline when the wheel is empty.
+    uint64_t NextDeadline() const;
+
+    bool IsEmpty() const;
+
+private:
+    uint64_t NextEvent() const;
+    void Place(TimerWheelNode* node);
+    void Cascade(uint32_t level, uint32_t index);
+
+    static constexpr int32_t FiringSlot = LevelCount * SlotCount;
+
+    uint64_t current;
+    TimerWheelNode* slots[LevelCount][SlotCount]{};
+    TimerWheelNode* firing{};
+    uint64_t occupied[LevelCount]{};
+};
@@ -0,0 +1,245 @@
+#include "vmx_ops.h"
+#include "nx/log/nxlogger.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <random>
+
+namespace {
+
+    constexpr size_t DifferentialIterations = 200'000;
+    constexpr size_t BenchmarkVectors = 256;
+    constexpr size_t BenchmarkRounds = 2'000;
+    constexpr size_t MaxReportedMismatches = 4;
+
+    struct Operands
+    {
+        simde__m128i a;
+        simde__m128i b;
+        simde__m128i c;
+    };
+
+    // Mostly random bits, with enough saturation edges and float specials mixed in that
+    // every clamp and NaN path gets exercised.
+    class VectorSource
+    {
+    public:
+        simde__m128i Next()
+        {
+            alignas(16) uint32_t words[4];
+
+            switch (rng() % 4)
+            {
+            case 0:
+                for (auto& word : words)
+                    word = rng();
+                break;
+
+            case 1:
+                for (auto& word : words)
+                {
+                    const float value = rng() % 2 ? FloatSpecials[rng() % std::size(FloatSpecials)]
+                        : std::ldexp((float)(int32_t)rng(), (int)(rng() % 64) - 40);
+                    std::memcpy(&word, &value, sizeof(word));
+                }
+                break;
+
+            case 2:
+                for (auto& word : words)
+                    word = IntegerEdges[rng() % std::size(IntegerEdges)];
+                break;
+
+            default:
+                for (auto& word : words)
+                {
+                    const uint16_t low = HalfEdges[rng() % std::size(HalfEdges)];
+                    const uint16_t high = HalfEdges[rng() % std::size(HalfEdges)];
+                    word = low | (uint32_t)high << 16;
+                }
+                break;
+            }
+
+            return simde_mm_load_si128(reinterpret_cast<const simde__m128i*>(words));
+        }
+
+    private:
+        static constexpr float FloatSpecials[] = {
+            0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -2.5f,
+            2147483520.0f, 2147483648.0f, -2147483648.0f, -2147483904.0f, 1e20f, -1e20f,
+            std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+            std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::denorm_min(),
+            std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+
+        static constexpr uint32_t IntegerEdges[] = {
+            0, 1, 0xFFFFFFFF, 0x7FFF, 0x8000, 0xFFFF8000, 0xFFFF7FFF, 0x10000, 0x7FFFFFFF, 0x80000000, 0xFFFF };
+
+        static constexpr uint16_t HalfEdges[] = { 0, 1, 0x7F, 0x80, 0xFF, 0x100, 0xFF80, 0xFF7F, 0x7FFF, 0x8000, 0xFFFF };
+
+        std::mt19937 rng{ 0x56'4D'58'31 };
+    };
+
+    bool SameBits(simde__m128i lhs, simde__m128i rhs)
+    {
+        alignas(16) uint8_t left[16];
+        alignas(16) uint8_t right[16];
+        simde_mm_store_si128(reinterpret_cast<simde__m128i*>(left), lhs);
+        simde_mm_store_si128(reinterpret_cast<simde__m128i*>(right), rhs);
+        return std::memcmp(left, right, sizeof(left)) == 0;
+    }
+
+    // NaNs only have to agree on being NaN, the hosts pick different default NaNs. Finite
+    // sums may differ in the last bits when the reference adds the products in sequence.
+    template<int Mask>
+    bool SameDotProduct(const Operands& operands, simde__m128i lhs, simde__m128i rhs)
+    {
+        alignas(16) float a[4];
+        alignas(16) float b[4];
+        alignas(16) float left[4];
+        alignas(16) float right[4];
+        simde_mm_store_si128(reinterpret_cast<simde__m128i*>(a), operands.a);
+        simde_mm_store_si128(reinterpret_cast<simde__m128i*>(b), operands.b);
+        simde_mm_store_si128(reinterpret_cast<simde__m128i*>(left), lhs);
+        simde_mm_store_si128(reinterpret_cast<simde__m128i*>(right), rhs);
+
+        double magnitude = 0.0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (Mask & (0x10 << i))
+                magnitude += std::fabs((double)a[i] * b[i]);
+        }
+
+        for (int i = 0; i < 4; i++)
+        {
+            if (std::isnan(left[i]) || std::isnan(right[i]))
+            {
+                if (std::isnan(left[i]) != std::isnan(right[i]))
+                    return false;
+            }
+            else if (left[i] != right[i] && !(std::isfinite(left[i]) && std::isfinite(right[i])
+                && std::fabs((double)left[i] - right[i]) <= magnitude * 0x1p-21))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    template<typename TPortable, typename TNative, typename TCompare>
+    size_t CheckOperation(const char* name, const TPortable& portable, const TNative& native, const TCompare& same)
+    {
+        VectorSource source;
+        size_t mismatches = 0;
+
+        for (size_t i = 0; i < DifferentialIterations; i++)
+        {
+            const Operands operands{ source.Next(), source.Next(), source.Next() };
+            const simde__m128i expected = portable(operands);
+            const simde__m128i actual = native(operands);
+
+            if (same(operands, expected, actual))
+                continue;
+
+            if (mismatches++ < MaxReportedMismatches)
+            {
+                alignas(16) uint32_t words[5][4];
+                simde_mm_store_si128(reinterpret_cast<simde__m128i*>(words[0]), operands.a);
+                simde_mm_store_si128(reinterpret_cast<simde__m128i*>(words[1]), operands.b);
+                simde_mm_store_si128(reinterpret_cast<simde__m128i*>(words[2]), operands.c);
+                simde_mm_store_si128(reinterpret_cast<simde__m128i*>(words[3]), expected);
+                simde_mm_store_si128(reinterpret_cast<simde__m128i*>(words[4]), actual);
+
+                for (size_t j = 0; j < std::size(words); j++)
+                {
+                    constexpr const char* Labels[] = { "a", "b", "c", "expected", "actual" };
+                    SDLogger::Log("VmxOps %-14s %-8s %08X %08X %08X %08X", name, Labels[j],
+                        words[j][0], words[j][1], words[j][2], words[j][3]);
+                }
+            }
+        }
+
+        return mismatches;
+    }
+
+    template<typename TOperation>
+    double MeasureOperation(const Operands* operands, const TOperation& operation)
+    {
+        simde__m128i sink = simde_mm_setzero_si128();
+        const auto start = std::chrono::steady_clock::now();
+
+        for (size_t round = 0; round < BenchmarkRounds; round++)
+        {
+            for (size_t i = 0; i < BenchmarkVectors; i++)
+                sink = simde_mm_xor_si128(sink, operation(operands[i]));
+        }
+
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        alignas(16) uint32_t words[4];
+        simde_mm_store_si128(reinterpret_cast<simde__m128i*>(words), sink);
+        volatile uint32_t keep = words[0] ^ words[1] ^ words[2] ^ words[3];
+        (void)keep;
+
+        return std::chrono::duration<double, std::nano>(elapsed).count() / (double)(BenchmarkRounds * BenchmarkVectors);
+    }
+
+    // Check and timing per operation; both lambdas are instantiated here so the kernels
+    // inline into the timed loop the way they do into recompiled code.
+    template<typename TPortable, typename TNative, typename TCompare>
+    size_t RunOperation(const char* name, const Operands* operands, const TPortable& portable, const TNative& native, const TCompare& same)
+    {
+        const size_t mismatches = CheckOperation(name, portable, native, same);
+        const double portableNs = MeasureOperation(operands, portable);
+        const double nativeNs = MeasureOperation(operands, native);
+
+        SDLogger::Log("%-14s %12.3f %12.3f %7.2fx %10zu", name, portableNs, nativeNs,
+            nativeNs > 0.0 ? portableNs / nativeNs : 0.0, mismatches);
+
+        return mismatches;
+    }
+
+    bool SameResult(const Operands&, simde__m128i lhs, simde__m128i rhs)
+    {
+        return SameBits(lhs, rhs);
+    }
+
+} // namespace
+
+void VmxOps::RunBenchmark()
+{
+    VectorSource source;
+    Operands operands[BenchmarkVectors];
+    for (auto& operand : operands)
+        operand = { source.Next(), source.Next(), source.Next() };
+
+    SDLogger::Log("VmxOps::RunBenchmark - native path: %s, %zu random cases per operation", NativeName, DifferentialIterations);
+    SDLogger::Log("%-14s %12s %12s %8s %10s", "operation", "simde_ns", "native_ns", "speedup", "mismatches");
+
+    size_t mismatches = 0;
+
+#define VMX_OPERATION(name, expression, compare) \
+    mismatches += RunOperation(name, operands, \
+        [](const Operands& o) { using namespace Portable; return expression; }, \
+        [](const Operands& o) { using namespace Native; return expression; }, \
+        compare)
+
+#define VMX_FLOAT(x) simde_mm_castsi128_ps(x)
+#define VMX_INT(x) simde_mm_castps_si128(x)
+
+    VMX_OPERATION("vperm", Permute(o.a, o.b, o.c), SameResult);
+    VMX_OPERATION("vmsum3fp128", VMX_INT(DotProduct<0xEF>(VMX_FLOAT(o.a), VMX_FLOAT(o.b))), SameDotProduct<0xEF>);
+    VMX_OPERATION("vmsum4fp128", VMX_INT(DotProduct<0xFF>(VMX_FLOAT(o.a), VMX_FLOAT(o.b))), SameDotProduct<0xFF>);
+    VMX_OPERATION("vctsxs", ConvertToInt32Saturate(VMX_FLOAT(o.a)), SameResult);
+    VMX_OPERATION("vpkswss", PackSigned32To16(o.a, o.b), SameResult);
+    VMX_OPERATION("vpkshss", PackSigned16To8(o.a, o.b), SameResult);
+    VMX_OPERATION("vpkswus", PackUnsigned32To16(o.a, o.b), SameResult);
+    VMX_OPERATION("vpkshus", PackUnsigned16To8(o.a, o.b), SameResult);
+
+#undef VMX_INT
+#undef VMX_FLOAT
+#undef VMX_OPERATION
+
+    SDLogger::Log("VmxOps differential check: %s", mismatches == 0 ? "all operations match SIMDe" : "MISMATCHES");
+}
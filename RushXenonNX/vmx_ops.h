@@ -0,0 +1,156 @@
+#pragma once
+
+// VMX128 operations the recompiled code spends most of its vector time in. XenonRecomp
+// lowers them to SIMDe x86 calls, and on ARM several of those (dpps, the pshufb/pblendvb
+// pair behind vperm, the cvttps fix-ups behind vctsxs) become scalar loops or long NEON
+// sequences. Native:: picks the hand-written NEON kernels when SIMDe targets AArch64 and
+// the Portable:: SIMDe sequences everywhere else; Portable:: is also the reference
+// RunBenchmark checks Native:: against.
+//
+// Vector registers hold the guest vector byte-reversed (the recompiler swaps the whole
+// quadword on load/store), so guest element 0 is host lane 3, byte 0 is host byte 15.
+// All kernels take and return host lanes, exactly like the SIMDe calls they replace.
+//
+// With RXN_VMX_NEON this header is force-included into the recompiled sources and takes
+// over the SIMDe entry points below.
+#include <ppc_context.h>
+#include <cstdint>
+
+namespace VmxOps {
+
+    namespace Portable {
+
+        // vperm: byte i of the result is byte (c[i] & 31) of the guest pair a:b.
+        inline simde__m128i Permute(simde__m128i a, simde__m128i b, simde__m128i c)
+        {
+            const simde__m128i low = simde_mm_set1_epi8(0xF);
+            const simde__m128i index = simde_mm_sub_epi8(low, simde_mm_and_si128(c, low));
+            const simde__m128i fromA = simde_mm_shuffle_epi8(a, index);
+            const simde__m128i fromB = simde_mm_shuffle_epi8(b, index);
+            return simde_mm_blendv_epi8(fromA, fromB, simde_mm_slli_epi32(c, 3));
+        }
+
+        // vmsum3fp128/vmsum4fp128: dpps with the products in Mask's high nibble summed
+        // into the lanes of its low nibble.
+        template<int Mask>
+        inline simde__m128 DotProduct(simde__m128 a, simde__m128 b)
+        {
+            return simde_mm_dp_ps(a, b, Mask);
+        }
+
+        // vctsxs: truncate, saturate to the int32 range, NaN becomes 0.
+        inline simde__m128i ConvertToInt32Saturate(simde__m128 a)
+        {
+            const simde__m128i truncated = simde_mm_cvttps_epi32(a);
+            const simde__m128i overflow = simde_mm_castps_si128(simde_mm_cmpge_ps(a, simde_mm_set1_ps(2147483648.0f)));
+            const simde__m128i ordered = simde_mm_castps_si128(simde_mm_cmpord_ps(a, a));
+            return simde_mm_and_si128(simde_mm_xor_si128(truncated, overflow), ordered);
+        }
+
+        // vpkswss/vpkshss/vpkswus/vpkshus: a fills the low half of the result, b the high half.
+        inline simde__m128i PackSigned32To16(simde__m128i a, simde__m128i b)
+        {
+            return simde_mm_packs_epi32(a, b);
+        }
+
+        inline simde__m128i PackSigned16To8(simde__m128i a, simde__m128i b)
+        {
+            return simde_mm_packs_epi16(a, b);
+        }
+
+        inline simde__m128i PackUnsigned32To16(simde__m128i a, simde__m128i b)
+        {
+            return simde_mm_packus_epi32(a, b);
+        }
+
+        inline simde__m128i PackUnsigned16To8(simde__m128i a, simde__m128i b)
+        {
+            return simde_mm_packus_epi16(a, b);
+        }
+
+    } // namespace Portable
+
+#if defined(SIMDE_ARM_NEON_A64V8_NATIVE)
+
+    namespace Neon {
+
+        inline simde__m128i Permute(simde__m128i a, simde__m128i b, simde__m128i c)
+        {
+            // Guest byte i of a:b is host byte 31 - i of b:a, and 31 - i == ~i & 31.
+            const uint8x16x2_t table = { { simde__m128i_to_neon_u8(b), simde__m128i_to_neon_u8(a) } };
+            const uint8x16_t index = vandq_u8(vmvnq_u8(simde__m128i_to_neon_u8(c)), vdupq_n_u8(0x1F));
+            return simde__m128i_from_neon_u8(vqtbl2q_u8(table, index));
+        }
+
+        template<int Mask>
+        inline simde__m128 DotProduct(simde__m128 a, simde__m128 b)
+        {
+            const uint32x4_t sources = { Mask & 0x10 ? ~0u : 0u, Mask & 0x20 ? ~0u : 0u, Mask & 0x40 ? ~0u : 0u, Mask & 0x80 ? ~0u : 0u };
+            const uint32x4_t targets = { Mask & 0x1 ? ~0u : 0u, Mask & 0x2 ? ~0u : 0u, Mask & 0x4 ? ~0u : 0u, Mask & 0x8 ? ~0u : 0u };
+
+            const float32x4_t products = vmulq_f32(simde__m128_to_neon_f32(a), simde__m128_to_neon_f32(b));
+            const float32x4_t masked = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(products), sources));
+
+            // faddv adds lanes 0+1 and 2+3 before the final add, the same order as dpps.
+            const uint32x4_t sum = vreinterpretq_u32_f32(vdupq_n_f32(vaddvq_f32(masked)));
+            return simde__m128_from_neon_f32(vreinterpretq_f32_u32(vandq_u32(sum, targets)));
+        }
+
+        inline simde__m128i ConvertToInt32Saturate(simde__m128 a)
+        {
+            // fcvtzs already truncates, saturates and turns NaN into 0.
+            return simde__m128i_from_neon_i32(vcvtq_s32_f32(simde__m128_to_neon_f32(a)));
+        }
+
+        inline simde__m128i PackSigned32To16(simde__m128i a, simde__m128i b)
+        {
+            return simde__m128i_from_neon_i16(vcombine_s16(vqmovn_s32(simde__m128i_to_neon_i32(a)), vqmovn_s32(simde__m128i_to_neon_i32(b))));
+        }
+
+        inline simde__m128i PackSigned16To8(simde__m128i a, simde__m128i b)
+        {
+            return simde__m128i_from_neon_i8(vcombine_s8(vqmovn_s16(simde__m128i_to_neon_i16(a)), vqmovn_s16(simde__m128i_to_neon_i16(b))));
+        }
+
+        inline simde__m128i PackUnsigned32To16(simde__m128i a, simde__m128i b)
+        {
+            return simde__m128i_from_neon_u16(vcombine_u16(vqmovun_s32(simde__m128i_to_neon_i32(a)), vqmovun_s32(simde__m128i_to_neon_i32(b))));
+        }
+
+        inline simde__m128i PackUnsigned16To8(simde__m128i a, simde__m128i b)
+        {
+            return simde__m128i_from_neon_u8(vcombine_u8(vqmovun_s16(simde__m128i_to_neon_i16(a)), vqmovun_s16(simde__m128i_to_neon_i16(b))));
+        }
+
+    } // namespace Neon
+
+    namespace Native = Neon;
+    constexpr const char* NativeName = "NEON";
+
+#else
+
+    namespace Native = Portable;
+    constexpr const char* NativeName = "portable";
+
+#endif
+
+    // Randomized differential check of Native:: against Portable:: followed by per-op
+    // throughput of both; on builds without NEON only the portable numbers mean anything.
+    void RunBenchmark();
+
+} // namespace VmxOps
+
+#ifdef RXN_VMX_NEON
+#undef simde_mm_dp_ps
+#undef simde_mm_packs_epi32
+#undef simde_mm_packs_epi16
+#undef simde_mm_packus_epi32
+#undef simde_mm_packus_epi16
+#define simde_mm_perm_epi8_ VmxOps::Native::Permute
+#define simde_mm_dp_ps(a, b, mask) VmxOps::Native::DotProduct<(mask)>((a), (b))
+#define simde_mm_vctsxs VmxOps::Native::ConvertToInt32Saturate
+#define simde_mm_packs_epi32 VmxOps::Native::PackSigned32To16
+#define simde_mm_packs_epi16 VmxOps::Native::PackSigned16To8
+#define simde_mm_packus_epi32 VmxOps::Native::PackUnsigned32To16
+#define simde_mm_packus_epi16 VmxOps::Native::PackUnsigned16To8
+#endif
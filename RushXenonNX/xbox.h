@@ -191,6 +191,21 @@ typedef struct _XLIST_ENTRY
     be<uint32_t> Blink;
 } XLIST_ENTRY;
 
+typedef struct _XSINGLE_LIST_ENTRY
+{
+    be<uint32_t> Next;
+} XSINGLE_LIST_ENTRY;
+
+// Updated as a single big-endian doubleword: Next in the high word, then Depth and Sequence.
+typedef struct _XSLIST_HEADER
+{
+    XSINGLE_LIST_ENTRY Next;
+    be<uint16_t> Depth;
+    be<uint16_t> Sequence;
+} XSLIST_HEADER;
+
+static_assert(sizeof(XSLIST_HEADER) == 8);
+
 typedef struct _XDISPATCHER_HEADER
 {
     union
@@ -323,6 +338,20 @@ typedef struct _XKSEMAPHORE
     be<uint32_t> Limit;
 } XKSEMAPHORE;
 
+typedef struct _XKDPC
+{
+    be<uint16_t> Type;
+    uint8_t SelectedCpuNumber;
+    uint8_t DesiredCpuNumber;
+    XLIST_ENTRY DpcListEntry;
+    be<uint32_t> DeferredRoutine;
+    be<uint32_t> DeferredContext;
+    be<uint32_t> SystemArgument1;
+    be<uint32_t> SystemArgument2;
+} XKDPC;
+
+static_assert(sizeof(XKDPC) == 0x1C);
+
 typedef struct _XUSER_SIGNIN_INFO {
     be<uint64_t> xuid;
     be<uint32_t> dwField08;
@@ -17,6 +17,10 @@
 #define STATUS_USER_APC            0x000000C0 
 #define STATUS_TIMEOUT             0x00000102
 #define STATUS_FAIL_CHECK          0xC0000229
+#define STATUS_INVALID_HANDLE      0xC0000008
+#define STATUS_INVALID_PARAMETER   0xC000000D
+#define STATUS_NO_MEMORY           0xC0000017
+#define STATUS_INSUFFICIENT_RESOURCES 0xC000009A
 #define INFINITE                   0xFFFFFFFF
 #define FILE_ATTRIBUTE_DIRECTORY   0x00000010  
 #define FILE_ATTRIBUTE_NORMAL      0x00000080  
@@ -3,13 +3,10 @@
 #include <cassert>
 #include <cstring>
 #include <vector>
-#include <unordered_map>
-#include "aes.hpp"
-#include "TinySHA1.hpp"
+#include "aes_cbc.h"
+#include "xex_verify.h"
 #include "xex_patcher.h"
-
-#define STRINGIFY(X) #X
-#define XE_EXPORT(MODULE, ORDINAL, NAME, TYPE) { (ORDINAL), "__imp__" STRINGIFY(NAME) }
+#include "export_table.h"
 
 #ifndef _WIN32
 
@@ -114,17 +111,7 @@ typedef struct _IMAGE_SECTION_HEADER {
 
 #endif
 
-std::unordered_map<size_t, const char*> XamExports =
-{
-    #include "xbox/xam_table.inc"
-};
-
-std::unordered_map<size_t, const char*> XboxKernelExports =
-{
-    #include "xbox/xboxkrnl_table.inc"
-};
-
-Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
+Image Xex2LoadImage(const uint8_t* data, size_t dataSize, XexVerifyMode verify)
 {
     auto* header = reinterpret_cast<const Xex2Header*>(data);
     auto* security = reinterpret_cast<const Xex2SecurityInfo*>(data + header->securityOffset);
@@ -145,17 +132,17 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
         if (fileFormatInfo->encryptionType == XEX_ENCRYPTION_NORMAL)
         {
             constexpr uint32_t KeySize = 16;
-            AES_ctx aesContext;
+            AesCbc::Context aesContext;
 
             uint8_t decryptedKey[KeySize];
             memcpy(decryptedKey, security->aesKey, KeySize);
-            AES_init_ctx_iv(&aesContext, Xex2RetailKey, AESBlankIV);
-            AES_CBC_decrypt_buffer(&aesContext, decryptedKey, KeySize);
+            AesCbc::Init(aesContext, Xex2RetailKey, AESBlankIV);
+            AesCbc::Decrypt(aesContext, decryptedKey, KeySize);
 
             decryptedData = std::make_unique<uint8_t[]>(dataSize - header->headerSize);
             memcpy(decryptedData.get(), data + header->headerSize, dataSize - header->headerSize);
-            AES_init_ctx_iv(&aesContext, decryptedKey, AESBlankIV);
-            AES_CBC_decrypt_buffer(&aesContext, decryptedData.get(), dataSize - header->headerSize);
+            AesCbc::Init(aesContext, decryptedKey, AESBlankIV);
+            AesCbc::Decrypt(aesContext, decryptedData.get(), dataSize - header->headerSize);
 
             srcData = decryptedData.get();
         }
@@ -208,24 +195,39 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
             auto compressBuffer = std::make_unique<uint8_t[]>(exeLength);
             const uint8_t* p = NULL;
             uint8_t* d = NULL;
-            sha1::SHA1 s;
 
+            // Walk the chain first: each block's hash sits in the header of the one before it,
+            // so every block can then be checked at once.
+            std::vector<XexBlockHash> hashes;
             p = exeBuffer;
-            d = compressBuffer.get();
 
-            uint8_t blockCalcedDigest[0x14];
             while (blocks->blockSize)
             {
-                const uint8_t* pNext = p + blocks->blockSize;
-                const auto* nextBlock = (const Xex2CompressedBlockInfo*)p;
+                if (blocks->blockSize < sizeof(Xex2CompressedBlockInfo) || blocks->blockSize > exeBuffer + exeLength - p)
+                    return {};
 
-                s.reset();
-                s.processBytes(p, blocks->blockSize);
-                s.finalize(blockCalcedDigest);
+                XexBlockHash& hash = hashes.emplace_back();
+                hash.data = p;
+                hash.size = blocks->blockSize;
+                memcpy(hash.expected, blocks->blockHash, sizeof(hash.expected));
 
-                if (memcmp(blockCalcedDigest, blocks->blockHash, 0x14) != 0)
-                    return {};
+                blocks = (const Xex2CompressedBlockInfo*)p;
+                p += hash.size;
+            }
 
+            XexBlockVerifier verifier(verify == XexVerifyMode::Skip ? 1 : XexBlockVerifier::MaxThreads);
+
+            if (verify == XexVerifyMode::Full && verifier.Verify(hashes.data(), hashes.size()) >= 0)
+                return {};
+
+            if (verify == XexVerifyMode::Deferred)
+                verifier.Begin(hashes.data(), hashes.size());
+
+            d = compressBuffer.get();
+
+            for (const auto& hash : hashes)
+            {
+                p = hash.data;
                 p += 4;
                 p += 20;
 
@@ -241,9 +243,6 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
                     p += chunkSize;
                     d += chunkSize;
                 }
-
-                p = pNext;
-                blocks = nextBlock;
             }
 
             int resultCode = 0;
@@ -252,6 +251,9 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
 
             resultCode = lzxDecompress(compressBuffer.get(), d - compressBuffer.get(), buffer, uncompressedSize, ((const Xex2FileNormalCompressionInfo*)(fileFormatInfo + 1))->windowSize, nullptr, 0);
 
+            if (verify == XexVerifyMode::Deferred && verifier.Wait() >= 0)
+                return {};
+
             if (resultCode)
                 return {};
         }
@@ -259,17 +261,31 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
 
     image.data = std::move(result);
     image.size = imageSize;
+    image.base = Xex2GetImageBase(data);
 
-    // Map image
-    const auto* dosHeader = reinterpret_cast<IMAGE_DOS_HEADER*>(image.data.get());
-    const auto* ntHeaders = reinterpret_cast<IMAGE_NT_HEADERS32*>(image.data.get() + dosHeader->e_lfanew);
+    Xex2MapImage(image, data, image.data.get());
+    return image;
+}
+
+uint32_t Xex2GetImageBase(const uint8_t* data)
+{
+    auto* header = reinterpret_cast<const Xex2Header*>(data);
+    auto* security = reinterpret_cast<const Xex2SecurityInfo*>(data + header->securityOffset);
 
-    image.base = security->loadAddress;
     const void* xex2BaseAddressPtr = getOptHeaderPtr(data, XEX_HEADER_IMAGE_BASE_ADDRESS);
     if (xex2BaseAddressPtr != nullptr)
     {
-        image.base = *reinterpret_cast<const be<uint32_t>*>(xex2BaseAddressPtr);
+        return *reinterpret_cast<const be<uint32_t>*>(xex2BaseAddressPtr);
     }
+
+    return security->loadAddress;
+}
+
+void Xex2MapImage(Image& image, const uint8_t* data, uint8_t* imageData)
+{
+    const auto* dosHeader = reinterpret_cast<IMAGE_DOS_HEADER*>(imageData);
+    const auto* ntHeaders = reinterpret_cast<IMAGE_NT_HEADERS32*>(imageData + dosHeader->e_lfanew);
+
     const void* xex2ResourceInfoPtr = getOptHeaderPtr(data, XEX_HEADER_RESOURCE_INFO);
     if (xex2ResourceInfoPtr != nullptr)
     {
@@ -297,7 +313,7 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
         }
 
         image.Map(reinterpret_cast<const char*>(section.Name), section.VirtualAddress,
-            section.Misc.VirtualSize, flags, image.data.get() + section.VirtualAddress);
+            section.Misc.VirtualSize, flags, imageData + section.VirtualAddress);
     }
 
     auto* imports = reinterpret_cast<const Xex2ImportHeader*>(getOptHeaderPtr(data, XEX_HEADER_IMPORT_LIBRARIES));
@@ -319,17 +335,7 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
         for (size_t i = 0; i < stringTable.size(); i++)
         {
             auto* descriptors = (Xex2ImportDescriptor*)(library + 1);
-            static std::unordered_map<size_t, const char*> DummyExports;
-            const std::unordered_map<size_t, const char*>* names = &DummyExports;
-
-            if (stringTable[i] == "xam.xex")
-            {
-                names = &XamExports;
-            }
-            else if (stringTable[i] == "xboxkrnl.exe")
-            {
-                names = &XboxKernelExports;
-            }
+            const ExportLibrary exportLibrary = ExportTable::FromModuleName(stringTable[i]);
 
             for (size_t im = 0; im < library->numberOfImports; im++)
             {
@@ -340,10 +346,9 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
                 if (originalData->originalData.type != 0)
                 {
                     uint32_t thunk[4] = { 0x00000060, 0x00000060, 0x00000060, 0x2000804E };
-                    auto name = names->find(originalData->originalData.ordinal);
-                    if (name != names->end())
+                    if (const char* name = ExportTable::FindName(exportLibrary, originalData->originalData.ordinal))
                     {
-                        image.symbols.insert({ name->second, descriptors[im].firstThunk, sizeof(thunk), Symbol_Function });
+                        image.symbols.insert({ name, descriptors[im].firstThunk, sizeof(thunk), Symbol_Function });
                     }
 
                     memcpy(originalThunk, thunk, sizeof(thunk));
@@ -352,6 +357,4 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
             library = (Xex2ImportLibrary*)((char*)(library + 1) + library->numberOfImports * sizeof(Xex2ImportDescriptor));
         }
     }
-
-    return image;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include <memory>
 #include "xbox.h"
+#include "xex_verify.h"
 
 inline constexpr uint8_t Xex2RetailKey[16] = { 0x20, 0xB1, 0x85, 0xA5, 0x9D, 0x28, 0xFD, 0xC3, 0x40, 0x58, 0x3F, 0xBB, 0x08, 0x96, 0xBF, 0x91 };
 inline constexpr uint8_t AESBlankIV[16] = {};
@@ -264,4 +265,11 @@ inline const void* getOptHeaderPtr(const uint8_t* moduleBytes, uint32_t headerKe
 }
 
 struct Image;
-Image Xex2LoadImage(const uint8_t* data, size_t dataSize);
+Image Xex2LoadImage(const uint8_t* data, size_t dataSize, XexVerifyMode verify = XexVerifyMode::Full);
+
+// Load address of the image described by the XEX headers in `data`.
+uint32_t Xex2GetImageBase(const uint8_t* data);
+
+// Fills `image` (base already set) from the decompressed PE image at `imageData`:
+// resources, entry point, sections, and import thunks, which are patched in place.
+void Xex2MapImage(Image& image, const uint8_t* data, uint8_t* imageData);
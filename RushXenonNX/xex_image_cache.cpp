@@ -0,0 +1,191 @@
+#include "xex_image_cache.h"
+#include "xex_verify.h"
+#include "nx/log/nxlogger.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+    constexpr uint32_t CacheMagic = 'RXIC';
+
+    // Part of every key, so bumping it invalidates all stored images. Bump it whenever
+    // the layout or the key derivation changes, and on every change to the code that
+    // produces the image: xex_loader.cpp (decryption, basic and LZX decompression,
+    // Xex2MapImage input), xex_patcher.cpp (title update deltas) and the LZX and AES
+    // backends. The key only sees the input files, so a fixed decoder would otherwise
+    // keep serving images decoded by the broken one.
+    constexpr uint32_t CacheVersion = 1;
+
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        XexImageCache::Key key;
+        uint32_t base;
+        uint32_t imageSize;
+        uint32_t chunkSize;
+        uint32_t chunkCount;
+        uint64_t coldTicks;
+    };
+
+    size_t ChunkCount(size_t imageSize)
+    {
+        return (imageSize + XexImageCache::CacheChunkSize - 1) / XexImageCache::CacheChunkSize;
+    }
+
+    struct FileCloser
+    {
+        void operator()(FILE* file) const
+        {
+            fclose(file);
+        }
+    };
+
+    using File = std::unique_ptr<FILE, FileCloser>;
+
+} // namespace
+
+XexImageCache::Key XexImageCache::ComputeKey(const char* xexPath, const uint8_t* headers, size_t headerSize,
+    const void* extra, size_t extraSize)
+{
+    Sha1::Context sha;
+    sha.Update(&CacheVersion, sizeof(CacheVersion));
+    sha.Update(headers, headerSize);
+
+    struct stat info{};
+    if (stat(xexPath, &info) == 0)
+    {
+        const uint64_t stamp[2] = { uint64_t(info.st_size), uint64_t(info.st_mtime) };
+        sha.Update(stamp, sizeof(stamp));
+    }
+
+    if (extraSize != 0)
+        sha.Update(extra, extraSize);
+
+    Key key;
+    sha.Final(key.data());
+    return key;
+}
+
+bool XexImageCache::Load(const char* path, const Key& key, uint32_t base, uint8_t* destination, size_t& imageSize,
+    bool verify, uint64_t& coldTicks)
+{
+    File file(fopen(path, "rb"));
+    if (!file)
+        return false;
+
+    FileHeader header{};
+    if (fread(&header, sizeof(header), 1, file.get()) != 1 || header.magic != CacheMagic || header.version != CacheVersion)
+    {
+        SDLogger::Log("XexImageCache - %s is not a cache entry of this version", path);
+        return false;
+    }
+
+    if (header.key != key || header.base != base)
+    {
+        SDLogger::Log("XexImageCache - %s was stored for another XEX", path);
+        return false;
+    }
+
+    if (header.chunkSize != CacheChunkSize || header.chunkCount != ChunkCount(header.imageSize)
+        || uint64_t(base) + header.imageSize > 0x100000000ull)
+    {
+        SDLogger::Log("XexImageCache - %s has a malformed header", path);
+        return false;
+    }
+
+    std::vector<XexBlockHash> chunks(header.chunkCount);
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        const size_t offset = i * CacheChunkSize;
+        chunks[i].data = destination + offset;
+        chunks[i].size = uint32_t(std::min(CacheChunkSize, header.imageSize - offset));
+
+        if (fread(chunks[i].expected, sizeof(chunks[i].expected), 1, file.get()) != 1)
+        {
+            SDLogger::Log("XexImageCache - short read in the chunk table of %s", path);
+            return false;
+        }
+    }
+
+    if (fread(destination, 1, header.imageSize, file.get()) != header.imageSize)
+    {
+        SDLogger::Log("XexImageCache - short read in the image of %s", path);
+        return false;
+    }
+
+    if (verify)
+    {
+        XexBlockVerifier verifier;
+        const ptrdiff_t failed = verifier.Verify(chunks.data(), chunks.size());
+        if (failed >= 0)
+        {
+            SDLogger::Log("XexImageCache - chunk %td of %s does not match its hash", failed, path);
+            return false;
+        }
+    }
+
+    imageSize = header.imageSize;
+    coldTicks = header.coldTicks;
+    return true;
+}
+
+bool XexImageCache::Store(const char* path, const Key& key, uint32_t base, const uint8_t* image, size_t imageSize,
+    uint64_t coldTicks)
+{
+    FileHeader header{};
+    header.magic = CacheMagic;
+    header.version = CacheVersion;
+    header.key = key;
+    header.base = base;
+    header.imageSize = uint32_t(imageSize);
+    header.chunkSize = CacheChunkSize;
+    header.chunkCount = uint32_t(ChunkCount(imageSize));
+    header.coldTicks = coldTicks;
+
+    std::vector<uint8_t> digests(header.chunkCount * Sha1::DigestSize);
+    for (size_t i = 0; i < header.chunkCount; i++)
+    {
+        const size_t offset = i * CacheChunkSize;
+        Sha1::Hash(image + offset, std::min(CacheChunkSize, imageSize - offset), &digests[i * Sha1::DigestSize]);
+    }
+
+    const std::string temporary = std::string(path) + ".tmp";
+    {
+        File file(fopen(temporary.c_str(), "wb"));
+        if (!file)
+        {
+            SDLogger::Log("XexImageCache - could not create %s", temporary.c_str());
+            return false;
+        }
+
+        bool written = fwrite(&header, sizeof(header), 1, file.get()) == 1
+            && fwrite(digests.data(), 1, digests.size(), file.get()) == digests.size()
+            && fwrite(image, 1, imageSize, file.get()) == imageSize;
+
+        // fclose flushes, so its result belongs to the write as well.
+        written = fclose(file.release()) == 0 && written;
+        if (!written)
+        {
+            SDLogger::Log("XexImageCache - could not write %s", temporary.c_str());
+            remove(temporary.c_str());
+            return false;
+        }
+    }
+
+    // FAT will not rename over an existing file.
+    remove(path);
+    if (rename(temporary.c_str(), path) != 0)
+    {
+        SDLogger::Log("XexImageCache - could not rename %s to %s", temporary.c_str(), path);
+        remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "sha1_engine.h"
+
+// A copy of the decompressed XEX image on the SD card, so a boot with an unchanged XEX
+// reads the image straight into guest memory instead of decrypting and decompressing it
+// again. The copy is taken before the import thunks are patched; the XEX headers are
+// still read on every boot and Xex2MapImage rebuilds sections, entry point, resources and
+// thunks from them, so a cached boot produces the same Image as a cold one.
+//
+// File layout: FileHeader, one SHA-1 per CacheChunkSize bytes of image, then the image.
+namespace XexImageCache {
+
+    using Key = std::array<uint8_t, Sha1::DigestSize>;
+
+    constexpr size_t CacheChunkSize = 1024 * 1024;
+
+    // SHA-1 over the XEX headers, the XEX's size and modification time, and `extraSize`
+    // bytes of `extra`. The headers carry the security info, whose image digest and AES key
+    // change with any rebuild of the XEX; the file stamp catches edits in place. Hashing
+    // the payload itself would mean reading the whole XEX on a warm boot. Changes to the
+    // decoding code are covered by CacheVersion in xex_image_cache.cpp, not by the key.
+    Key ComputeKey(const char* xexPath, const uint8_t* headers, size_t headerSize, const void* extra = nullptr,
+        size_t extraSize = 0);
+
+    // Reads the entry at `path` into `destination` if it was stored for `key` at `base`.
+    // With `verify` every chunk is hashed on all cores against the stored table. On a
+    // miss `destination` may have been partly written. `coldTicks` receives the load time
+    // recorded when the entry was stored.
+    bool Load(const char* path, const Key& key, uint32_t base, uint8_t* destination, size_t& imageSize, bool verify,
+        uint64_t& coldTicks);
+
+    // Writes the entry to a temporary file and renames it over `path`, so an interrupted
+    // write never leaves a truncated entry behind under the real name.
+    bool Store(const char* path, const Key& key, uint32_t base, const uint8_t* image, size_t imageSize, uint64_t coldTicks);
+
+} // namespace XexImageCache
@@ -0,0 +1,733 @@
+#include "xex_loader.h"
+#include "xex.h"
+#include "xex_image_cache.h"
+#include "xex_patcher.h"
+#include "memory.h"
+#include "aes_cbc.h"
+#include "sha1_engine.h"
+#include "lzx.h"
+#include <mspack.h>
+#include "nx/fs/fs_helpers.h"
+#include "nx/log/nxlogger.h"
+#include <switch.h>
+#include <malloc.h>
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+    // A multiple of the AES block, so CBC chaining carries over from one read to the next.
+    constexpr size_t ReadChunkSize = 256 * 1024;
+    constexpr int LzxInputBufferSize = 0x8000;
+
+    // Compressed blocks read, and hashed in parallel, at a time. A block larger than this
+    // still makes a window of its own.
+    constexpr size_t VerifyWindowSize = 2 * 1024 * 1024;
+
+    size_t HeapInUse()
+    {
+        return mallinfo().uordblks;
+    }
+
+    void SampleHeap(XexLoadStats& stats)
+    {
+        stats.peakHeap = std::max(stats.peakHeap, HeapInUse());
+    }
+
+    // The decrypted bytes that follow the XEX headers, in file order.
+    class PayloadStream
+    {
+    public:
+        PayloadStream(BinaryReader& file, size_t offset, size_t size, XexLoadStats& stats)
+            : file(file), fileOffset(offset), fileRemaining(size), stats(stats)
+        {
+            stats.peakBuffers += ReadChunkSize;
+        }
+
+        void SetKey(const uint8_t* key)
+        {
+            AesCbc::Init(aes, key, AESBlankIV);
+            encrypted = true;
+        }
+
+        size_t GetRemaining() const
+        {
+            return fileRemaining + (chunkEnd - chunkPosition);
+        }
+
+        bool Read(void* destination, size_t size)
+        {
+            auto* out = static_cast<uint8_t*>(destination);
+
+            while (size != 0)
+            {
+                if (chunkPosition == chunkEnd)
+                {
+                    // Large reads skip the staging chunk and are decrypted where they land.
+                    if (size >= ReadChunkSize)
+                    {
+                        const size_t direct = Fetch(out, size & ~(AesCbc::BlockSize - 1));
+                        if (direct == 0)
+                            return false;
+
+                        out += direct;
+                        size -= direct;
+                        continue;
+                    }
+
+                    chunkPosition = 0;
+                    chunkEnd = Fetch(chunk.get(), ReadChunkSize);
+
+                    if (chunkEnd == 0)
+                        return false;
+                }
+
+                const size_t copy = std::min(size, chunkEnd - chunkPosition);
+                memcpy(out, chunk.get() + chunkPosition, copy);
+
+                chunkPosition += copy;
+                out += copy;
+                size -= copy;
+            }
+
+            return true;
+        }
+
+    private:
+        size_t Fetch(uint8_t* destination, size_t size)
+        {
+            size = std::min(size, fileRemaining);
+            if (size == 0)
+                return 0;
+
+            uint64_t start = armGetSystemTick();
+            const size_t read = file.ReadAt(fileOffset, destination, size);
+            stats.readTicks += armGetSystemTick() - start;
+
+            if (read != size)
+                return 0;
+
+            fileOffset += read;
+            fileRemaining -= read;
+
+            if (encrypted)
+            {
+                // Only the last read can end mid-block; the payload is padded to whole blocks.
+                start = armGetSystemTick();
+                AesCbc::Decrypt(aes, destination, read & ~(AesCbc::BlockSize - 1));
+                stats.decryptTicks += armGetSystemTick() - start;
+            }
+
+            return read;
+        }
+
+        BinaryReader& file;
+        size_t fileOffset;
+        size_t fileRemaining;
+
+        std::unique_ptr<uint8_t[]> chunk{ std::make_unique<uint8_t[]>(ReadChunkSize) };
+        size_t chunkPosition{};
+        size_t chunkEnd{};
+
+        AesCbc::Context aes{};
+        bool encrypted{};
+
+        XexLoadStats& stats;
+    };
+
+    // LZX input of a normally compressed XEX: a chain of blocks, each SHA-1 checked by the
+    // one before it (the first by the file format header), holding the size and hash of
+    // the next block followed by length-prefixed chunks of compressed data.
+    //
+    // Blocks are read a window at a time. The chain only needs each block's header to find
+    // the next one, so the whole window is read before any hash is checked, and the hashes
+    // are then spread over the verifier's threads.
+    class BlockReader
+    {
+    public:
+        BlockReader(PayloadStream& payload, const Xex2CompressedBlockInfo& first, XexVerifyMode verify, XexBlockVerifier& verifier,
+            XexLoadStats& stats)
+            : payload(payload), verify(verify), verifier(verifier), nextSize(first.blockSize), stats(stats)
+        {
+            memcpy(nextHash, first.blockHash, sizeof(nextHash));
+        }
+
+        ~BlockReader()
+        {
+            // The verifier may still be reading the window.
+            if (pending)
+                verifier.Wait();
+        }
+
+        bool Failed() const
+        {
+            return failed;
+        }
+
+        // The decompressor can stop before the end of the chain; a deferred window still has
+        // to be checked before the image is trusted.
+        bool Finish()
+        {
+            return Settle() && !failed;
+        }
+
+        int Read(uint8_t* buffer, int bytes)
+        {
+            int total = 0;
+
+            while (total < bytes)
+            {
+                if (chunkRemaining == 0)
+                {
+                    if (position + 2 <= blockEnd)
+                    {
+                        chunkRemaining = (window[position] << 8) | window[position + 1];
+                        position += 2;
+
+                        if (position + chunkRemaining > blockEnd)
+                        {
+                            SDLogger::Log("XexLoader - chunk overruns block %u", stats.blockCount - 1);
+                            failed = true;
+                            return -1;
+                        }
+                    }
+
+                    // A zero length ends the block's chunks.
+                    if (chunkRemaining == 0 && !NextBlock())
+                        return failed ? -1 : total;
+
+                    continue;
+                }
+
+                const size_t copy = std::min(chunkRemaining, size_t(bytes - total));
+                memcpy(buffer + total, window.data() + position, copy);
+
+                position += copy;
+                chunkRemaining -= copy;
+                total += int(copy);
+            }
+
+            return total;
+        }
+
+    private:
+        bool NextBlock()
+        {
+            if (current + 1 < blocks.size())
+            {
+                Enter(current + 1);
+                return true;
+            }
+
+            return Settle() && FillWindow();
+        }
+
+        void Enter(size_t index)
+        {
+            current = index;
+            position = blocks[index].data - window.data() + sizeof(Xex2CompressedBlockInfo);
+            blockEnd = blocks[index].data - window.data() + blocks[index].size;
+            chunkRemaining = 0;
+
+            stats.blockCount++;
+        }
+
+        bool FillWindow()
+        {
+            blocks.clear();
+            windowFirst = stats.blockCount;
+
+            size_t used = 0;
+            while (nextSize != 0 && used < VerifyWindowSize)
+            {
+                const uint32_t index = windowFirst + uint32_t(blocks.size());
+
+                if (nextSize < sizeof(Xex2CompressedBlockInfo) || nextSize > payload.GetRemaining())
+                {
+                    SDLogger::Log("XexLoader - block %u has invalid size 0x%X", index, nextSize);
+                    failed = true;
+                    return false;
+                }
+
+                if (window.size() < used + nextSize)
+                {
+                    stats.peakBuffers += used + nextSize - window.size();
+                    window.resize(used + nextSize);
+                    SampleHeap(stats);
+                }
+
+                if (!payload.Read(window.data() + used, nextSize))
+                {
+                    SDLogger::Log("XexLoader - short read in block %u", index);
+                    failed = true;
+                    return false;
+                }
+
+                XexBlockHash& block = blocks.emplace_back();
+                block.size = nextSize;
+                memcpy(block.expected, nextHash, sizeof(block.expected));
+
+                const auto* next = reinterpret_cast<const Xex2CompressedBlockInfo*>(window.data() + used);
+                used += nextSize;
+                nextSize = next->blockSize;
+                memcpy(nextHash, next->blockHash, sizeof(nextHash));
+            }
+
+            if (blocks.empty())
+                return false;
+
+            // Only now that the window has stopped growing do the block addresses hold.
+            const uint8_t* data = window.data();
+            for (auto& block : blocks)
+            {
+                block.data = data;
+                data += block.size;
+            }
+
+            if (verify == XexVerifyMode::Full)
+            {
+                const uint64_t start = armGetSystemTick();
+                const ptrdiff_t failure = verifier.Verify(blocks.data(), blocks.size());
+                stats.verifyTicks += armGetSystemTick() - start;
+
+                if (failure >= 0)
+                {
+                    SDLogger::Log("XexLoader - block %u failed SHA-1 verification", windowFirst + uint32_t(failure));
+                    failed = true;
+                    return false;
+                }
+            }
+            else if (verify == XexVerifyMode::Deferred)
+            {
+                verifier.Begin(blocks.data(), blocks.size());
+                pending = true;
+            }
+
+            Enter(0);
+            return true;
+        }
+
+        // Waits for the hashes of a deferred window; only the wait shows up as verify time.
+        bool Settle()
+        {
+            if (!pending)
+                return true;
+
+            pending = false;
+
+            const uint64_t start = armGetSystemTick();
+            const ptrdiff_t failure = verifier.Wait();
+            stats.verifyTicks += armGetSystemTick() - start;
+
+            if (failure >= 0)
+            {
+                SDLogger::Log("XexLoader - block %u failed deferred SHA-1 verification", windowFirst + uint32_t(failure));
+                failed = true;
+                return false;
+            }
+
+            return true;
+        }
+
+        PayloadStream& payload;
+        XexVerifyMode verify;
+        XexBlockVerifier& verifier;
+
+        std::vector<uint8_t> window;
+        std::vector<XexBlockHash> blocks;
+        uint32_t windowFirst{};
+        size_t current{};
+        size_t blockEnd{};
+        size_t position{};
+        size_t chunkRemaining{};
+        bool pending{};
+
+        uint32_t nextSize;
+        uint8_t nextHash[0x14];
+        bool failed{};
+
+        XexLoadStats& stats;
+    };
+
+    // What lzxd sees as its input and output files.
+    struct LzxFile
+    {
+        BlockReader* input;
+        uint8_t* output;
+        size_t outputSize;
+        size_t outputOffset;
+    };
+
+    struct LzxSystem
+    {
+        mspack_system sys;
+        XexLoadStats* stats;
+    };
+
+    int LzxRead(mspack_file* file, void* buffer, int bytes)
+    {
+        return reinterpret_cast<LzxFile*>(file)->input->Read(static_cast<uint8_t*>(buffer), bytes);
+    }
+
+    int LzxWrite(mspack_file* file, void* buffer, int bytes)
+    {
+        auto* output = reinterpret_cast<LzxFile*>(file);
+        const size_t total = std::min(size_t(bytes), output->outputSize - output->outputOffset);
+
+        memcpy(output->output + output->outputOffset, buffer, total);
+        output->outputOffset += total;
+        return int(total);
+    }
+
+    void* LzxAlloc(mspack_system* sys, size_t bytes)
+    {
+        reinterpret_cast<LzxSystem*>(sys)->stats->peakBuffers += bytes;
+        return calloc(bytes, 1);
+    }
+
+    void LzxFree(void* pointer)
+    {
+        free(pointer);
+    }
+
+    void LzxCopy(void* source, void* destination, size_t bytes)
+    {
+        memcpy(destination, source, bytes);
+    }
+
+    bool Decompress(PayloadStream& payload, const Xex2FileNormalCompressionInfo* info, uint8_t* destination, size_t imageSize,
+        XexVerifyMode verify, XexLoadStats& stats)
+    {
+        const uint32_t windowSize = info->windowSize;
+        if (!std::has_single_bit(windowSize))
+        {
+            SDLogger::Log("XexLoader - invalid LZX window size 0x%X", windowSize);
+            return false;
+        }
+
+        // With verification deferred the calling thread is busy decompressing, so the
+        // workers are the only ones hashing; skipping it needs no workers at all.
+        XexBlockVerifier verifier(verify == XexVerifyMode::Skip ? 1 : XexBlockVerifier::MaxThreads);
+        BlockReader blocks(payload, info->firstBlock, verify, verifier, stats);
+
+        LzxSystem system{};
+        system.sys.read = LzxRead;
+        system.sys.write = LzxWrite;
+        system.sys.alloc = LzxAlloc;
+        system.sys.free = LzxFree;
+        system.sys.copy = LzxCopy;
+        system.stats = &stats;
+
+        LzxFile input{ &blocks, nullptr, 0, 0 };
+        LzxFile output{ nullptr, destination, imageSize, 0 };
+
+        // Time spent inside the read callback is charged to read/decrypt/verify.
+        const uint64_t inner = stats.readTicks + stats.decryptTicks + stats.verifyTicks;
+        const uint64_t start = armGetSystemTick();
+
+        lzxd_stream* lzxd = lzxd_init(&system.sys, reinterpret_cast<mspack_file*>(&input), reinterpret_cast<mspack_file*>(&output),
+            std::countr_zero(windowSize), 0, LzxInputBufferSize, imageSize, 0);
+
+        if (lzxd == nullptr)
+            return false;
+
+        SampleHeap(stats);
+
+        const int result = lzxd_decompress(lzxd, imageSize);
+        lzxd_free(lzxd);
+
+        const bool verified = blocks.Finish();
+
+        stats.decompressTicks += (armGetSystemTick() - start) - (stats.readTicks + stats.decryptTicks + stats.verifyTicks - inner);
+
+        if (!verified)
+            return false;
+
+        if (result != MSPACK_ERR_OK)
+        {
+            SDLogger::Log("XexLoader - LZX decompression failed (%d)", result);
+            return false;
+        }
+
+        return true;
+    }
+
+    // Decrypts and unpacks the payload that follows the headers into `destination`.
+    bool ReadImage(BinaryReader& file, size_t headerSize, const Xex2SecurityInfo* security,
+        const Xex2OptFileFormatInfo* fileFormatInfo, uint8_t* destination, size_t& imageSize, XexVerifyMode verify,
+        XexLoadStats& s)
+    {
+        PayloadStream payload(file, headerSize, s.fileSize - headerSize, s);
+
+        if (fileFormatInfo->encryptionType == XEX_ENCRYPTION_NORMAL)
+        {
+            AesCbc::Context aesContext;
+            uint8_t key[16];
+
+            memcpy(key, security->aesKey, sizeof(key));
+            AesCbc::Init(aesContext, Xex2RetailKey, AESBlankIV);
+            AesCbc::Decrypt(aesContext, key, sizeof(key));
+
+            payload.SetKey(key);
+        }
+
+        if (fileFormatInfo->compressionType == XEX_COMPRESSION_NONE)
+        {
+            if (!payload.Read(destination, imageSize))
+            {
+                SDLogger::Log("XexLoader - short read in the image");
+                return false;
+            }
+        }
+        else if (fileFormatInfo->compressionType == XEX_COMPRESSION_BASIC)
+        {
+            auto* blocks = reinterpret_cast<const Xex2FileBasicCompressionBlock*>(fileFormatInfo + 1);
+            const size_t numBlocks = (fileFormatInfo->infoSize / sizeof(Xex2FileBasicCompressionInfo)) - 1;
+
+            // Like LzxWrite, never write past the image the security info declares.
+            const size_t capacity = imageSize;
+
+            imageSize = 0;
+            for (size_t i = 0; i < numBlocks; i++)
+            {
+                if (uint64_t(blocks[i].dataSize) + blocks[i].zeroSize > capacity - imageSize)
+                {
+                    SDLogger::Log("XexLoader - block %zu runs past the 0x%zX byte image", i, capacity);
+                    return false;
+                }
+
+                if (!payload.Read(destination + imageSize, blocks[i].dataSize))
+                {
+                    SDLogger::Log("XexLoader - short read in block %zu", i);
+                    return false;
+                }
+
+                memset(destination + imageSize + blocks[i].dataSize, 0, blocks[i].zeroSize);
+                imageSize += blocks[i].dataSize + blocks[i].zeroSize;
+            }
+
+            s.blockCount = uint32_t(numBlocks);
+        }
+        else if (!Decompress(payload, reinterpret_cast<const Xex2FileNormalCompressionInfo*>(fileFormatInfo + 1), destination, imageSize, verify, s))
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+    // The whole .xexp: headers, then the delta blocks that applyImage decrypts in place.
+    // A title update is a small fraction of the XEX it patches.
+    bool ReadPatch(const char* patchPath, std::vector<uint8_t>& patch)
+    {
+        BinaryReader patchFile;
+        if (!patchFile.Open(patchPath) || !patchFile.ReadAll(patch))
+        {
+            SDLogger::Log("XexLoader - could not read %s", patchPath);
+            return false;
+        }
+
+        const auto* patchHeader = reinterpret_cast<const Xex2Header*>(patch.data());
+        if (patch.size() < sizeof(Xex2Header) || patchHeader->magic != 'XEX2' || patchHeader->headerSize > patch.size())
+        {
+            SDLogger::Log("XexLoader - %s is not an XEX2 patch", patchPath);
+            return false;
+        }
+
+        return true;
+    }
+
+    // Applies the patch's delta blocks to the base image in guest memory, growing it to
+    // the patched size.
+    bool ApplyPatch(std::vector<uint8_t>& patch, const uint8_t* patchKey, uint8_t* destination, size_t& imageSize,
+        size_t patchedSize, XexLoadStats& s)
+    {
+        const uint64_t start = armGetSystemTick();
+        const size_t patchHeaderSize = reinterpret_cast<const Xex2Header*>(patch.data())->headerSize;
+
+        // XexPatcher::apply starts the patched image zeroed as well.
+        if (patchedSize > imageSize)
+            memset(destination + imageSize, 0, patchedSize - imageSize);
+
+        size_t lzxBytes = 0;
+        const auto result = XexPatcher::applyImage(patch.data(), patch.data() + patchHeaderSize, patch.size() - patchHeaderSize,
+            patchKey, destination, patchedSize, &lzxBytes);
+
+        s.peakBuffers += lzxBytes;
+        s.patchTicks += armGetSystemTick() - start;
+
+        if (result != XexPatcher::Result::Success)
+        {
+            SDLogger::Log("XexLoader - patching the image failed (%d)", int(result));
+            return false;
+        }
+
+        imageSize = patchedSize;
+        return true;
+    }
+
+} // namespace
+
+void XexLoadStats::Report() const
+{
+    auto ms = [](uint64_t ticks)
+        {
+            return (unsigned long long)(armTicksToNs(ticks) / 1'000'000);
+        };
+
+    SDLogger::Log("XexLoader - %zu KiB file -> %zu KiB image, %u blocks, %llu ms", fileSize / 1024, imageSize / 1024,
+        blockCount, ms(totalTicks));
+    SDLogger::Log("XexLoader - read %llu ms, decrypt %llu ms (%s), verify %llu ms (%s), decompress %llu ms", ms(readTicks),
+        ms(decryptTicks), AesCbc::GetBackendName(AesCbc::GetBackend()), ms(verifyTicks), Sha1::GetBackendName(Sha1::GetBackend()),
+        ms(decompressTicks));
+    SDLogger::Log("XexLoader - loader buffers %zu KiB, heap in use %zu KiB before, %zu KiB peak", peakBuffers / 1024,
+        heapBefore / 1024, peakHeap / 1024);
+
+    if (patchSize != 0)
+        SDLogger::Log("XexLoader - %zu KiB title update patched in at load time, %llu ms", patchSize / 1024, ms(patchTicks));
+
+    if (cacheHit)
+        SDLogger::Log("XexLoader - warm boot from the image cache in %llu ms, cold boot was %llu ms", ms(totalTicks),
+            ms(coldTicks));
+    else if (cacheStored)
+        SDLogger::Log("XexLoader - cold boot %llu ms, image cache written in %llu ms", ms(coldTicks), ms(cacheTicks));
+}
+
+Image XexLoader::Load(const char* path, XexLoadStats* stats, XexVerifyMode verify, const char* cachePath, const char* patchPath)
+{
+    XexLoadStats localStats;
+    XexLoadStats& s = stats != nullptr ? *stats : localStats;
+
+    s = {};
+    s.heapBefore = HeapInUse();
+    s.peakHeap = s.heapBefore;
+
+    const uint64_t start = armGetSystemTick();
+
+    BinaryReader file;
+    if (!file.Open(path))
+    {
+        SDLogger::Log("XexLoader - could not open %s", path);
+        return {};
+    }
+
+    s.fileSize = file.GetSize();
+
+    Xex2Header fileHeader{};
+    if (file.ReadAt(0, &fileHeader, sizeof(fileHeader)) != sizeof(fileHeader) || fileHeader.magic != 'XEX2'
+        || fileHeader.headerSize < sizeof(fileHeader) || fileHeader.headerSize > s.fileSize)
+    {
+        SDLogger::Log("XexLoader - %s is not an XEX2 image", path);
+        return {};
+    }
+
+    const size_t headerSize = fileHeader.headerSize;
+    size_t headerReadSize = headerSize;
+
+    // A title update is applied while loading instead of to a patched copy of the XEX:
+    // the base headers are patched once read, the image once it is in guest memory. The
+    // header delta may read past the end of the base headers.
+    std::vector<uint8_t> patch;
+    if (patchPath != nullptr)
+    {
+        const uint64_t patchStart = armGetSystemTick();
+        if (!ReadPatch(patchPath, patch))
+            return {};
+
+        s.patchSize = patch.size();
+        s.peakBuffers += patch.size();
+        s.patchTicks += armGetSystemTick() - patchStart;
+
+        headerReadSize = std::min(s.fileSize, std::max(headerSize, size_t(XexPatcher::targetHeaderSize(patch.data(), patch.size()))));
+    }
+
+    // Optional headers, security info and the import table, all kept until mapping is done.
+    std::vector<uint8_t> headers(headerReadSize);
+    s.peakBuffers += headerReadSize;
+
+    if (file.ReadAt(0, headers.data(), headerReadSize) != headerReadSize)
+    {
+        SDLogger::Log("XexLoader - short read in the XEX headers");
+        return {};
+    }
+
+    const uint8_t* data = headers.data();
+    const auto* security = reinterpret_cast<const Xex2SecurityInfo*>(data + fileHeader.securityOffset);
+    const auto* fileFormatInfo = reinterpret_cast<const Xex2OptFileFormatInfo*>(getOptHeaderPtr(data, XEX_HEADER_FILE_FORMAT_INFO));
+
+    if (fileFormatInfo == nullptr || fileFormatInfo->compressionType > XEX_COMPRESSION_NORMAL)
+    {
+        SDLogger::Log("XexLoader - unsupported file format");
+        return {};
+    }
+
+    std::vector<uint8_t> patchedHeaders;
+    uint8_t patchKey[16];
+    if (!patch.empty())
+    {
+        const uint64_t patchStart = armGetSystemTick();
+        uint8_t baseKey[16];
+        const auto result = XexPatcher::applyHeaders(data, headers.size(), patch.data(), patch.size(), patchedHeaders, baseKey, patchKey);
+        s.patchTicks += armGetSystemTick() - patchStart;
+
+        if (result != XexPatcher::Result::Success)
+        {
+            SDLogger::Log("XexLoader - %s does not apply to %s (%d)", patchPath, path, int(result));
+            return {};
+        }
+
+        s.peakBuffers += patchedHeaders.size();
+    }
+
+    // The base headers decode the payload; the image that ends up in memory is described
+    // by the patched ones when there is a patch.
+    const uint8_t* imageHeaders = patch.empty() ? data : patchedHeaders.data();
+    const auto* imageSecurity = reinterpret_cast<const Xex2SecurityInfo*>(
+        imageHeaders + reinterpret_cast<const Xex2Header*>(imageHeaders)->securityOffset);
+
+    Image image{};
+    image.base = Xex2GetImageBase(imageHeaders);
+
+    auto* destination = static_cast<uint8_t*>(g_memory.Translate(image.base));
+    size_t imageSize = security->imageSize;
+    SampleHeap(s);
+
+    XexImageCache::Key cacheKey{};
+    if (cachePath != nullptr)
+    {
+        const uint64_t cacheStart = armGetSystemTick();
+        cacheKey = XexImageCache::ComputeKey(path, data, headerSize, patch.data(), patch.size());
+        s.cacheHit = XexImageCache::Load(cachePath, cacheKey, image.base, destination, imageSize,
+            verify != XexVerifyMode::Skip, s.coldTicks);
+        s.cacheTicks = armGetSystemTick() - cacheStart;
+    }
+
+    if (!s.cacheHit && !ReadImage(file, headerSize, security, fileFormatInfo, destination, imageSize, verify, s))
+        return {};
+
+    if (!s.cacheHit && !patch.empty() && !ApplyPatch(patch, patchKey, destination, imageSize, imageSecurity->imageSize, s))
+        return {};
+
+    file.Close();
+
+    // Stored before Xex2MapImage patches the import thunks, which it redoes on every boot.
+    if (cachePath != nullptr && !s.cacheHit)
+    {
+        const uint64_t storeStart = armGetSystemTick();
+        s.coldTicks = storeStart - start;
+        s.cacheStored = XexImageCache::Store(cachePath, cacheKey, image.base, destination, imageSize, s.coldTicks);
+        s.cacheTicks += armGetSystemTick() - storeStart;
+    }
+
+    image.size = imageSize;
+    Xex2MapImage(image, imageHeaders, destination);
+
+    s.imageSize = imageSize;
+    s.totalTicks = armGetSystemTick() - start;
+    SampleHeap(s);
+
+    return image;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "image.h"
+#include "xex_verify.h"
+
+struct XexLoadStats
+{
+    size_t fileSize{};
+    size_t imageSize{};
+    uint32_t blockCount{};
+
+    uint64_t totalTicks{};
+    uint64_t readTicks{};
+    uint64_t decryptTicks{};
+    uint64_t verifyTicks{};
+    uint64_t decompressTicks{};
+
+    // High-water mark of the loader's own buffers, and of the C heap in use while loading
+    // (Horizon has no RSS counter; everything the loader touches outside guest memory
+    // comes from the heap).
+    size_t peakBuffers{};
+    size_t heapBefore{};
+    size_t peakHeap{};
+
+    // Image cache: whether the image came from it or was written to it, the time spent
+    // reading or writing it, and the load time of the cold boot that filled it.
+    bool cacheHit{};
+    bool cacheStored{};
+    uint64_t cacheTicks{};
+    uint64_t coldTicks{};
+
+    // Title update applied at load time: its size, and the time spent reading it and
+    // patching headers and image.
+    size_t patchSize{};
+    uint64_t patchTicks{};
+
+    void Report() const;
+};
+
+namespace XexLoader {
+
+    // Streams the XEX at `path` into guest memory at its load address. The payload is read
+    // in fixed-size chunks, CBC-decrypted as it arrives, and compressed blocks are SHA-1
+    // checked on all cores a window at a time before their LZX data is handed to the
+    // decompressor, which writes the image in place. The working set is one read chunk,
+    // one window of compressed blocks and the LZX window, instead of copies of the whole
+    // file and image.
+    //
+    // `verify` only matters for normally compressed images and cache entries; see
+    // XexVerifyMode.
+    //
+    // With `cachePath` the image is read from that XexImageCache entry when it matches the
+    // XEX, and otherwise loaded as above and written there for the next boot.
+    //
+    // With `patchPath` the .xexp title update there is applied on the way in, with the
+    // same result as loading the XEX that XexPatcher::apply writes. The patched headers are
+    // built from the base ones and the delta blocks are applied to the image in guest
+    // memory, so neither a patched file nor a second copy of the image is needed. The
+    // patch is part of the cache key.
+    //
+    // The returned Image owns no data: its sections point into guest memory. On failure it
+    // is empty (size 0).
+    Image Load(const char* path, XexLoadStats* stats = nullptr, XexVerifyMode verify = XexVerifyMode::Full,
+        const char* cachePath = nullptr, const char* patchPath = nullptr);
+
+} // namespace XexLoader
@@ -18,6 +18,8 @@
 #include <fstream>
 
 #include "aes.hpp"
+#include "aes_cbc.h"
+#include "sha1_engine.h"
 #include "lzx.h"
 #include <mspack.h>
 #include "TinySHA1.hpp"
@@ -114,6 +116,77 @@ static void mspack_memory_sys_destroy(struct mspack_system *sys)
     free(sys);
 }
 
+// Keeps the blocks lzxd_init allocates (the stream, its window and its input buffer) for
+// the next stream instead of returning them to the heap, so the delta blocks of a patch
+// all decompress through one LZX window. Streams are created and freed one at a time and
+// allocate the same sizes in the same order, so blocks are simply handed out again in
+// order; lzxd_free releases nothing and the pool frees everything when it is destroyed.
+struct mspack_pool_system
+{
+    mspack_system sys;
+    std::vector<std::pair<void *, size_t>> blocks;
+    size_t next = 0;
+    size_t bytes = 0;
+
+    mspack_pool_system();
+    ~mspack_pool_system();
+};
+
+static void *mspack_pool_alloc(mspack_system *sys, size_t chars)
+{
+    mspack_pool_system *pool = (mspack_pool_system *)(sys);
+    if (pool->next < pool->blocks.size() && pool->blocks[pool->next].second == chars)
+    {
+        // Same contract as calloc.
+        void *ptr = pool->blocks[pool->next++].first;
+        std::memset(ptr, 0, chars);
+        return ptr;
+    }
+
+    void *ptr = std::calloc(chars, 1);
+    if (ptr == nullptr)
+    {
+        return nullptr;
+    }
+
+    if (pool->next < pool->blocks.size())
+    {
+        pool->bytes -= pool->blocks[pool->next].second;
+        std::free(pool->blocks[pool->next].first);
+        pool->blocks[pool->next] = { ptr, chars };
+    }
+    else
+    {
+        pool->blocks.emplace_back(ptr, chars);
+    }
+
+    pool->next++;
+    pool->bytes += chars;
+    return ptr;
+}
+
+static void mspack_pool_free(void *ptr)
+{
+}
+
+mspack_pool_system::mspack_pool_system()
+{
+    sys = {};
+    sys.read = mspack_memory_read;
+    sys.write = mspack_memory_write;
+    sys.alloc = mspack_pool_alloc;
+    sys.free = mspack_pool_free;
+    sys.copy = mspack_memory_copy;
+}
+
+mspack_pool_system::~mspack_pool_system()
+{
+    for (auto &block : blocks)
+    {
+        std::free(block.first);
+    }
+}
+
 #if defined(_WIN32)
 inline bool bitScanForward(uint32_t v, uint32_t *outFirstSetIndex)
 {
@@ -141,7 +214,7 @@ inline bool bitScanForward(uint64_t v, uint32_t *outFirstSetIndex)
 }
 #endif
 
-int lzxDecompress(const void *lzxData, size_t lzxLength, void *dst, size_t dstLength, uint32_t windowSize, void *windowData, size_t windowDataLength)
+static int lzxDecompress(mspack_system *sys, const void *lzxData, size_t lzxLength, void *dst, size_t dstLength, uint32_t windowSize, void *windowData, size_t windowDataLength)
 {
     int resultCode = 1;
     uint32_t windowBits;
@@ -149,7 +222,6 @@ int lzxDecompress(const void *lzxData, size_t lzxLength, void *dst, size_t dstLe
         return resultCode;
     }
 
-    mspack_system *sys = mspack_memory_sys_create();
     mspack_memory_file *lzxSrc = mspack_memory_open(sys, (void *)(lzxData), lzxLength);
     mspack_memory_file *lzxDst = mspack_memory_open(sys, dst, dstLength);
     lzxd_stream *lzxd = lzxd_init(sys, (mspack_file *)(lzxSrc), (mspack_file *)(lzxDst), windowBits, 0, 0x8000, dstLength, 0);
@@ -173,14 +245,22 @@ int lzxDecompress(const void *lzxData, size_t lzxLength, void *dst, size_t dstLe
         mspack_memory_close(lzxDst);
     }
 
-    if (sys) {
-        mspack_memory_sys_destroy(sys);
+    return resultCode;
+}
+
+int lzxDecompress(const void *lzxData, size_t lzxLength, void *dst, size_t dstLength, uint32_t windowSize, void *windowData, size_t windowDataLength)
+{
+    mspack_system *sys = mspack_memory_sys_create();
+    if (sys == nullptr) {
+        return 1;
     }
 
+    int resultCode = lzxDecompress(sys, lzxData, lzxLength, dst, dstLength, windowSize, windowData, windowDataLength);
+    mspack_memory_sys_destroy(sys);
     return resultCode;
 }
 
-static int lzxDeltaApplyPatch(const Xex2DeltaPatch *deltaPatch, uint32_t patchLength, uint32_t windowSize, uint8_t *dstData)
+static int lzxDeltaApplyPatch(const Xex2DeltaPatch *deltaPatch, uint32_t patchLength, uint32_t windowSize, uint8_t *dstData, size_t dstLength, mspack_pool_system *pool)
 {
     const void *patchEnd = (const uint8_t *)(deltaPatch) + patchLength;
     const Xex2DeltaPatch *curPatch = deltaPatch;
@@ -193,6 +273,14 @@ static int lzxDeltaApplyPatch(const Xex2DeltaPatch *deltaPatch, uint32_t patchLe
             break;
         }
 
+        // The image may be guest memory, where nothing would catch a write past its end.
+        if (curPatch->newAddress + size_t(curPatch->uncompressedLength) > dstLength
+            || (curPatch->compressedLength != 0 && curPatch->oldAddress + size_t(curPatch->uncompressedLength) > dstLength)
+            || (curPatch->compressedLength > 1 && curPatch->uncompressedLength > windowSize))
+        {
+            return 1;
+        }
+
         switch (curPatch->compressedLength)
         {
         case 0:
@@ -201,12 +289,13 @@ static int lzxDeltaApplyPatch(const Xex2DeltaPatch *deltaPatch, uint32_t patchLe
             break;
         case 1:
             // Move the data.
-            std::memcpy(&dstData[curPatch->newAddress], &dstData[curPatch->oldAddress], curPatch->uncompressedLength);
+            std::memmove(&dstData[curPatch->newAddress], &dstData[curPatch->oldAddress], curPatch->uncompressedLength);
             break;
         default:
             // Decompress the data into the destination.
             patchSize = curPatch->compressedLength - 4;
-            int result = lzxDecompress(curPatch->patchData, curPatch->compressedLength, &dstData[curPatch->newAddress], curPatch->uncompressedLength, windowSize, &dstData[curPatch->oldAddress], curPatch->uncompressedLength);
+            pool->next = 0;
+            int result = lzxDecompress(&pool->sys, curPatch->patchData, curPatch->compressedLength, &dstData[curPatch->newAddress], curPatch->uncompressedLength, windowSize, &dstData[curPatch->oldAddress], curPatch->uncompressedLength);
             if (result != 0)
             {
                 return result;
@@ -222,7 +311,28 @@ static int lzxDeltaApplyPatch(const Xex2DeltaPatch *deltaPatch, uint32_t patchLe
     return 0;
 }
 
-XexPatcher::Result XexPatcher::apply(const uint8_t* xexBytes, size_t xexBytesSize, const uint8_t* patchBytes, size_t patchBytesSize, std::vector<uint8_t> &outBytes, bool skipData)
+uint32_t XexPatcher::targetHeaderSize(const uint8_t* patchBytes, size_t patchBytesSize)
+{
+    if (patchBytesSize < sizeof(Xex2Header) || memcmp(patchBytes, "XEX2", 4) != 0)
+    {
+        return 0;
+    }
+
+    const Xex2OptDeltaPatchDescriptor *patchDescriptor = (const Xex2OptDeltaPatchDescriptor *)(getOptHeaderPtr(patchBytes, XEX_HEADER_DELTA_PATCH_DESCRIPTOR));
+    if (patchDescriptor == nullptr)
+    {
+        return 0;
+    }
+
+    if (patchDescriptor->sizeOfTargetHeaders != 0)
+    {
+        return patchDescriptor->sizeOfTargetHeaders;
+    }
+
+    return patchDescriptor->deltaHeadersTargetOffset + patchDescriptor->deltaHeadersSourceSize;
+}
+
+XexPatcher::Result XexPatcher::applyHeaders(const uint8_t* xexBytes, size_t xexBytesSize, const uint8_t* patchBytes, size_t patchBytesSize, std::vector<uint8_t> &outHeaders, uint8_t* originalKey, uint8_t* patchKey)
 {
     // Validate headers.
     static const char Xex2Magic[] = "XEX2";
@@ -289,43 +399,47 @@ XexPatcher::Result XexPatcher::apply(const uint8_t* xexBytes, size_t xexBytesSiz
         headerTargetSize = patchDescriptor->deltaHeadersTargetOffset + patchDescriptor->deltaHeadersSourceSize;
     }
 
+    if (headerTargetSize > xexBytesSize)
+    {
+        return Result::PatchIncompatible;
+    }
+
     // Create the bytes for the new XEX header. Copy over the existing data.
     uint32_t newXexHeaderSize = std::max(headerTargetSize, xexHeader->headerSize.get());
-    outBytes.resize(newXexHeaderSize);
-    memset(outBytes.data(), 0, newXexHeaderSize);
-    memcpy(outBytes.data(), xexBytes, headerTargetSize);
+    outHeaders.resize(newXexHeaderSize);
+    memset(outHeaders.data(), 0, newXexHeaderSize);
+    memcpy(outHeaders.data(), xexBytes, headerTargetSize);
 
-    Xex2Header *newXexHeader = (Xex2Header *)(outBytes.data());
+    Xex2Header *newXexHeader = (Xex2Header *)(outHeaders.data());
     if (patchDescriptor->deltaHeadersSourceOffset > 0)
     {
-        memcpy(&outBytes[patchDescriptor->deltaHeadersTargetOffset], &outBytes[patchDescriptor->deltaHeadersSourceOffset], patchDescriptor->deltaHeadersSourceSize);
+        memcpy(&outHeaders[patchDescriptor->deltaHeadersTargetOffset], &outHeaders[patchDescriptor->deltaHeadersSourceOffset], patchDescriptor->deltaHeadersSourceSize);
     }
 
-    int resultCode = lzxDeltaApplyPatch(&patchDescriptor->info, patchDescriptor->size, ((const Xex2FileNormalCompressionInfo*)(patchFileFormatInfo + 1))->windowSize, outBytes.data());
+    mspack_pool_system pool;
+    int resultCode = lzxDeltaApplyPatch(&patchDescriptor->info, patchDescriptor->size, ((const Xex2FileNormalCompressionInfo*)(patchFileFormatInfo + 1))->windowSize, outHeaders.data(), outHeaders.size(), &pool);
     if (resultCode != 0)
     {
         return Result::PatchFailed;
     }
 
     // Make the header the specified size by the patch.
-    outBytes.resize(headerTargetSize);
-    newXexHeader = (Xex2Header *)(outBytes.data());
+    outHeaders.resize(headerTargetSize);
+    newXexHeader = (Xex2Header *)(outHeaders.data());
+    if (newXexHeader->securityOffset + sizeof(Xex2SecurityInfo) > headerTargetSize)
+    {
+        return Result::PatchFailed;
+    }
+
+    const Xex2SecurityInfo *newSecurityInfo = (const Xex2SecurityInfo *)(&outHeaders[newXexHeader->securityOffset]);
 
-    // Copy the rest of the data.
-    const Xex2SecurityInfo *newSecurityInfo = (const Xex2SecurityInfo *)(&outBytes[newXexHeader->securityOffset]);
-    outBytes.resize(outBytes.size() + newSecurityInfo->imageSize);
-    memset(&outBytes[headerTargetSize], 0, outBytes.size() - headerTargetSize);
-    memcpy(&outBytes[headerTargetSize], &xexBytes[xexHeader->headerSize], xexBytesSize - xexHeader->headerSize);
-    newXexHeader = (Xex2Header *)(outBytes.data());
-    newSecurityInfo = (const Xex2SecurityInfo *)(&outBytes[newXexHeader->securityOffset]);
-    
     // Decrypt the keys and validate that the patch is compatible with the base file.
     constexpr uint32_t KeySize = 16;
     const Xex2SecurityInfo *originalSecurityInfo = (const Xex2SecurityInfo *)(&xexBytes[xexHeader->securityOffset]);
     const Xex2SecurityInfo *patchSecurityInfo = (const Xex2SecurityInfo *)(&patchBytes[patchHeader->securityOffset]);
-    uint8_t decryptedOriginalKey[KeySize];
+    uint8_t *decryptedOriginalKey = originalKey;
     uint8_t decryptedNewKey[KeySize];
-    uint8_t decryptedPatchKey[KeySize];
+    uint8_t *decryptedPatchKey = patchKey;
     uint8_t decrpytedImageKeySource[KeySize];
     memcpy(decryptedOriginalKey, originalSecurityInfo->aesKey, KeySize);
     memcpy(decryptedNewKey, newSecurityInfo->aesKey, KeySize);
@@ -351,6 +465,35 @@ XexPatcher::Result XexPatcher::apply(const uint8_t* xexBytes, size_t xexBytesSiz
         return Result::PatchIncompatible;
     }
 
+    return Result::Success;
+}
+
+XexPatcher::Result XexPatcher::apply(const uint8_t* xexBytes, size_t xexBytesSize, const uint8_t* patchBytes, size_t patchBytesSize, std::vector<uint8_t> &outBytes, bool skipData)
+{
+    constexpr uint32_t KeySize = 16;
+    uint8_t decryptedOriginalKey[KeySize];
+    uint8_t decryptedPatchKey[KeySize];
+    Result result = applyHeaders(xexBytes, xexBytesSize, patchBytes, patchBytesSize, outBytes, decryptedOriginalKey, decryptedPatchKey);
+    if (result != Result::Success)
+    {
+        return result;
+    }
+
+    const Xex2Header *xexHeader = (const Xex2Header *)(xexBytes);
+    const Xex2Header *patchHeader = (const Xex2Header *)(patchBytes);
+    const Xex2SecurityInfo *originalSecurityInfo = (const Xex2SecurityInfo *)(&xexBytes[xexHeader->securityOffset]);
+    const uint32_t headerTargetSize = uint32_t(outBytes.size());
+    const uint32_t newXexHeaderSize = std::max(headerTargetSize, xexHeader->headerSize.get());
+
+    // Copy the rest of the data.
+    Xex2Header *newXexHeader = (Xex2Header *)(outBytes.data());
+    const Xex2SecurityInfo *newSecurityInfo = (const Xex2SecurityInfo *)(&outBytes[newXexHeader->securityOffset]);
+    outBytes.resize(outBytes.size() + newSecurityInfo->imageSize);
+    memset(&outBytes[headerTargetSize], 0, outBytes.size() - headerTargetSize);
+    memcpy(&outBytes[headerTargetSize], &xexBytes[xexHeader->headerSize], xexBytesSize - xexHeader->headerSize);
+    newXexHeader = (Xex2Header *)(outBytes.data());
+    newSecurityInfo = (const Xex2SecurityInfo *)(&outBytes[newXexHeader->securityOffset]);
+    
     // Don't process the rest of the patch.
     if (skipData)
     {
@@ -366,6 +509,7 @@ XexPatcher::Result XexPatcher::apply(const uint8_t* xexBytes, size_t xexBytesSiz
 
     if (fileFormatInfo->encryptionType == XEX_ENCRYPTION_NORMAL)
     {
+        AES_ctx aesContext;
         AES_init_ctx_iv(&aesContext, decryptedOriginalKey, AESBlankIV);
         AES_CBC_decrypt_buffer(&aesContext, &outBytes[headerTargetSize], xexBytesSize - xexHeader->headerSize);
     }
@@ -478,50 +622,73 @@ XexPatcher::Result XexPatcher::apply(const uint8_t* xexBytes, size_t xexBytesSiz
     newFileFormatInfo->encryptionType = XEX_ENCRYPTION_NONE;
     newFileFormatInfo->compressionType = XEX_COMPRESSION_NONE;
 
-    // Copy and decrypt patch data if necessary.
+    // Copy the patch data, applyImage decrypts it in place.
     std::vector<uint8_t> patchData;
     patchData.resize(patchBytesSize - patchHeader->headerSize);
     memcpy(patchData.data(), &patchBytes[patchHeader->headerSize], patchData.size());
 
+    return applyImage(patchBytes, patchData.data(), patchData.size(), decryptedPatchKey, &outBytes[newXexHeader->headerSize], outBytes.size() - newXexHeader->headerSize);
+}
+
+XexPatcher::Result XexPatcher::applyImage(const uint8_t* patchBytes, uint8_t* patchData, size_t patchDataSize, const uint8_t* patchKey, uint8_t* image, size_t imageSize, size_t* lzxBytes)
+{
+    const Xex2OptDeltaPatchDescriptor *patchDescriptor = (const Xex2OptDeltaPatchDescriptor *)(getOptHeaderPtr(patchBytes, XEX_HEADER_DELTA_PATCH_DESCRIPTOR));
+    const Xex2OptFileFormatInfo *patchFileFormatInfo = (const Xex2OptFileFormatInfo *)(getOptHeaderPtr(patchBytes, XEX_HEADER_FILE_FORMAT_INFO));
+    if (patchDescriptor == nullptr || patchFileFormatInfo == nullptr || patchFileFormatInfo->compressionType != XEX_COMPRESSION_DELTA)
+    {
+        return Result::PatchFileInvalid;
+    }
+
+    // Decrypt the patch data if necessary.
     if (patchFileFormatInfo->encryptionType == XEX_ENCRYPTION_NORMAL)
     {
-        AES_init_ctx_iv(&aesContext, decryptedPatchKey, AESBlankIV);
-        AES_CBC_decrypt_buffer(&aesContext, patchData.data(), patchData.size());
+        AesCbc::Context aesContext;
+        AesCbc::Init(aesContext, patchKey, AESBlankIV);
+        AesCbc::Decrypt(aesContext, patchData, patchDataSize & ~(AesCbc::BlockSize - 1));
     }
     else if (patchFileFormatInfo->encryptionType != XEX_ENCRYPTION_NONE)
     {
         return Result::PatchFileInvalid;
     }
 
-    const Xex2CompressedBlockInfo *currentBlock = &((const Xex2FileNormalCompressionInfo*)(patchFileFormatInfo + 1))->firstBlock;
-    uint8_t *outExe = &outBytes[newXexHeader->headerSize];
     if (patchDescriptor->deltaImageSourceOffset > 0)
     {
-        memcpy(&outExe[patchDescriptor->deltaImageTargetOffset], &outExe[patchDescriptor->deltaImageSourceOffset], patchDescriptor->deltaImageSourceSize);
+        if (patchDescriptor->deltaImageSourceOffset + size_t(patchDescriptor->deltaImageSourceSize) > imageSize
+            || patchDescriptor->deltaImageTargetOffset + size_t(patchDescriptor->deltaImageSourceSize) > imageSize)
+        {
+            return Result::PatchIncompatible;
+        }
+
+        memmove(&image[patchDescriptor->deltaImageTargetOffset], &image[patchDescriptor->deltaImageSourceOffset], patchDescriptor->deltaImageSourceSize);
     }
 
-    static const uint32_t DigestSize = 20;
-    uint8_t sha1Digest[DigestSize];
-    sha1::SHA1 sha1Context;
-    uint8_t *patchDataCursor = patchData.data();
+    const uint32_t windowSize = ((const Xex2FileNormalCompressionInfo*)(patchFileFormatInfo + 1))->windowSize;
+    const Xex2CompressedBlockInfo *currentBlock = &((const Xex2FileNormalCompressionInfo*)(patchFileFormatInfo + 1))->firstBlock;
+    uint8_t *patchDataCursor = patchData;
+    const uint8_t *patchDataEnd = patchData + patchDataSize;
+    uint8_t sha1Digest[Sha1::DigestSize];
+    mspack_pool_system pool;
     while (currentBlock->blockSize > 0)
     {
+        if (currentBlock->blockSize < sizeof(Xex2CompressedBlockInfo) || currentBlock->blockSize > size_t(patchDataEnd - patchDataCursor))
+        {
+            return Result::PatchFailed;
+        }
+
         const Xex2CompressedBlockInfo *nextBlock = (const Xex2CompressedBlockInfo *)(patchDataCursor);
 
         // Hash and validate the block.
-        sha1Context.reset();
-        sha1Context.processBytes(patchDataCursor, currentBlock->blockSize);
-        sha1Context.finalize(sha1Digest);
-        if (memcmp(sha1Digest, currentBlock->blockHash, DigestSize) != 0)
+        Sha1::Hash(patchDataCursor, currentBlock->blockSize, sha1Digest);
+        if (memcmp(sha1Digest, currentBlock->blockHash, Sha1::DigestSize) != 0)
         {
             return Result::PatchFailed;
         }
 
-        patchDataCursor += 24;
+        patchDataCursor += sizeof(Xex2CompressedBlockInfo);
 
         // Apply the block's patch data.
-        uint32_t blockDataSize = currentBlock->blockSize - 24;
-        if (lzxDeltaApplyPatch((const Xex2DeltaPatch *)(patchDataCursor), blockDataSize, ((const Xex2FileNormalCompressionInfo*)(patchFileFormatInfo + 1))->windowSize, outExe) != 0)
+        uint32_t blockDataSize = currentBlock->blockSize - sizeof(Xex2CompressedBlockInfo);
+        if (lzxDeltaApplyPatch((const Xex2DeltaPatch *)(patchDataCursor), blockDataSize, windowSize, image, imageSize, &pool) != 0)
         {
             return Result::PatchFailed;
         }
@@ -530,6 +697,11 @@ XexPatcher::Result XexPatcher::apply(const uint8_t* xexBytes, size_t xexBytesSiz
         currentBlock = nextBlock;
     }
 
+    if (lzxBytes != nullptr)
+    {
+        *lzxBytes = pool.bytes;
+    }
+
     return Result::Success;
 }
 
@@ -33,5 +33,16 @@ struct XexPatcher
     };
 
     static Result apply(const uint8_t* xexBytes, size_t xexBytesSize, const uint8_t* patchBytes, size_t patchBytesSize, std::vector<uint8_t> &outBytes, bool skipData);
+
+    // apply() in two halves, so the loader can patch an image while streaming it into guest
+    // memory instead of writing a patched XEX. applyHeaders builds the patched headers from
+    // the first targetHeaderSize() bytes of the base XEX and returns the decrypted base and
+    // patch keys. applyImage decrypts `patchData` (the patch file after its headers) in
+    // place and applies its delta blocks to the decompressed base image; `imageSize` is the
+    // patched image size and bounds every write. All delta blocks share one LZX window,
+    // whose allocation is returned in `lzxBytes`.
+    static uint32_t targetHeaderSize(const uint8_t* patchBytes, size_t patchBytesSize);
+    static Result applyHeaders(const uint8_t* xexBytes, size_t xexBytesSize, const uint8_t* patchBytes, size_t patchBytesSize, std::vector<uint8_t> &outHeaders, uint8_t* originalKey, uint8_t* patchKey);
+    static Result applyImage(const uint8_t* patchBytes, uint8_t* patchData, size_t patchDataSize, const uint8_t* patchKey, uint8_t* image, size_t imageSize, size_t* lzxBytes = nullptr);
     static Result apply(const std::filesystem::path &baseXexPath, const std::filesystem::path &patchXexPath, const std::filesystem::path &newXexPath);
 };
@@ -0,0 +1,200 @@
+#include "xex_verify.h"
+#include "sha1_engine.h"
+#include "nx/log/nxlogger.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+constexpr size_t VERIFY_WORKER_STACK_SIZE = 0x4000;
+constexpr int VERIFY_WORKER_PRIORITY = 0x2C;
+
+constexpr size_t NoFailure = std::numeric_limits<size_t>::max();
+
+XexBlockVerifier::XexBlockVerifier(size_t threadCount)
+{
+    mutexInit(&mutex);
+    condvarInit(&wake);
+    condvarInit(&idle);
+    firstFailure = NoFailure;
+
+    const size_t wanted = std::min(std::max(threadCount, size_t(1)), MaxThreads) - 1;
+
+    // Worker i runs on core i + 1; the loading thread is the application's main thread on core 0.
+    for (size_t i = 0; i < wanted; i++)
+    {
+        Result rc = threadCreate(&workers[workerCount], WorkerMain, this, nullptr, VERIFY_WORKER_STACK_SIZE,
+            VERIFY_WORKER_PRIORITY, int(i + 1));
+
+        if (R_SUCCEEDED(rc))
+        {
+            rc = threadStart(&workers[workerCount]);
+            if (R_FAILED(rc))
+                threadClose(&workers[workerCount]);
+        }
+
+        if (R_FAILED(rc))
+        {
+            SDLogger::Log("XexBlockVerifier - failed to start worker %zu: 0x%X", i, rc);
+            break;
+        }
+
+        workerCount++;
+    }
+}
+
+XexBlockVerifier::~XexBlockVerifier()
+{
+    mutexLock(&mutex);
+    quit = true;
+    condvarWakeAll(&wake);
+    mutexUnlock(&mutex);
+
+    for (size_t i = 0; i < workerCount; i++)
+    {
+        threadWaitForExit(&workers[i]);
+        threadClose(&workers[i]);
+    }
+}
+
+void XexBlockVerifier::Begin(const XexBlockHash* queued, size_t queuedCount)
+{
+    mutexLock(&mutex);
+
+    // A worker that woke up late for the previous batch may still be looking at the counter.
+    while (busy != 0)
+        condvarWait(&idle, &mutex);
+
+    blocks = queued;
+    count = queuedCount;
+    next = 0;
+    firstFailure = NoFailure;
+    generation++;
+
+    condvarWakeAll(&wake);
+    mutexUnlock(&mutex);
+}
+
+ptrdiff_t XexBlockVerifier::Wait()
+{
+    mutexLock(&mutex);
+    const XexBlockHash* queued = blocks;
+    const size_t queuedCount = count;
+    mutexUnlock(&mutex);
+
+    Work(queued, queuedCount);
+
+    // Every index has been handed out; whoever took one is still counted as busy.
+    mutexLock(&mutex);
+    while (busy != 0)
+        condvarWait(&idle, &mutex);
+    mutexUnlock(&mutex);
+
+    const size_t failure = firstFailure;
+    return failure == NoFailure ? -1 : ptrdiff_t(failure);
+}
+
+void XexBlockVerifier::Work(const XexBlockHash* queued, size_t queuedCount)
+{
+    for (size_t i = next.fetch_add(1, std::memory_order_relaxed); i < queuedCount; i = next.fetch_add(1, std::memory_order_relaxed))
+    {
+        uint8_t digest[0x14];
+        Sha1::Hash(queued[i].data, queued[i].size, digest);
+
+        if (memcmp(digest, queued[i].expected, sizeof(digest)) == 0)
+            continue;
+
+        size_t failure = firstFailure.load(std::memory_order_relaxed);
+        while (i < failure && !firstFailure.compare_exchange_weak(failure, i, std::memory_order_relaxed))
+        {
+        }
+    }
+}
+
+void XexBlockVerifier::WorkerMain(void* arg)
+{
+    auto* verifier = static_cast<XexBlockVerifier*>(arg);
+    uint64_t seen = 0;
+
+    mutexLock(&verifier->mutex);
+
+    while (true)
+    {
+        while (!verifier->quit && verifier->generation == seen)
+            condvarWait(&verifier->wake, &verifier->mutex);
+
+        if (verifier->quit)
+            break;
+
+        seen = verifier->generation;
+        const XexBlockHash* queued = verifier->blocks;
+        const size_t queuedCount = verifier->count;
+        verifier->busy++;
+
+        mutexUnlock(&verifier->mutex);
+        verifier->Work(queued, queuedCount);
+        mutexLock(&verifier->mutex);
+
+        if (--verifier->busy == 0)
+            condvarWakeAll(&verifier->idle);
+    }
+
+    mutexUnlock(&verifier->mutex);
+}
+
+void XexBlockVerifier::RunBenchmark()
+{
+    // Roughly the size of a retail image's compressed payload, in blocks of the usual size.
+    constexpr size_t BlockSize = 0x10000;
+    constexpr size_t BlockCount = 128;
+    constexpr size_t Rounds = 4;
+
+    auto data = std::make_unique<uint8_t[]>(BlockSize * BlockCount);
+    uint32_t seed = 0x58455832;
+    for (size_t i = 0; i < BlockSize * BlockCount; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        data[i] = uint8_t(seed >> 24);
+    }
+
+    std::vector<XexBlockHash> hashes(BlockCount);
+    for (size_t i = 0; i < BlockCount; i++)
+    {
+        hashes[i].data = data.get() + i * BlockSize;
+        hashes[i].size = BlockSize;
+
+        Sha1::Hash(hashes[i].data, BlockSize, hashes[i].expected);
+    }
+
+    // One corrupted block, to check the reported index rather than just the count.
+    constexpr size_t CorruptBlock = BlockCount * 3 / 4;
+
+    SDLogger::Log("XexBlockVerifier::RunBenchmark - %zu blocks of %zu KiB", BlockCount, BlockSize / 1024);
+    SDLogger::Log("%-8s %10s %8s %10s", "threads", "MB/s", "speedup", "detected");
+
+    uint64_t baseline = 0;
+
+    for (size_t threads = 1; threads <= MaxThreads; threads++)
+    {
+        XexBlockVerifier verifier(threads);
+
+        const uint64_t start = armGetSystemTick();
+        bool clean = true;
+
+        for (size_t round = 0; round < Rounds; round++)
+            clean &= verifier.Verify(hashes.data(), BlockCount) < 0;
+
+        const uint64_t ns = armTicksToNs(armGetSystemTick() - start);
+        if (threads == 1)
+            baseline = ns;
+
+        hashes[CorruptBlock].expected[0] ^= 1;
+        const ptrdiff_t failure = verifier.Verify(hashes.data(), BlockCount);
+        hashes[CorruptBlock].expected[0] ^= 1;
+
+        const double megabytes = double(BlockSize * BlockCount * Rounds) / (1024.0 * 1024.0);
+        SDLogger::Log("%-8zu %10.1f %7.2fx %10s", verifier.GetThreadCount(), ns != 0 ? megabytes * 1e9 / double(ns) : 0.0,
+            ns != 0 ? double(baseline) / double(ns) : 0.0, clean && failure == ptrdiff_t(CorruptBlock) ? "yes" : "NO");
+    }
+}
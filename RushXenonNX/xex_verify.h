@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <switch.h>
+
+// How much checking the compressed blocks of a normally compressed XEX get.
+enum class XexVerifyMode : uint8_t
+{
+    // Every block is hashed before any of its data reaches the decompressor.
+    Full,
+
+    // Blocks are hashed on the other cores while they are being decompressed; a mismatch
+    // still fails the load, only after the bad data has gone through LZX.
+    Deferred,
+
+    // No hashing, for images that were already verified once (a trusted cached copy).
+    Skip,
+};
+
+struct XexBlockHash
+{
+    const uint8_t* data;
+    uint32_t size;
+    uint8_t expected[0x14];
+};
+
+// Each block's SHA-1 is stored in the header of the block before it, so once the chain
+// has been walked every hash is known up front and the blocks can be checked in any
+// order. Workers pull block indices from a shared counter; the thread that waits for
+// the result pulls from the same counter until the queue is empty.
+class XexBlockVerifier
+{
+public:
+    // The cores an application gets; the fourth belongs to the system.
+    static constexpr size_t MaxThreads = 3;
+
+    // `threadCount` includes the caller: 1 hashes everything on the calling thread.
+    explicit XexBlockVerifier(size_t threadCount = MaxThreads);
+    ~XexBlockVerifier();
+
+    XexBlockVerifier(const XexBlockVerifier&) = delete;
+    XexBlockVerifier& operator=(const XexBlockVerifier&) = delete;
+
+    // Queues `count` blocks for the workers and returns. The blocks must stay in place
+    // until Wait returns.
+    void Begin(const XexBlockHash* blocks, size_t count);
+
+    // Helps with whatever is still queued, then waits for the workers. Returns the index
+    // of the first block whose hash does not match, or -1.
+    ptrdiff_t Wait();
+
+    ptrdiff_t Verify(const XexBlockHash* blocks, size_t count)
+    {
+        Begin(blocks, count);
+        return Wait();
+    }
+
+    size_t GetThreadCount() const
+    {
+        return workerCount + 1;
+    }
+
+    // Hashing throughput over a synthetic chain for 1 to MaxThreads threads.
+    static void RunBenchmark();
+
+private:
+    static void WorkerMain(void* arg);
+    void Work(const XexBlockHash* blocks, size_t count);
+
+    Thread workers[MaxThreads - 1]{};
+    size_t workerCount{};
+
+    Mutex mutex{};
+    CondVar wake{};
+    CondVar idle{};
+
+    // Guarded by `mutex`.
+    const XexBlockHash* blocks{};
+    size_t count{};
+    uint64_t generation{};
+    size_t busy{};
+    bool quit{};
+
+    std::atomic<size_t> next{};
+    std::atomic<size_t> firstFailure{};
+};